@@ -0,0 +1,267 @@
+// ============= actor.c =============
+// Actor de vehículos: el único thread que modifica el estado de la flota.
+// Comandos, pasos de simulación y estados grabados llegan por una cola MPSC
+// acotada y sin locks (la misma cola de Vyukov que el ring del logger) y se
+// aplican en orden de llegada; las reglas de los comandos se evalúan en el
+// mismo thread que la escritura, sin mutex por vehículo.
+//
+// Con la cola vacía el actor duerme en un eventfd. Antes anuncia que va a
+// dormir y vuelve a mirar la cola; el productor que encola después de ese
+// anuncio lo despierta. Cada despertar vacía todo lo encolado (lote).
+//
+// Quien necesita el resultado espera en un hueco de completado (futex):
+//   0 = pendiente, 1 = completado, 2 = pendiente con alguien dormido.
+// Los reactores no pueden esperar (pararían todas las conexiones del shard):
+// su hueco trae un 'notify' con el que el actor les entrega el resultado.
+#define _GNU_SOURCE
+#include "actor.h"
+#include "telemetry.h"
+#include "metrics.h"
+#include "logger.h"
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+
+typedef enum {
+    ACTOR_COMMANDS,
+    ACTOR_SIMULATE,
+    ACTOR_SET_STATE,
+    ACTOR_SYNC
+} ActorOp;
+
+typedef struct {
+    atomic_size_t seq;
+    ActorOp op;
+    uint32_t vehicle;
+    int count;
+    CommandType commands[COMMAND_MAX_BATCH];
+    VehicleState state;
+    ActorCompletion* slot;      // NULL si nadie espera
+} ActorMessage;
+
+static ActorMessage queue[ACTOR_QUEUE_SIZE];
+static atomic_size_t enqueue_pos = 0;
+static size_t dequeue_pos = 0;          // Solo lo usa el actor
+
+static int wakeup_fd = -1;
+static atomic_int sleeping = 0;
+
+// Reserva una celda libre de la cola. Devuelve NULL si está llena.
+static ActorMessage* queue_claim(size_t* pos_out) {
+    size_t pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+
+    while (1) {
+        ActorMessage* msg = &queue[pos & (ACTOR_QUEUE_SIZE - 1)];
+        size_t seq = atomic_load_explicit(&msg->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                *pos_out = pos;
+                return msg;
+            }
+        } else if (diff < 0) {
+            return NULL; // Llena: el actor aún no liberó esta celda
+        } else {
+            pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+static ActorMessage* queue_head() {
+    ActorMessage* msg = &queue[dequeue_pos & (ACTOR_QUEUE_SIZE - 1)];
+    size_t seq = atomic_load_explicit(&msg->seq, memory_order_acquire);
+    return seq == dequeue_pos + 1 ? msg : NULL;
+}
+
+static void completion_wait(ActorCompletion* slot) {
+    unsigned int expected = 0;
+    // Si el actor aún no terminó, marcar que hay alguien dormido
+    if (!atomic_compare_exchange_strong(&slot->state, &expected, 2) && expected == 1) return;
+
+    while (atomic_load_explicit(&slot->state, memory_order_acquire) != 1) {
+        syscall(SYS_futex, &slot->state, FUTEX_WAIT_PRIVATE, 2, NULL, NULL, 0);
+    }
+}
+
+static void completion_signal(ActorCompletion* slot) {
+    if (atomic_exchange_explicit(&slot->state, 1, memory_order_acq_rel) == 2) {
+        syscall(SYS_futex, &slot->state, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+// Encola un mensaje (copiado de 'msg' salvo 'seq') y despierta al actor si
+// dormía
+static void post(const ActorMessage* msg) {
+    size_t pos;
+    ActorMessage* cell = queue_claim(&pos);
+    unsigned long wait_start = 0;
+    while (!cell) {
+        if (!wait_start) wait_start = metrics_now_ns();
+        sched_yield(); // Llena: esperar a que el actor libere hueco
+        cell = queue_claim(&pos);
+    }
+    if (wait_start) metrics_lock_wait(METRIC_LOCK_VEHICLE, metrics_now_ns() - wait_start);
+
+    cell->op = msg->op;
+    cell->vehicle = msg->vehicle;
+    cell->count = msg->count;
+    if (msg->op == ACTOR_COMMANDS) {
+        memcpy(cell->commands, msg->commands, msg->count * sizeof(CommandType));
+    }
+    if (msg->op == ACTOR_SET_STATE) cell->state = msg->state;
+    cell->slot = msg->slot;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+
+    // Pareja del anuncio del actor: o él ve este mensaje o aquí se ve que duerme
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&sleeping, memory_order_relaxed) && atomic_exchange(&sleeping, 0)) {
+        uint64_t one = 1;
+        if (write(wakeup_fd, &one, sizeof(one)) < 0) log_error("No se pudo despertar al actor");
+    }
+}
+
+// Encola y espera el resultado en 'slot'
+static void call(ActorMessage* msg, ActorCompletion* slot) {
+    atomic_store_explicit(&slot->state, 0, memory_order_relaxed);
+    msg->slot = slot;
+    post(msg);
+    completion_wait(slot);
+}
+
+static void apply(ActorMessage* msg) {
+    ActorCompletion* slot = msg->slot;
+
+    switch (msg->op) {
+        case ACTOR_COMMANDS:
+            slot->applied = telemetry_apply_commands(msg->vehicle, msg->commands, msg->count,
+                                                     slot->steps, slot->reason);
+            break;
+
+        case ACTOR_SIMULATE:
+            simulate_vehicle_changes();
+            break;
+
+        case ACTOR_SET_STATE:
+            telemetry_set_state(msg->vehicle, &msg->state);
+            break;
+
+        case ACTOR_SYNC:
+            break;
+    }
+
+    if (!slot) return;
+    if (slot->notify) slot->notify(slot);
+    else completion_signal(slot);
+}
+
+// Aplica todo lo encolado. Devuelve el número de mensajes.
+static int drain_queue() {
+    int applied = 0;
+    ActorMessage* msg;
+
+    while ((msg = queue_head()) != NULL) {
+        apply(msg);
+        atomic_store_explicit(&msg->seq, dequeue_pos + ACTOR_QUEUE_SIZE, memory_order_release);
+        dequeue_pos++;
+        applied++;
+    }
+    return applied;
+}
+
+static void* actor_thread(void* arg) {
+    (void)arg;
+
+    while (1) {
+        int applied = drain_queue();
+        if (applied > 0) {
+            metrics_add(METRIC_ACTOR_BATCHES, 1);
+            metrics_add(METRIC_ACTOR_MESSAGES, applied);
+            continue;
+        }
+
+        // Anunciar que se va a dormir y mirar otra vez (ver post())
+        atomic_store(&sleeping, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (queue_head()) {
+            atomic_store(&sleeping, 0);
+            continue;
+        }
+
+        uint64_t counter;
+        if (read(wakeup_fd, &counter, sizeof(counter)) < 0) atomic_store(&sleeping, 0);
+    }
+
+    return NULL;
+}
+
+int actor_start() {
+    for (size_t i = 0; i < ACTOR_QUEUE_SIZE; i++) {
+        atomic_init(&queue[i].seq, i);
+    }
+
+    wakeup_fd = eventfd(0, EFD_CLOEXEC);
+    if (wakeup_fd < 0) return -1;
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, actor_thread, NULL) != 0) {
+        close(wakeup_fd);
+        wakeup_fd = -1;
+        return -1;
+    }
+    pthread_detach(thread);
+
+    log_info("Actor de vehículos iniciado (único escritor del estado de la flota)");
+    return 0;
+}
+
+static void commands_message(ActorMessage* msg, ActorCompletion* slot, uint32_t vehicle,
+                             const CommandType* commands, int count, VehicleState* steps,
+                             char* reason) {
+    msg->op = ACTOR_COMMANDS;
+    msg->vehicle = vehicle;
+    msg->count = count;
+    memcpy(msg->commands, commands, count * sizeof(CommandType));
+
+    slot->steps = steps;
+    slot->reason = reason;
+}
+
+int actor_apply_commands(ActorCompletion* slot, uint32_t vehicle, const CommandType* commands,
+                         int count, VehicleState* steps, char* reason) {
+    ActorMessage msg;
+    commands_message(&msg, slot, vehicle, commands, count, steps, reason);
+    call(&msg, slot);
+    return slot->applied;
+}
+
+void actor_post_commands(ActorCompletion* slot, uint32_t vehicle, const CommandType* commands,
+                         int count, VehicleState* steps, char* reason) {
+    ActorMessage msg;
+    commands_message(&msg, slot, vehicle, commands, count, steps, reason);
+    msg.slot = slot;
+    post(&msg);
+}
+
+void actor_simulate() {
+    ActorMessage msg = { .op = ACTOR_SIMULATE };
+    ActorCompletion slot = { .notify = NULL };
+    call(&msg, &slot);
+}
+
+void actor_set_state(uint32_t vehicle, const VehicleState* state) {
+    ActorMessage msg = { .op = ACTOR_SET_STATE, .vehicle = vehicle, .state = *state };
+    post(&msg);
+}
+
+void actor_sync() {
+    ActorMessage msg = { .op = ACTOR_SYNC };
+    ActorCompletion slot = { .notify = NULL };
+    call(&msg, &slot);
+}
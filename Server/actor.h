@@ -0,0 +1,49 @@
+// ============= actor.h =============
+#ifndef ACTOR_H
+#define ACTOR_H
+
+#include "protocol.h"
+#include <stdint.h>
+#include <stdatomic.h>
+
+// Mensajes en la cola del actor (potencia de 2). Con la cola llena el
+// productor espera hueco (métrica lock="vehicle").
+#define ACTOR_QUEUE_SIZE 1024
+
+typedef struct ActorCompletion ActorCompletion;
+
+// Aviso de resultado listo. Lo llama el thread del actor: no debe bloquear.
+typedef void (*ActorNotify)(ActorCompletion* slot);
+
+// Hueco de completado: el actor deja aquí el resultado de una petición y
+// despierta a quien espera (futex) o, si hay 'notify', lo avisa. Cada
+// conexión tiene el suyo (procesa sus mensajes de uno en uno), así que
+// nunca hay dos peticiones en el mismo.
+struct ActorCompletion {
+    atomic_uint state;          // Palabra del futex (ver actor.c)
+    int applied;
+    VehicleState* steps;
+    char* reason;
+    ActorNotify notify;         // NULL: se espera en el futex (modo threads)
+};
+
+// Arranca el thread del actor: desde aquí solo él modifica el estado de la
+// flota. Devuelve -1 si no se pudo crear.
+int actor_start();
+
+// Valida y aplica un lote de comandos en el actor y espera el resultado
+// (mismo contrato que telemetry_apply_commands)
+int actor_apply_commands(ActorCompletion* slot, uint32_t vehicle, const CommandType* commands,
+                         int count, VehicleState* steps, char* reason);
+// Lo mismo sin esperar (reactores): el actor deja el resultado en 'slot' y
+// llama a slot->notify. 'steps' y 'reason' deben seguir vivos hasta entonces.
+void actor_post_commands(ActorCompletion* slot, uint32_t vehicle, const CommandType* commands,
+                         int count, VehicleState* steps, char* reason);
+// Un paso de simulación de toda la flota. Espera a que se aplique.
+void actor_simulate();
+// Sustituye el estado de un vehículo (grabación y reproducción). No espera.
+void actor_set_state(uint32_t vehicle, const VehicleState* state);
+// Espera a que se aplique todo lo que este thread encoló antes
+void actor_sync();
+
+#endif // ACTOR_H
@@ -1,79 +1,329 @@
 // ============= auth.c =============
+// Autenticación de administradores.
+//
+// - Usuarios: se cargan al arrancar de un archivo "usuario:hash", con hashes
+//   salados de crypt(3) (p. ej. SHA-512, "$6$sal$..."). Tras la carga la
+//   tabla es de solo lectura y se indexa con una tabla hash: las búsquedas
+//   no toman locks.
+// - Tokens: uno por sesión (cada AUTH crea uno nuevo sin invalidar los de
+//   otras conexiones del mismo usuario). Se guardan en una tabla hash por
+//   token repartida en shards, cada uno con su mutex, así que validar es O(1)
+//   y los admins casi nunca compiten por el mismo lock. Cada shard tiene una
+//   rueda de temporizadores que expira los tokens sin recorrer la tabla.
+#define _GNU_SOURCE
 #include "auth.h"
+#include "logger.h"
+#include "timer_wheel.h"
+#include "metrics.h"
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
 #include <stdio.h>
+#include <pthread.h>
+#include <crypt.h>
+#include <sys/random.h>
+
+// ---- Base de usuarios (solo lectura tras auth_init) ----
 
-// Base de datos simple de usuarios (en producción usar BD)
 typedef struct {
     char username[MAX_USERNAME];
-    char password[MAX_PASSWORD];
-    char token[MAX_TOKEN];
-    time_t token_expiry;
+    char hash[AUTH_MAX_HASH];
 } UserCredential;
 
-#define MAX_USERS 10
-static UserCredential users[MAX_USERS];
+static UserCredential* users = NULL;
 static int user_count = 0;
+static int* user_index = NULL;      // Direccionamiento abierto: posición en users[] o -1
+static unsigned int user_index_mask = 0;
+
+// Hash para usuarios sin cuenta: se verifica igual para no delatar por tiempo
+// qué usuarios existen
+static const char* dummy_hash = "$6$vatpdummy$Y6CgS9mbXFmzQxzqJPv2V0JgYeO7mUQnZkPc"
+                                "T5O3hX7rWnGkPp0oFVx7p8N9WgGfEw1GnUq1n2K3m4L5o6P7q.";
 
-void auth_init() {
-    // Inicializar con algunos usuarios de prueba
-    strcpy(users[0].username, "admin");
-    strcpy(users[0].password, "admin123");
-    users[0].token[0] = '\0';
-    users[0].token_expiry = 0;
-    user_count = 1;
-    
-    strcpy(users[1].username, "admin2");
-    strcpy(users[1].password, "pass456");
-    users[1].token[0] = '\0';
-    users[1].token_expiry = 0;
-    user_count = 2;
+static unsigned int hash_string(const char* str) {
+    unsigned int hash = 2166136261u; // FNV-1a
+    while (*str) {
+        hash ^= (unsigned char)*str++;
+        hash *= 16777619u;
+    }
+    return hash;
 }
 
-// Genera un token simple (en producción usar UUID o JWT)
-static void generate_token(char* token_out) {
-    srand(time(NULL) + rand());
-    sprintf(token_out, "TOKEN_%ld_%d", time(NULL), rand() % 100000);
+// Compara sin cortar en la primera diferencia (tiempo independiente del
+// contenido, solo de la longitud de 'expected')
+static int constant_time_equals(const char* expected, const char* given) {
+    size_t len = strlen(expected);
+    size_t given_len = strnlen(given, len + 1);
+    unsigned char diff = given_len != len;
+
+    for (size_t i = 0; i < len; i++) {
+        diff |= (unsigned char)expected[i] ^ (unsigned char)(i < given_len ? given[i] : 0);
+    }
+    return diff == 0;
 }
 
-int authenticate_user(const char* username, const char* password, char* token_out) {
-    for (int i = 0; i < user_count; i++) {
-        if (strcmp(users[i].username, username) == 0 &&
-            strcmp(users[i].password, password) == 0) {
-            
-            // Generar nuevo token
-            generate_token(users[i].token);
-            users[i].token_expiry = time(NULL) + 3600; // Token válido por 1 hora
-            
-            strcpy(token_out, users[i].token);
-            return 1; // Autenticación exitosa
-        }
+static const UserCredential* find_user(const char* username) {
+    if (!user_index) return NULL;
+
+    unsigned int pos = hash_string(username) & user_index_mask;
+    while (user_index[pos] >= 0) {
+        const UserCredential* user = &users[user_index[pos]];
+        if (strcmp(user->username, username) == 0) return user;
+        pos = (pos + 1) & user_index_mask;
     }
-    return 0; // Credenciales inválidas
+    return NULL;
 }
 
-int validate_token(const char* username, const char* token) {
+// Índice a un ~50% de ocupación como máximo
+static int build_user_index() {
+    unsigned int size = 16;
+    while (size < (unsigned int)user_count * 2) size *= 2;
+
+    user_index = malloc(size * sizeof(int));
+    if (!user_index) return -1;
+    for (unsigned int i = 0; i < size; i++) user_index[i] = -1;
+    user_index_mask = size - 1;
+
     for (int i = 0; i < user_count; i++) {
-        if (strcmp(users[i].username, username) == 0) {
-            // Verificar token y expiración
-            if (strcmp(users[i].token, token) == 0 &&
-                time(NULL) < users[i].token_expiry) {
-                return 1; // Token válido
+        unsigned int pos = hash_string(users[i].username) & user_index_mask;
+        while (user_index[pos] >= 0) pos = (pos + 1) & user_index_mask;
+        user_index[pos] = i;
+    }
+    return 0;
+}
+
+// Lee el archivo de usuarios: una línea "usuario:hash" por cuenta; las líneas
+// vacías y las que empiezan por '#' se ignoran. Un usuario repetido conserva
+// la primera definición.
+static int load_users(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) return -1;
+
+    int capacity = 0;
+    char line[MAX_USERNAME + AUTH_MAX_HASH + 8];
+    int line_no = 0;
+
+    while (fgets(line, sizeof(line), file)) {
+        line_no++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') continue;
+
+        char* sep = strchr(line, ':');
+        if (!sep || sep == line || sep - line >= MAX_USERNAME ||
+            strlen(sep + 1) >= AUTH_MAX_HASH || sep[1] != '$') {
+            char msg[128];
+            snprintf(msg, sizeof(msg), "%s:%d: entrada de usuario inválida, se ignora", path, line_no);
+            log_error(msg);
+            continue;
+        }
+
+        if (user_count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            UserCredential* grown = realloc(users, capacity * sizeof(UserCredential));
+            if (!grown) {
+                fclose(file);
+                return -1;
             }
-            return 0; // Token inválido o expirado
+            users = grown;
         }
+
+        *sep = '\0';
+        strcpy(users[user_count].username, line);
+        strcpy(users[user_count].hash, sep + 1);
+        user_count++;
     }
-    return 0; // Usuario no encontrado
+
+    fclose(file);
+    return 0;
 }
 
-void revoke_token(const char* username) {
-    for (int i = 0; i < user_count; i++) {
-        if (strcmp(users[i].username, username) == 0) {
-            users[i].token[0] = '\0';
-            users[i].token_expiry = 0;
-            return;
+// ---- Tokens ----
+
+typedef struct TokenEntry {
+    TimerEntry timer;            // Primero: la rueda devuelve punteros a la entrada
+    struct TokenEntry* next;     // Cadena del bucket
+    unsigned int hash;
+    char token[MAX_TOKEN];
+    char username[MAX_USERNAME];
+} TokenEntry;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    TokenEntry** buckets;
+    unsigned int bucket_mask;
+    int count;
+    TimerWheel wheel;            // Ticks de un segundo (reloj monotónico)
+} __attribute__((aligned(64))) TokenShard;
+
+static TokenShard token_shards[AUTH_TOKEN_SHARDS];
+
+static unsigned long now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+static TokenShard* shard_for(unsigned int hash) {
+    return &token_shards[hash % AUTH_TOKEN_SHARDS];
+}
+
+static TokenEntry** bucket_for(TokenShard* shard, unsigned int hash) {
+    return &shard->buckets[(hash / AUTH_TOKEN_SHARDS) & shard->bucket_mask];
+}
+
+// Requiere el mutex del shard
+static void unlink_token(TokenShard* shard, TokenEntry* entry) {
+    TokenEntry** link = bucket_for(shard, entry->hash);
+    while (*link && *link != entry) link = &(*link)->next;
+    if (*link) *link = entry->next;
+
+    timer_wheel_remove(&entry->timer);
+    shard->count--;
+    free(entry);
+}
+
+// Vence los tokens cuyo plazo pasó. Requiere el mutex del shard.
+static void expire_tokens(TokenShard* shard) {
+    TimerEntry* expired = timer_wheel_advance(&shard->wheel, now_seconds());
+    while (expired) {
+        TokenEntry* entry = (TokenEntry*)expired;
+        expired = expired->next;
+        unlink_token(shard, entry);
+    }
+}
+
+// Duplica los buckets cuando hay más tokens que buckets. Requiere el mutex.
+static void grow_buckets(TokenShard* shard) {
+    unsigned int old_size = shard->bucket_mask + 1;
+    unsigned int new_size = old_size * 2;
+    TokenEntry** buckets = calloc(new_size, sizeof(TokenEntry*));
+    if (!buckets) return; // Se sigue con cadenas más largas
+
+    TokenEntry** old = shard->buckets;
+    shard->buckets = buckets;
+    shard->bucket_mask = new_size - 1;
+
+    for (unsigned int i = 0; i < old_size; i++) {
+        TokenEntry* entry = old[i];
+        while (entry) {
+            TokenEntry* next = entry->next;
+            TokenEntry** head = bucket_for(shard, entry->hash);
+            entry->next = *head;
+            *head = entry;
+            entry = next;
         }
     }
+    free(old);
+}
+
+// Token aleatorio del sistema (no predecible): "TOKEN_" + 32 dígitos hex
+static int generate_token(char* token_out) {
+    unsigned char bytes[16];
+    if (getrandom(bytes, sizeof(bytes), 0) != sizeof(bytes)) return -1;
+
+    int len = sprintf(token_out, "TOKEN_");
+    for (size_t i = 0; i < sizeof(bytes); i++) {
+        len += sprintf(token_out + len, "%02x", bytes[i]);
+    }
+    return 0;
+}
+
+static int store_token(const char* token, const char* username) {
+    TokenEntry* entry = calloc(1, sizeof(TokenEntry));
+    if (!entry) return -1;
+
+    strcpy(entry->token, token);
+    strcpy(entry->username, username);
+    entry->hash = hash_string(token);
+
+    TokenShard* shard = shard_for(entry->hash);
+    metrics_lock(&shard->mutex, METRIC_LOCK_TOKENS);
+
+    expire_tokens(shard);
+    if (shard->count >= (int)(shard->bucket_mask + 1)) grow_buckets(shard);
+
+    TokenEntry** head = bucket_for(shard, entry->hash);
+    entry->next = *head;
+    *head = entry;
+    shard->count++;
+    timer_wheel_add(&shard->wheel, &entry->timer, now_seconds() + AUTH_TOKEN_TTL);
+
+    pthread_mutex_unlock(&shard->mutex);
+    return 0;
+}
+
+// Requiere el mutex del shard
+static TokenEntry* find_token(TokenShard* shard, const char* token, unsigned int hash) {
+    TokenEntry* entry = *bucket_for(shard, hash);
+    while (entry) {
+        if (entry->hash == hash && constant_time_equals(entry->token, token)) return entry;
+        entry = entry->next;
+    }
+    return NULL;
+}
+
+// ---- API ----
+
+int auth_init(const char* users_file) {
+    unsigned long now = now_seconds();
+    for (int i = 0; i < AUTH_TOKEN_SHARDS; i++) {
+        TokenShard* shard = &token_shards[i];
+        pthread_mutex_init(&shard->mutex, NULL);
+        shard->buckets = calloc(AUTH_TOKEN_BUCKETS, sizeof(TokenEntry*));
+        if (!shard->buckets) return -1;
+        shard->bucket_mask = AUTH_TOKEN_BUCKETS - 1;
+        timer_wheel_init(&shard->wheel, now);
+    }
+
+    if (load_users(users_file) < 0 || build_user_index() < 0) return -1;
+
+    char msg[256];
+    snprintf(msg, sizeof(msg), "%d usuarios cargados de %s", user_count, users_file);
+    log_info(msg);
+    return 0;
+}
+
+int authenticate_user(const char* username, const char* password, char* token_out) {
+    const UserCredential* user = find_user(username);
+    const char* expected = user ? user->hash : dummy_hash;
+
+    // crypt_r: el estado va en el heap (es grande) y cada llamada usa el suyo
+    struct crypt_data* data = calloc(1, sizeof(struct crypt_data));
+    if (!data) return 0;
+    const char* computed = crypt_r(password, expected, data);
+    int valid = computed && computed[0] != '*' && constant_time_equals(expected, computed);
+    free(data);
+
+    if (!user || !valid) return 0; // Credenciales inválidas
+
+    // Generar nuevo token para esta sesión
+    if (generate_token(token_out) < 0 || store_token(token_out, user->username) < 0) {
+        return 0;
+    }
+    return 1; // Autenticación exitosa
+}
+
+int validate_token(const char* username, const char* token) {
+    unsigned int hash = hash_string(token);
+    TokenShard* shard = shard_for(hash);
+
+    metrics_lock(&shard->mutex, METRIC_LOCK_TOKENS);
+    expire_tokens(shard);
+    TokenEntry* entry = find_token(shard, token, hash);
+    int valid = entry && strcmp(entry->username, username) == 0;
+    pthread_mutex_unlock(&shard->mutex);
+
+    return valid; // 0: token inválido, expirado o de otro usuario
+}
+
+void revoke_token(const char* token) {
+    if (!token[0]) return;
+
+    unsigned int hash = hash_string(token);
+    TokenShard* shard = shard_for(hash);
+
+    metrics_lock(&shard->mutex, METRIC_LOCK_TOKENS);
+    TokenEntry* entry = find_token(shard, token, hash);
+    if (entry) unlink_token(shard, entry);
+    pthread_mutex_unlock(&shard->mutex);
 }
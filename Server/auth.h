@@ -4,9 +4,19 @@
 
 #include "protocol.h"
 
-void auth_init();
+// Archivo de usuarios por defecto (relativo al directorio de trabajo)
+#define AUTH_DEFAULT_USERS_FILE "users.db"
+// Longitud máxima del hash de crypt(3) en el archivo de usuarios
+#define AUTH_MAX_HASH 128
+// Vida de un token (segundos)
+#define AUTH_TOKEN_TTL 3600
+// Shards de la tabla de tokens y buckets iniciales de cada uno (potencias de 2)
+#define AUTH_TOKEN_SHARDS 16
+#define AUTH_TOKEN_BUCKETS 64
+
+int auth_init(const char* users_file);
 int authenticate_user(const char* username, const char* password, char* token_out);
 int validate_token(const char* username, const char* token);
-void revoke_token(const char* username);
+void revoke_token(const char* token);
 
-#endif // AUTH_H
\ No newline at end of file
+#endif // AUTH_H
@@ -0,0 +1,172 @@
+// ============= bench/bench_codec.c =============
+// Benchmark de codificación: VATP/1.0 (texto) frente a VATP/2.0 (binario).
+//
+// Casos:
+//   formato %.2f       - sprintf frente al formateador de punto fijo
+//   encode telemetría  - build_telemetry_message (texto) vs registro fijo de 16 bytes
+//   decode telemetría  - sscanf como hacen los clientes vs decode_binary_telemetry
+//   parse COMMAND      - StreamParser en modo texto vs trama binaria
+//   encode delta       - delta con un solo campo cambiado (temperatura)
+//
+// Uso: bench_codec [iteraciones]   (por defecto: 1000000)
+#include "../protocol.h"
+#include "../parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Evita que el compilador elimine el trabajo medido
+static volatile unsigned long sink;
+
+static void report(const char* name, const char* codec, double seconds, long iterations, int bytes) {
+    printf("%-20s %-8s %8.1f ns/op  %5d bytes\n", name, codec, seconds / iterations * 1e9, bytes);
+}
+
+static void bench_format(long iterations) {
+    char buffer[64];
+    int len = 0;
+
+    double start = now_seconds();
+    for (long i = 0; i < iterations; i++) {
+        len = sprintf(buffer, "%.2f", (float)(i % 10000) / 7.0f);
+        sink += buffer[len - 1];
+    }
+    report("formato %.2f", "sprintf", now_seconds() - start, iterations, len);
+
+    start = now_seconds();
+    for (long i = 0; i < iterations; i++) {
+        len = format_fixed2(buffer, (float)(i % 10000) / 7.0f);
+        sink += buffer[len - 1];
+    }
+    report("formato %.2f", "fijo", now_seconds() - start, iterations, len);
+}
+
+static void bench_encode(long iterations, const VehicleState* state) {
+    char buffer[BUFFER_SIZE];
+    VehicleState copy = *state;
+    int len = 0;
+
+    double start = now_seconds();
+    for (long i = 0; i < iterations; i++) {
+        copy.speed = (float)(i % 100);
+        len = build_telemetry_message(buffer, &copy);
+        sink += buffer[len / 2];
+    }
+    report("encode telemetría", "texto", now_seconds() - start, iterations, len);
+
+    start = now_seconds();
+    for (long i = 0; i < iterations; i++) {
+        copy.speed = (float)(i % 100);
+        len = build_binary_telemetry(buffer, &copy);
+        sink += buffer[len / 2];
+    }
+    report("encode telemetría", "binario", now_seconds() - start, iterations, len);
+}
+
+static void bench_decode(long iterations, const VehicleState* state) {
+    char text[BUFFER_SIZE], binary[BUFFER_SIZE];
+    int text_len = build_telemetry_message(text, (VehicleState*)state);
+    int binary_len = build_binary_telemetry(binary, state);
+    VehicleState out;
+
+    // El body empieza tras la línea vacía
+    const char* body = strstr(text, "\r\n\r\n") + 4;
+    double start = now_seconds();
+    for (long i = 0; i < iterations; i++) {
+        char moving[8];
+        sscanf(body, "Speed: %f km/h\r\nBattery: %f%%\r\nTemperature: %f C\r\n"
+                     "Direction: %15s\r\nMoving: %7s",
+               &out.speed, &out.battery, &out.temperature, out.direction, moving);
+        out.is_moving = strcmp(moving, "Yes") == 0;
+        sink += out.is_moving + (unsigned long)out.speed;
+    }
+    report("decode telemetría", "texto", now_seconds() - start, iterations, text_len);
+
+    start = now_seconds();
+    for (long i = 0; i < iterations; i++) {
+        decode_binary_telemetry(binary + BINARY_HEADER_SIZE, binary_len - BINARY_HEADER_SIZE, &out);
+        sink += out.is_moving + (unsigned long)out.speed;
+    }
+    report("decode telemetría", "binario", now_seconds() - start, iterations, binary_len);
+}
+
+// Caso típico de la simulación: solo cambia la temperatura entre ticks
+static void bench_delta(long iterations, const VehicleState* state) {
+    char buffer[BUFFER_SIZE];
+    VehicleState copy = *state;
+    int len = 0;
+
+    for (int encoding = 0; encoding < ENCODING_COUNT; encoding++) {
+        double start = now_seconds();
+        for (long i = 0; i < iterations; i++) {
+            copy.temperature = (float)(20 + i % 20);
+            len = encode_telemetry_delta(buffer, encoding, VEHICLE_NO_ID, i, 0, TELEMETRY_FIELD_TEMPERATURE, &copy);
+            sink += buffer[len / 2];
+        }
+        report("encode delta", encoding == ENCODING_BINARY ? "binario" : "texto",
+               now_seconds() - start, iterations, len);
+    }
+}
+
+// Parsea el mismo mensaje una y otra vez a través del StreamParser
+static double parse_loop(long iterations, ProtocolEncoding encoding, const char* msg, int len) {
+    static StreamParser parser;
+    MessageView view;
+
+    parser_init(&parser);
+    parser_set_encoding(&parser, encoding);
+
+    double start = now_seconds();
+    for (long i = 0; i < iterations; i++) {
+        int space;
+        char* dst = parser_write_ptr(&parser, &space);
+        memcpy(dst, msg, len);
+        parser_commit(&parser, len);
+        if (parser_next(&parser, &view) != PARSE_COMPLETE) {
+            fprintf(stderr, "parse falló\n");
+            exit(1);
+        }
+        sink += message_header(&view, "Command").len;
+    }
+    return now_seconds() - start;
+}
+
+static void bench_parse(long iterations) {
+    const char* text = "VATP/1.0 COMMAND 0\r\n"
+                       "Username: admin\r\n"
+                       "Auth-Token: TOKEN_1728145632_89234\r\n"
+                       "Command: SPEED_UP\r\n"
+                       "\r\n";
+    char binary[BINARY_HEADER_SIZE + 1];
+    build_binary_header(binary, MSG_COMMAND, 1);
+    binary[BINARY_HEADER_SIZE] = CMD_SPEED_UP;
+
+    int text_len = strlen(text);
+    report("parse COMMAND", "texto", parse_loop(iterations, ENCODING_TEXT, text, text_len),
+           iterations, text_len);
+    report("parse COMMAND", "binario",
+           parse_loop(iterations, ENCODING_BINARY, binary, sizeof(binary)),
+           iterations, sizeof(binary));
+}
+
+int main(int argc, char* argv[]) {
+    long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+    if (iterations <= 0) iterations = 1000000;
+
+    VehicleState state = { 42.0f, 87.5f, 28.3f, "NORTH", 1 };
+
+    printf("Codificación VATP/1.0 (texto) vs VATP/2.0 (binario), %ld iteraciones\n", iterations);
+    bench_format(iterations);
+    bench_encode(iterations, &state);
+    bench_decode(iterations, &state);
+    bench_delta(iterations, &state);
+    bench_parse(iterations);
+    return 0;
+}
@@ -0,0 +1,279 @@
+// ============= bench/bench_fanout.c =============
+// Benchmark de fan-out de telemetría: coste de CPU del emisor por envío al
+// repartir un frame a 1k y 10k suscriptores TCP por loopback.
+//
+// Estrategias:
+//   render+copy  - se formatea la telemetría por suscriptor y se copia al kernel
+//                  (el camino anterior de GET_TELEMETRY)
+//   shared+copy  - frame compartido codificado una vez, send() con copia
+//   shared+zc    - frame compartido con MSG_ZEROCOPY y recogida de notificaciones
+//
+// Un proceso hijo abre los sockets cliente y descarta todo lo que recibe, así
+// cada proceso usa la mitad de los descriptores.
+//
+// Uso: bench_fanout [suscriptores ...]   (por defecto: 1000 10000)
+#include "../protocol.h"
+#include "../frame.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/errqueue.h>
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+
+#define SMALL_ROUNDS 50
+#define LARGE_ROUNDS 4
+#define LARGE_FRAME (64 * 1024)
+
+typedef enum { RENDER_COPY, SHARED_COPY, SHARED_ZEROCOPY } Strategy;
+
+static const char* strategy_name[] = { "render+copy", "shared+copy", "shared+zc" };
+
+static double cpu_seconds() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+           (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+static double wall_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Proceso hijo: conecta n sockets y descarta todo hasta que el padre cierre
+static void run_drainer(int port, int n) {
+    int epfd = epoll_create1(0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    for (int i = 0; i < n; i++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            perror("drainer connect");
+            _exit(1);
+        }
+        struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    static char sink[256 * 1024];
+    struct epoll_event events[256];
+    int open_count = n;
+    while (open_count > 0) {
+        int ready = epoll_wait(epfd, events, 256, -1);
+        for (int i = 0; i < ready; i++) {
+            ssize_t r = recv(events[i].data.fd, sink, sizeof(sink), MSG_DONTWAIT);
+            if (r == 0 || (r < 0 && errno != EAGAIN && errno != EINTR)) {
+                close(events[i].data.fd);
+                open_count--;
+            }
+        }
+    }
+    _exit(0);
+}
+
+// Recoge las notificaciones zero-copy pendientes de un socket
+static int reap_zerocopy(int fd, unsigned int* completed, int* copied) {
+    char control[128];
+    int reaped = 0;
+
+    while (1) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) break;
+
+        for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            struct sock_extended_err* serr = (struct sock_extended_err*)CMSG_DATA(cm);
+            if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+            *completed += serr->ee_data - serr->ee_info + 1;
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) (*copied)++;
+            reaped++;
+        }
+    }
+    return reaped;
+}
+
+static int send_all(int fd, const char* data, int len, int flags) {
+    int off = 0;
+    while (off < len) {
+        ssize_t sent = send(fd, data + off, len - off, flags | MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == ENOBUFS && (flags & MSG_ZEROCOPY)) {
+                // Demasiadas notificaciones sin recoger: reintentar tras recogerlas
+                unsigned int done = 0;
+                int copied = 0;
+                reap_zerocopy(fd, &done, &copied);
+                continue;
+            }
+            return -1;
+        }
+        off += sent;
+    }
+    return 0;
+}
+
+static void run_case(int* fds, int n, Strategy strategy, Frame* frame, int rounds, int large) {
+    VehicleState state = { 42.0f, 87.5f, 28.3f, "NORTH", 1 };
+    char rendered[BUFFER_SIZE];
+    unsigned int zc_sent = 0, zc_completed = 0;
+    int zc_copied = 0;
+
+    double cpu_start = cpu_seconds();
+    double wall_start = wall_seconds();
+
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < n; i++) {
+            switch (strategy) {
+                case RENDER_COPY: {
+                    // Cada suscriptor vuelve a formatear (solo aplica al frame pequeño)
+                    int len = build_telemetry_message(rendered, &state);
+                    send_all(fds[i], rendered, len, 0);
+                    break;
+                }
+                case SHARED_COPY:
+                    send_all(fds[i], frame->data, frame->len, 0);
+                    break;
+                case SHARED_ZEROCOPY:
+                    send_all(fds[i], frame->data, frame->len, MSG_ZEROCOPY);
+                    zc_sent++;
+                    break;
+            }
+        }
+        if (strategy == SHARED_ZEROCOPY) {
+            for (int i = 0; i < n; i++) reap_zerocopy(fds[i], &zc_completed, &zc_copied);
+        }
+    }
+
+    // Esperar a que el kernel suelte todas las páginas antes de medir
+    while (strategy == SHARED_ZEROCOPY && zc_completed < zc_sent) {
+        for (int i = 0; i < n; i++) reap_zerocopy(fds[i], &zc_completed, &zc_copied);
+    }
+
+    double cpu = cpu_seconds() - cpu_start;
+    double wall = wall_seconds() - wall_start;
+    double sends = (double)rounds * n;
+
+    printf("%-6d %-8s %-12s %8.0f ns/envío CPU  %8.2f ms/ronda  %7.1f MB/s",
+           n, large ? "64KB" : "telem", strategy_name[strategy],
+           cpu / sends * 1e9, wall / rounds * 1e3,
+           sends * frame->len / wall / (1024 * 1024));
+    if (strategy == SHARED_ZEROCOPY) {
+        printf("  (copiados por el kernel: %d)", zc_copied);
+    }
+    printf("\n");
+}
+
+static void bench_subscribers(int n) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+
+    if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(listener, SOMAXCONN) < 0 ||
+        getsockname(listener, (struct sockaddr*)&addr, &addr_len) < 0) {
+        perror("listener");
+        exit(1);
+    }
+
+    pid_t child = fork();
+    if (child == 0) {
+        close(listener);
+        run_drainer(ntohs(addr.sin_port), n);
+    }
+
+    int* fds = malloc(n * sizeof(int));
+    int zerocopy_ok = 1;
+    for (int i = 0; i < n; i++) {
+        fds[i] = accept(listener, NULL, NULL);
+        if (fds[i] < 0) {
+            perror("accept");
+            exit(1);
+        }
+        int one = 1;
+        if (setsockopt(fds[i], SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) < 0) {
+            zerocopy_ok = 0;
+        }
+    }
+    close(listener);
+
+    VehicleState state = { 42.0f, 87.5f, 28.3f, "NORTH", 1 };
+    char buffer[BUFFER_SIZE];
+    int len = build_telemetry_message(buffer, &state);
+    Frame* small = frame_create(buffer, len, 1);
+    printf("-- %d suscriptores (frame telem = %d bytes)\n", n, len);
+
+    char* payload = malloc(LARGE_FRAME);
+    memset(payload, 'x', LARGE_FRAME);
+    Frame* large = frame_create(payload, LARGE_FRAME, 1);
+    free(payload);
+
+    run_case(fds, n, RENDER_COPY, small, SMALL_ROUNDS, 0);
+    run_case(fds, n, SHARED_COPY, small, SMALL_ROUNDS, 0);
+    if (zerocopy_ok) run_case(fds, n, SHARED_ZEROCOPY, small, SMALL_ROUNDS, 0);
+    run_case(fds, n, SHARED_COPY, large, LARGE_ROUNDS, 1);
+    if (zerocopy_ok) run_case(fds, n, SHARED_ZEROCOPY, large, LARGE_ROUNDS, 1);
+    if (!zerocopy_ok) printf("       (SO_ZEROCOPY no soportado: se omite shared+zc)\n");
+
+    for (int i = 0; i < n; i++) close(fds[i]);
+    free(fds);
+    frame_unref(small);
+    frame_unref(large);
+    waitpid(child, NULL, 0);
+}
+
+int main(int argc, char* argv[]) {
+    int defaults[] = { 1000, 10000 };
+    int count = argc > 1 ? argc - 1 : 2;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    printf("Fan-out de telemetría por loopback\n");
+    printf("%-6s %-8s %-12s\n", "subs", "frame", "estrategia");
+
+    for (int i = 0; i < count; i++) {
+        int n = argc > 1 ? atoi(argv[i + 1]) : defaults[i];
+        if (n <= 0) continue;
+        if ((rlim_t)n + 16 > rl.rlim_cur) {
+            printf("%-6d omitido: RLIMIT_NOFILE=%ld insuficiente\n", n, (long)rl.rlim_cur);
+            continue;
+        }
+        bench_subscribers(n);
+    }
+
+    printf("\nNota: en loopback el kernel siempre copia los envíos MSG_ZEROCOPY; el beneficio\n"
+           "solo aparece en interfaces reales y con frames grandes (>= 16 KB).\n");
+    return 0;
+}
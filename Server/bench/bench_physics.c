@@ -0,0 +1,148 @@
+// ============= bench/bench_physics.c =============
+// Benchmark de la simulación física (physics.c): tiempo por paso de toda la
+// flota con 1 thread y con N, solo integrando y también publicando cada
+// vehículo en un array de VehicleState (lo que hace el servidor), y suma de
+// comprobación del estado final para verificar que el resultado no depende
+// del número de threads.
+//
+// Cada configuración corre en un proceso hijo: el motor es único por proceso.
+//
+// Uso: bench_physics [vehículos] [threads] [pasos]   (por defecto: 100000, núcleos, 1000)
+#include "../physics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define BENCH_DT 0.01    // 100 Hz
+
+typedef struct {
+    double integrate_ms;    // Por paso, solo integración
+    double publish_ms;      // Por paso, integración y publicación
+    unsigned long checksum;
+} Result;
+
+static VehicleState* published = NULL;
+static volatile int publishing = 0;
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void publish(uint32_t first, uint32_t last, void* arg) {
+    (void)arg;
+    if (!publishing) return;
+    for (uint32_t id = first; id < last; id++) physics_state(id, &published[id]);
+}
+
+// FNV-1a sobre el estado publicado de toda la flota
+static unsigned long checksum(int vehicles) {
+    unsigned long hash = 1469598103934665603UL;
+    for (int id = 0; id < vehicles; id++) {
+        VehicleState state;
+        physics_state(id, &state);
+        const unsigned char* bytes = (const unsigned char*)&state;
+        for (size_t i = 0; i < sizeof(state); i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211UL;
+        }
+    }
+    return hash;
+}
+
+static double run_steps(int steps) {
+    double start = now_seconds();
+    for (int i = 0; i < steps; i++) physics_step();
+    return (now_seconds() - start) / steps * 1e3;
+}
+
+static Result run(int vehicles, int threads, int steps) {
+    const char* directions[] = {"NORTH", "EAST", "SOUTH", "WEST"};
+    Result result;
+
+    published = calloc(vehicles, sizeof(VehicleState));
+    if (!published || physics_init(vehicles) < 0 ||
+        physics_start(BENCH_DT, threads, PHYSICS_DEFAULT_SEED, publish, NULL) < 0) {
+        fprintf(stderr, "No se pudo iniciar la simulación\n");
+        exit(1);
+    }
+
+    // Flota en marcha a distintas velocidades y rumbos
+    for (int id = 0; id < vehicles; id++) {
+        VehicleState state;
+        memset(&state, 0, sizeof(state));
+        state.speed = 10.0f * (1 + id % 10);
+        state.battery = 100.0f;
+        state.temperature = 25.0f;
+        strcpy(state.direction, directions[id % 4]);
+        state.is_moving = 1;
+        physics_load(id, &state);
+    }
+
+    result.integrate_ms = run_steps(steps);
+    publishing = 1;
+    result.publish_ms = run_steps(steps);
+    result.checksum = checksum(vehicles);
+    return result;
+}
+
+// Ejecuta una configuración en un hijo y recoge el resultado por un pipe
+static int run_child(int vehicles, int threads, int steps, Result* out) {
+    int fds[2];
+    if (pipe(fds) < 0) return -1;
+
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        close(fds[0]);
+        Result result = run(vehicles, threads, steps);
+        if (write(fds[1], &result, sizeof(result)) != sizeof(result)) _exit(1);
+        _exit(0);
+    }
+
+    close(fds[1]);
+    ssize_t n = read(fds[0], out, sizeof(*out));
+    close(fds[0]);
+    waitpid(pid, NULL, 0);
+    return n == sizeof(*out) ? 0 : -1;
+}
+
+int main(int argc, char* argv[]) {
+    int vehicles = argc > 1 ? atoi(argv[1]) : 100000;
+    int threads = argc > 2 ? atoi(argv[2]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int steps = argc > 3 ? atoi(argv[3]) : 1000;
+    if (vehicles <= 0 || threads <= 0 || steps <= 0) {
+        fprintf(stderr, "Uso: %s [vehículos] [threads] [pasos]\n", argv[0]);
+        return 1;
+    }
+
+    printf("Simulación de %d vehículos, %d pasos de %.0f ms (2 x %d pasos por configuración)\n\n",
+           vehicles, steps, BENCH_DT * 1e3, steps);
+    printf("%-8s %14s %14s %16s %10s  %s\n", "threads", "integrar ms", "+publicar ms",
+           "ns/vehículo", "100 Hz", "checksum");
+
+    int configs[2] = { 1, threads };
+    unsigned long checksums[2] = { 0, 0 };
+    int count = threads > 1 ? 2 : 1;
+
+    for (int c = 0; c < count; c++) {
+        Result result;
+        if (run_child(vehicles, configs[c], steps, &result) < 0) {
+            fprintf(stderr, "Falló la configuración de %d threads\n", configs[c]);
+            return 1;
+        }
+        checksums[c] = result.checksum;
+        printf("%-8d %14.3f %14.3f %16.2f %10s  %016lx\n", configs[c], result.integrate_ms,
+               result.publish_ms, result.publish_ms * 1e6 / vehicles,
+               result.publish_ms < BENCH_DT * 1e3 ? "sí" : "no", result.checksum);
+    }
+
+    if (count == 2) {
+        printf("\nMismo estado final con 1 y %d threads: %s\n", threads,
+               checksums[0] == checksums[1] ? "sí" : "NO");
+    }
+    return 0;
+}
@@ -0,0 +1,709 @@
+// ============= bench/vatp_bench.c =============
+// Generador de carga VATP contra un servidor en marcha.
+//
+// Abre N observers y M admins (un único thread con epoll y sockets no
+// bloqueantes). Cada conexión hace su guion de arranque:
+//   observer: CONNECT (Rate: <telemetry-rate>)
+//   admin:    CONNECT -> AUTH
+// y, durante la medición, los admins ejecutan una mezcla de COMMAND y
+// GET_TELEMETRY al ritmo total pedido. Se mide:
+//   - latencia de ida y vuelta por tipo de petición (p50/p99/p999). La carga
+//     es de lazo abierto: cada petición tiene un instante programado y la
+//     latencia se cuenta desde ahí, así la espera por falta de admins libres
+//     también aparece (sin "coordinated omission")
+//   - dispersión del broadcast: en cada tick, tiempo entre el primer y el
+//     último observer que recibe el TELEMETRY_DATA. Los mensajes se agrupan
+//     en ticks por cercanía (dentro de medio periodo del primero)
+//
+// Cada admin usa el token de su propio AUTH (los tokens son por sesión, así
+// que varios admins pueden compartir usuario). Los comandos que el vehículo
+// rechaza (límite de velocidad, batería) cuentan como rechazados.
+//
+// Los admins no piden telemetría periódica (no envían "Fields"), así que el
+// único TELEMETRY_DATA que reciben es la respuesta a GET_TELEMETRY.
+//
+// Uso: vatp_bench [opciones]
+//   --host H              servidor (127.0.0.1)
+//   --port P              puerto (8080)
+//   --observers N         conexiones observer (1000)
+//   --admins N            conexiones admin (50)
+//   --rate R              peticiones por segundo en total (1000)
+//   --duration S          segundos de medición (10)
+//   --telemetry-rate HZ   frecuencia de telemetría de los observers (10)
+//   --mix C,T             pesos de COMMAND y GET_TELEMETRY (80,20)
+//   --user U --password P credenciales admin (admin / admin123)
+//   --json FILE           resultados en JSON a FILE (por defecto, stdout)
+#define _GNU_SOURCE
+#include "../protocol.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define IN_BUFFER (16 * 1024)
+#define OUT_BUFFER 1024
+#define MAX_EVENTS 512
+#define CONNECT_BATCH 256           // Conexiones en curso a la vez durante el arranque
+#define SETUP_TIMEOUT 30.0          // Segundos máximos para el arranque
+#define DRAIN_TIMEOUT 2.0           // Espera a las respuestas en vuelo al terminar
+#define BACKLOG_CAPACITY (1 << 20)  // Peticiones programadas sin admin libre
+
+typedef enum {
+    PHASE_CONNECTING,   // connect() no bloqueante en curso
+    PHASE_HANDSHAKE,    // Guion de arranque (CONNECT, AUTH)
+    PHASE_READY,
+    PHASE_CLOSED
+} ConnPhase;
+
+typedef enum {
+    OP_NONE,
+    OP_CONNECT,
+    OP_AUTH,
+    OP_COMMAND,
+    OP_GET_TELEMETRY,
+    OP_COUNT
+} OpType;
+
+static const char* op_name[OP_COUNT] = { "none", "connect", "auth", "command", "get_telemetry" };
+
+typedef struct {
+    int fd;
+    int admin;
+    ConnPhase phase;
+    OpType pending;
+    double pending_since;   // Instante programado de la petición en vuelo
+    int next_command;
+    char token[MAX_TOKEN];
+    char in[IN_BUFFER];
+    int in_len;
+    char out[OUT_BUFFER];
+    int out_len;
+    int want_write;         // EPOLLOUT registrado
+} BenchConn;
+
+typedef struct {
+    double* values;
+    long count;
+    long capacity;
+} Samples;
+
+typedef struct {
+    const char* host;
+    int port;
+    int observers;
+    int admins;
+    double rate;
+    double duration;
+    double telemetry_rate;
+    int weight_command;
+    int weight_telemetry;
+    const char* user;
+    const char* password;
+    const char* json_path;
+} BenchConfig;
+
+static BenchConfig config = {
+    "127.0.0.1", 8080, 1000, 50, 1000.0, 10.0, 10.0, 80, 20, "admin", "admin123", NULL
+};
+
+static BenchConn* conns;
+static int conn_count;
+static int epfd;
+static struct sockaddr_in server_addr;
+
+static int established = 0;
+static int failed = 0;
+static int ready = 0;
+
+static int measuring = 0;
+static Samples latency[OP_COUNT];
+static unsigned long completed[OP_COUNT];
+static unsigned long rejected[OP_COUNT];
+static unsigned long scheduled = 0;
+static unsigned long dropped = 0;
+
+// Admins libres (pila) y peticiones programadas esperando uno (cola circular)
+static int* idle_admins;
+static int idle_count = 0;
+static double* backlog;
+static long backlog_head = 0;
+static long backlog_count = 0;
+
+// Broadcast: tick abierto y muestras de dispersión
+static Samples skew;
+static double tick_first = -1;
+static double tick_last = 0;
+static unsigned long tick_recipients = 0;
+static unsigned long broadcast_messages = 0;
+static unsigned long broadcast_ticks = 0;
+static unsigned long broadcast_recipients_total = 0;
+
+static unsigned int rng_state = 1;
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void samples_add(Samples* s, double value) {
+    if (s->count == s->capacity) {
+        long capacity = s->capacity ? s->capacity * 2 : 4096;
+        double* grown = realloc(s->values, capacity * sizeof(double));
+        if (!grown) return;
+        s->values = grown;
+        s->capacity = capacity;
+    }
+    s->values[s->count++] = value;
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Percentil por rango más cercano (muestras ya ordenadas)
+static double percentile(const Samples* s, double p) {
+    if (s->count == 0) return 0;
+    long rank = (long)(p * s->count + 0.999999);
+    if (rank < 1) rank = 1;
+    if (rank > s->count) rank = s->count;
+    return s->values[rank - 1];
+}
+
+// EPOLLOUT solo mientras se conecta o queda salida pendiente
+static void update_events(BenchConn* conn) {
+    int want_write = conn->phase == PHASE_CONNECTING || conn->out_len > 0;
+    if (want_write == conn->want_write) return;
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN | (want_write ? EPOLLOUT : 0);
+    ev.data.ptr = conn;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+    conn->want_write = want_write;
+}
+
+static void conn_close(BenchConn* conn) {
+    if (conn->phase == PHASE_CLOSED) return;
+    if (conn->phase == PHASE_READY) ready--;
+    if (conn->phase == PHASE_CONNECTING || conn->phase == PHASE_HANDSHAKE) failed++;
+    conn->phase = PHASE_CLOSED;
+    close(conn->fd);
+}
+
+static void flush_output(BenchConn* conn) {
+    while (conn->out_len > 0) {
+        ssize_t sent = send(conn->fd, conn->out, conn->out_len, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EINTR) break;
+            conn_close(conn);
+            return;
+        }
+        memmove(conn->out, conn->out + sent, conn->out_len - sent);
+        conn->out_len -= sent;
+    }
+    update_events(conn);
+}
+
+static void send_request(BenchConn* conn, OpType op, double since, const char* fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+
+static void send_request(BenchConn* conn, OpType op, double since, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(conn->out + conn->out_len, OUT_BUFFER - conn->out_len, fmt, args);
+    va_end(args);
+    if (len < 0 || len >= OUT_BUFFER - conn->out_len) {
+        conn_close(conn);
+        return;
+    }
+    conn->out_len += len;
+    conn->pending = op;
+    conn->pending_since = since;
+    flush_output(conn);
+}
+
+static void send_connect(BenchConn* conn) {
+    if (conn->admin) {
+        send_request(conn, OP_CONNECT, now_seconds(),
+                     "%s CONNECT 0\r\nUser-Type: ADMIN\r\n\r\n",
+                     PROTOCOL_VERSION);
+    } else {
+        send_request(conn, OP_CONNECT, now_seconds(),
+                     "%s CONNECT 0\r\nUser-Type: OBSERVER\r\nRate: %g\r\n\r\n",
+                     PROTOCOL_VERSION, config.telemetry_rate);
+    }
+}
+
+static void send_auth(BenchConn* conn) {
+    send_request(conn, OP_AUTH, now_seconds(),
+                 "%s AUTH 0\r\nUsername: %s\r\nPassword: %s\r\n\r\n",
+                 PROTOCOL_VERSION, config.user, config.password);
+}
+
+static void send_operation(BenchConn* conn, double since) {
+    static const char* commands[] = { "SPEED_UP", "TURN_LEFT", "SLOW_DOWN", "TURN_RIGHT" };
+    int total = config.weight_command + config.weight_telemetry;
+
+    if ((int)(rand_r(&rng_state) % total) < config.weight_command) {
+        const char* command = commands[conn->next_command++ % 4];
+        send_request(conn, OP_COMMAND, since,
+                     "%s COMMAND 0\r\nUsername: %s\r\nAuth-Token: %s\r\nCommand: %s\r\n\r\n",
+                     PROTOCOL_VERSION, config.user, conn->token, command);
+    } else {
+        send_request(conn, OP_GET_TELEMETRY, since, "%s GET_TELEMETRY 0\r\n\r\n", PROTOCOL_VERSION);
+    }
+}
+
+// Asigna las peticiones programadas a admins libres
+static void dispatch_backlog() {
+    while (backlog_count > 0 && idle_count > 0) {
+        BenchConn* conn = &conns[idle_admins[--idle_count]];
+        if (conn->phase != PHASE_READY) continue;
+
+        double since = backlog[backlog_head];
+        backlog_head = (backlog_head + 1) % BACKLOG_CAPACITY;
+        backlog_count--;
+        send_operation(conn, since);
+    }
+}
+
+// Cierra el tick de broadcast abierto y guarda su dispersión
+static void close_tick() {
+    if (tick_first < 0) return;
+    samples_add(&skew, (tick_last - tick_first) * 1e6);
+    broadcast_ticks++;
+    broadcast_recipients_total += tick_recipients;
+    tick_first = -1;
+    tick_recipients = 0;
+}
+
+static void record_broadcast(double now) {
+    if (!measuring) return;
+
+    double period = 1.0 / config.telemetry_rate;
+    if (tick_first >= 0 && now - tick_first > period / 2) close_tick();
+    if (tick_first < 0) tick_first = now;
+    tick_last = now;
+    tick_recipients++;
+    broadcast_messages++;
+}
+
+static MessageType reply_type(const char* line, int len) {
+    static const struct { const char* name; MessageType type; } types[] = {
+        {"RESPONSE_OK ", MSG_RESPONSE_OK},
+        {"RESPONSE_ERROR ", MSG_RESPONSE_ERROR},
+        {"TELEMETRY_DATA ", MSG_TELEMETRY_DATA},
+        {"TELEMETRY_DELTA ", MSG_TELEMETRY_DELTA},
+    };
+    const char* space = memchr(line, ' ', len);
+    if (!space) return MSG_CONNECT;
+    space++;
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        int n = strlen(types[i].name);
+        if (line + len - space >= n && memcmp(space, types[i].name, n) == 0) return types[i].type;
+    }
+    return MSG_CONNECT; // Desconocido
+}
+
+static void on_message(BenchConn* conn, MessageType type, const char* body, int body_len, double now) {
+    if (type == MSG_TELEMETRY_DELTA) return; // Broadcast de los admins
+    if (type == MSG_TELEMETRY_DATA && !conn->admin) {
+        if (conn->phase == PHASE_READY) record_broadcast(now);
+        return;
+    }
+
+    OpType op = conn->pending;
+    if (op == OP_NONE) return;
+    conn->pending = OP_NONE;
+
+    if (measuring || op == OP_CONNECT || op == OP_AUTH) {
+        samples_add(&latency[op], (now - conn->pending_since) * 1e6);
+        completed[op]++;
+        if (type == MSG_RESPONSE_ERROR) rejected[op]++;
+    }
+
+    switch (op) {
+        case OP_CONNECT:
+            if (conn->admin) {
+                send_auth(conn);
+            } else {
+                conn->phase = PHASE_READY;
+                ready++;
+            }
+            break;
+
+        case OP_AUTH: {
+            const char* token = memmem(body, body_len, "Token: ", 7);
+            if (type != MSG_RESPONSE_OK || !token) {
+                fprintf(stderr, "AUTH rechazado: %.*s\n", body_len, body);
+                conn_close(conn);
+                return;
+            }
+            token += 7;
+            int len = body + body_len - token;
+            if (len >= MAX_TOKEN) len = MAX_TOKEN - 1;
+            memcpy(conn->token, token, len);
+            conn->token[len] = '\0';
+            conn->phase = PHASE_READY;
+            ready++;
+            break;
+        }
+
+        default:
+            idle_admins[idle_count++] = conn - conns;
+            dispatch_backlog();
+            break;
+    }
+}
+
+// Extrae los mensajes completos del buffer: "<versión> <TIPO> <LONGITUD>",
+// headers hasta la línea vacía y LONGITUD bytes de body
+static void parse_input(BenchConn* conn, double now) {
+    int offset = 0;
+
+    while (conn->phase != PHASE_CLOSED) {
+        char* start = conn->in + offset;
+        int available = conn->in_len - offset;
+        char* end = memmem(start, available, "\r\n\r\n", 4);
+        if (!end) break;
+
+        char* line_end = memchr(start, '\r', end - start + 1);
+        char* length = memrchr(start, ' ', line_end - start);
+        int body_len = length ? atoi(length + 1) : 0;
+        int total = end + 4 - start + body_len;
+        if (total > available) break;
+
+        on_message(conn, reply_type(start, line_end - start), end + 4, body_len, now);
+        offset += total;
+    }
+
+    if (conn->phase == PHASE_CLOSED) return;
+    if (offset == 0 && conn->in_len == IN_BUFFER) {
+        fprintf(stderr, "Mensaje mayor que el buffer de entrada\n");
+        conn_close(conn);
+        return;
+    }
+    memmove(conn->in, conn->in + offset, conn->in_len - offset);
+    conn->in_len -= offset;
+}
+
+static void on_readable(BenchConn* conn, double now) {
+    while (conn->phase != PHASE_CLOSED) {
+        ssize_t n = recv(conn->fd, conn->in + conn->in_len, IN_BUFFER - conn->in_len, 0);
+        if (n > 0) {
+            conn->in_len += n;
+            parse_input(conn, now);
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) break;
+        conn_close(conn); // Cierre del servidor o error
+    }
+}
+
+static void on_writable(BenchConn* conn) {
+    if (conn->phase == PHASE_CONNECTING) {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &len);
+        if (error) {
+            conn_close(conn);
+            return;
+        }
+        conn->phase = PHASE_HANDSHAKE;
+        established++;
+        update_events(conn);
+        send_connect(conn);
+        return;
+    }
+    flush_output(conn);
+}
+
+static int start_connect(BenchConn* conn) {
+    conn->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (conn->fd < 0) {
+        conn->phase = PHASE_CLOSED;
+        failed++;
+        return -1;
+    }
+    int one = 1;
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    conn->phase = PHASE_CONNECTING;
+    if (connect(conn->fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0 &&
+        errno != EINPROGRESS) {
+        conn_close(conn);
+        return -1;
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT, .data.ptr = conn };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, conn->fd, &ev);
+    conn->want_write = 1;
+    return 0;
+}
+
+static void poll_events(int timeout_ms) {
+    struct epoll_event events[MAX_EVENTS];
+    int n = epoll_wait(epfd, events, MAX_EVENTS, timeout_ms);
+    double now = now_seconds();
+
+    for (int i = 0; i < n; i++) {
+        BenchConn* conn = events[i].data.ptr;
+        if (conn->phase == PHASE_CLOSED) continue;
+        if (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) on_writable(conn);
+        if (conn->phase != PHASE_CONNECTING && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+            on_readable(conn, now);
+        }
+    }
+}
+
+// Abre todas las conexiones y completa sus guiones de arranque
+static void run_setup() {
+    int next = 0;
+    double deadline = now_seconds() + SETUP_TIMEOUT;
+
+    while (now_seconds() < deadline) {
+        int in_progress = next - ready - failed;
+        while (next < conn_count && in_progress < CONNECT_BATCH) {
+            start_connect(&conns[next++]);
+            in_progress++;
+        }
+        if (next == conn_count && ready + failed == conn_count) break;
+        poll_events(10);
+    }
+
+    // Todos los admins listos quedan libres para la medición
+    for (int i = 0; i < conn_count; i++) {
+        if (conns[i].admin && conns[i].phase == PHASE_READY) idle_admins[idle_count++] = i;
+    }
+}
+
+static void run_measurement() {
+    double interval = 1.0 / config.rate;
+    double start = now_seconds();
+    double end = start + config.duration;
+    double next_op = start;
+
+    measuring = 1;
+    while (1) {
+        double now = now_seconds();
+        if (now >= end) break;
+
+        // Lazo abierto: se programan las peticiones que tocan aunque no haya admins libres
+        while (next_op <= now) {
+            scheduled++;
+            if (backlog_count == BACKLOG_CAPACITY) {
+                dropped++;
+            } else {
+                backlog[(backlog_head + backlog_count) % BACKLOG_CAPACITY] = next_op;
+                backlog_count++;
+            }
+            next_op += interval;
+        }
+        dispatch_backlog();
+
+        int timeout_ms = (int)((next_op - now) * 1000);
+        poll_events(timeout_ms < 1 ? 0 : timeout_ms > 10 ? 10 : timeout_ms);
+    }
+
+    // Recoger las respuestas en vuelo
+    double drain_end = now_seconds() + DRAIN_TIMEOUT;
+    while (now_seconds() < drain_end) {
+        int in_flight = 0;
+        for (int i = 0; i < conn_count; i++) {
+            if (conns[i].phase == PHASE_READY && conns[i].pending != OP_NONE) in_flight++;
+        }
+        if (!in_flight) break;
+        poll_events(10);
+    }
+    measuring = 0;
+    close_tick();
+}
+
+static void sort_samples() {
+    for (int op = 0; op < OP_COUNT; op++) {
+        qsort(latency[op].values, latency[op].count, sizeof(double), compare_double);
+    }
+    qsort(skew.values, skew.count, sizeof(double), compare_double);
+}
+
+static void write_samples_json(FILE* out, const char* name, const Samples* s, int last) {
+    double sum = 0;
+    for (long i = 0; i < s->count; i++) sum += s->values[i];
+
+    fprintf(out, "    \"%s\": {\"count\": %ld, \"mean\": %.1f, \"p50\": %.1f, \"p99\": %.1f, "
+                 "\"p999\": %.1f, \"max\": %.1f}%s\n",
+            name, s->count, s->count ? sum / s->count : 0.0, percentile(s, 0.50),
+            percentile(s, 0.99), percentile(s, 0.999),
+            s->count ? s->values[s->count - 1] : 0.0, last ? "" : ",");
+}
+
+static void write_json(FILE* out) {
+    unsigned long requests = completed[OP_COMMAND] + completed[OP_GET_TELEMETRY];
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"config\": {\"host\": \"%s\", \"port\": %d, \"observers\": %d, \"admins\": %d, "
+                 "\"rate\": %.1f, \"duration\": %.1f, \"telemetry_rate\": %.2f, "
+                 "\"mix\": {\"command\": %d, \"get_telemetry\": %d}},\n",
+            config.host, config.port, config.observers, config.admins, config.rate,
+            config.duration, config.telemetry_rate, config.weight_command, config.weight_telemetry);
+    fprintf(out, "  \"connections\": {\"established\": %d, \"failed\": %d, \"ready\": %d},\n",
+            established, failed, ready);
+    fprintf(out, "  \"requests\": {\"scheduled\": %lu, \"completed\": %lu, \"rejected\": %lu, "
+                 "\"dropped\": %lu, \"achieved_rate\": %.1f},\n",
+            scheduled, requests, rejected[OP_COMMAND] + rejected[OP_GET_TELEMETRY], dropped,
+            requests / config.duration);
+    fprintf(out, "  \"latency_us\": {\n");
+    for (int op = OP_CONNECT; op < OP_COUNT; op++) {
+        write_samples_json(out, op_name[op], &latency[op], op == OP_COUNT - 1);
+    }
+    fprintf(out, "  },\n");
+    fprintf(out, "  \"broadcast\": {\"ticks\": %lu, \"messages\": %lu, \"recipients_avg\": %.1f,\n",
+            broadcast_ticks, broadcast_messages,
+            broadcast_ticks ? (double)broadcast_recipients_total / broadcast_ticks : 0.0);
+    write_samples_json(out, "skew_us", &skew, 1);
+    fprintf(out, "  }\n");
+    fprintf(out, "}\n");
+}
+
+static void print_summary() {
+    fprintf(stderr, "Conexiones: %d listas, %d fallidas\n", ready, failed);
+    for (int op = OP_COMMAND; op < OP_COUNT; op++) {
+        Samples* s = &latency[op];
+        fprintf(stderr, "%-14s %8ld  p50 %8.1f us  p99 %8.1f us  p999 %8.1f us  (%lu rechazadas)\n",
+                op_name[op], s->count, percentile(s, 0.50), percentile(s, 0.99),
+                percentile(s, 0.999), rejected[op]);
+    }
+    fprintf(stderr, "broadcast      %8lu ticks  dispersión p50 %.1f us  p99 %.1f us\n",
+            broadcast_ticks, percentile(&skew, 0.50), percentile(&skew, 0.99));
+}
+
+static int parse_args(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!value) {
+            fprintf(stderr, "Error: falta el valor de '%s'\n", argv[i]);
+            return -1;
+        }
+        i++;
+        if (strcmp(argv[i - 1], "--host") == 0) {
+            config.host = value;
+        } else if (strcmp(argv[i - 1], "--port") == 0) {
+            config.port = atoi(value);
+        } else if (strcmp(argv[i - 1], "--observers") == 0) {
+            config.observers = atoi(value);
+        } else if (strcmp(argv[i - 1], "--admins") == 0) {
+            config.admins = atoi(value);
+        } else if (strcmp(argv[i - 1], "--rate") == 0) {
+            config.rate = atof(value);
+        } else if (strcmp(argv[i - 1], "--duration") == 0) {
+            config.duration = atof(value);
+        } else if (strcmp(argv[i - 1], "--telemetry-rate") == 0) {
+            config.telemetry_rate = atof(value);
+        } else if (strcmp(argv[i - 1], "--mix") == 0) {
+            if (sscanf(value, "%d,%d", &config.weight_command, &config.weight_telemetry) != 2) {
+                fprintf(stderr, "Error: --mix espera C,T (p. ej. 80,20)\n");
+                return -1;
+            }
+        } else if (strcmp(argv[i - 1], "--user") == 0) {
+            config.user = value;
+        } else if (strcmp(argv[i - 1], "--password") == 0) {
+            config.password = value;
+        } else if (strcmp(argv[i - 1], "--json") == 0) {
+            config.json_path = value;
+        } else {
+            fprintf(stderr, "Error: Opción desconocida '%s'\n", argv[i - 1]);
+            return -1;
+        }
+    }
+
+    if (config.port <= 0 || config.port > 65535 || config.observers < 0 || config.admins < 0 ||
+        config.rate <= 0 || config.duration <= 0 || config.telemetry_rate <= 0 ||
+        config.weight_command < 0 || config.weight_telemetry < 0 ||
+        config.weight_command + config.weight_telemetry == 0) {
+        fprintf(stderr, "Error: parámetros fuera de rango\n");
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (parse_args(argc, argv) < 0) {
+        fprintf(stderr, "Uso: %s [--host H] [--port P] [--observers N] [--admins N] [--rate R]\n"
+                        "       [--duration S] [--telemetry-rate HZ] [--mix C,T]\n"
+                        "       [--user U] [--password P] [--json FILE]\n", argv[0]);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(config.port);
+    if (inet_pton(AF_INET, config.host, &server_addr.sin_addr) != 1) {
+        fprintf(stderr, "Error: dirección inválida '%s'\n", config.host);
+        return 1;
+    }
+
+    conn_count = config.observers + config.admins;
+    conns = calloc(conn_count ? conn_count : 1, sizeof(BenchConn));
+    idle_admins = calloc(config.admins ? config.admins : 1, sizeof(int));
+    backlog = malloc(BACKLOG_CAPACITY * sizeof(double));
+    epfd = epoll_create1(0);
+    if (!conns || !idle_admins || !backlog || epfd < 0) {
+        fprintf(stderr, "Error: sin memoria\n");
+        return 1;
+    }
+    // Admins repartidos entre los observers para no arrancarlos todos al final
+    for (int i = 0; i < config.admins; i++) {
+        conns[(long)i * conn_count / config.admins].admin = 1;
+    }
+
+    fprintf(stderr, "Conectando %d observers y %d admins a %s:%d...\n",
+            config.observers, config.admins, config.host, config.port);
+    run_setup();
+
+    fprintf(stderr, "Midiendo %.0f s a %.0f peticiones/s...\n", config.duration, config.rate);
+    if (config.admins > 0) {
+        run_measurement();
+    } else {
+        // Solo observers: se mide únicamente el broadcast
+        measuring = 1;
+        double end = now_seconds() + config.duration;
+        while (now_seconds() < end) poll_events(10);
+        measuring = 0;
+        close_tick();
+    }
+
+    sort_samples();
+    print_summary();
+
+    FILE* out = stdout;
+    if (config.json_path && !(out = fopen(config.json_path, "w"))) {
+        fprintf(stderr, "Error: no se pudo abrir '%s'\n", config.json_path);
+        return 1;
+    }
+    write_json(out);
+    if (out != stdout) fclose(out);
+
+    for (int i = 0; i < conn_count; i++) {
+        if (conns[i].phase != PHASE_CLOSED) close(conns[i].fd);
+    }
+    return 0;
+}
@@ -3,118 +3,813 @@
 #include "logger.h"
 #include "auth.h"
 #include "telemetry.h"
+#include "registry.h"
+#include "parser.h"
+#include "scheduler.h"
+#include "timeouts.h"
+#include "metrics.h"
+#include "history.h"
+#include "subscriptions.h"
+#include "multicast.h"
 #include <string.h>
+#include <strings.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 
-extern ClientInfo clients[MAX_CLIENTS];
-extern pthread_mutex_t clients_mutex;
+// Registra un cliente en el shard del reactor que lo atiende (0 en modo
+// threads). Devuelve su índice de cliente.
+int add_client(int shard, int socket_fd, const char* ip, int port) {
+    int client_idx = registry_add(shard, socket_fd, ip, port);
+    if (client_idx < 0) {
+        return -1; // Sin memoria o sin descriptores
+    }
+    
+    // Hasta su CONNECT el cliente recibe telemetría del vehículo 0 a la
+    // frecuencia por defecto
+    uint32_t vehicle = 0;
+    TelemetryFilter filter;
+    telemetry_filter_init(&filter);
+    scheduler_subscribe(SCHEDULER_DEFAULT_RATE_HZ);
+    subscriptions_add(SCHEDULER_DEFAULT_BUCKET, &vehicle, 1, &filter, TELEMETRY_MODE_FULL);
+    
+    char log_msg[256];
+    sprintf(log_msg, "Cliente añadido al sistema");
+    log_message(ip, port, "CONNECTED", log_msg);
+    
+    return client_idx;
+}
 
-int add_client(int socket_fd, const char* ip, int port) {
-    pthread_mutex_lock(&clients_mutex);
-    
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (!clients[i].active) {
-            clients[i].socket_fd = socket_fd;
-            strncpy(clients[i].ip, ip, 15);
-            clients[i].ip[15] = '\0';
-            clients[i].port = port;
-            clients[i].user_type = USER_OBSERVER;
-            clients[i].authenticated = 0;
-            clients[i].active = 1;
-            clients[i].username[0] = '\0';
-            clients[i].auth_token[0] = '\0';
-            
-            pthread_mutex_unlock(&clients_mutex);
-            
-            char log_msg[256];
-            sprintf(log_msg, "Cliente añadido al sistema");
-            log_message(ip, port, "CONNECTED", log_msg);
-            
-            return i;
+void remove_client(int client_idx) {
+    ClientInfo removed;
+    
+    if (registry_remove(client_idx, &removed) >= 0) {
+        scheduler_unsubscribe(removed.rate_bucket);
+        subscriptions_remove(removed.rate_bucket, removed.vehicles, removed.vehicle_count,
+                             &removed.filter, removed.telemetry_mode);
+        if (removed.authenticated) {
+            revoke_token(removed.auth_token); // Los tokens son por sesión
         }
+        log_message(removed.ip, removed.port, "REMOVED", "Cliente removido del sistema");
+        // El registro cierra el descriptor cuando ningún lector (broadcast)
+        // puede seguir usándolo; shutdown() corta la conexión ya
+        shutdown(removed.socket_fd, SHUT_RDWR);
     }
-    
-    pthread_mutex_unlock(&clients_mutex);
-    return -1; // No hay espacio
 }
 
-void remove_client(int socket_fd) {
-    pthread_mutex_lock(&clients_mutex);
+// Comandos de un COMMAND: el header "Command" (uno solo) o, si no está, el
+// lote del body: un nombre por línea en texto, un ID por byte en VATP/2.0.
+// Devuelve cuántos hay, -1 si alguno no se reconoce (su posición queda en
+// 'bad_step') o -2 si el lote está vacío o es demasiado largo.
+static int parse_command_list(const MessageView* msg, ProtocolEncoding encoding,
+                              CommandType* commands, int* bad_step) {
+    char name[32];
+    StrView header = message_header(msg, "Command");
+    *bad_step = 0;
+    
+    if (header.len > 0 || msg->body.len == 0) {
+        view_copy(header, name, sizeof(name));
+        commands[0] = parse_command(name);
+        return commands[0] == CMD_UNKNOWN ? -1 : 1;
+    }
     
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (clients[i].active && clients[i].socket_fd == socket_fd) {
-            log_message(clients[i].ip, clients[i].port, "REMOVED", "Cliente removido del sistema");
+    int count = 0;
+    const char* p = msg->body.ptr;
+    const char* end = p + msg->body.len;
+    
+    while (p < end) {
+        CommandType cmd;
+        
+        if (encoding == ENCODING_BINARY) {
+            unsigned char id = *p++;
+            cmd = id < CMD_UNKNOWN ? (CommandType)id : CMD_UNKNOWN;
+        } else {
+            const char* eol = memchr(p, '\n', end - p);
+            if (!eol) eol = end;
+            StrView line = { p, eol - p };
+            p = eol + 1;
             
-            clients[i].active = 0;
-            clients[i].socket_fd = -1;
-            close(socket_fd);
-            break;
+            while (line.len > 0 && (line.ptr[line.len - 1] == '\r' || line.ptr[line.len - 1] == ' ')) {
+                line.len--;
+            }
+            while (line.len > 0 && line.ptr[0] == ' ') {
+                line.ptr++;
+                line.len--;
+            }
+            if (line.len == 0) continue;
+            
+            view_copy(line, name, sizeof(name));
+            cmd = parse_command(name);
+        }
+        
+        if (count == COMMAND_MAX_BATCH) return -2;
+        if (cmd == CMD_UNKNOWN) {
+            *bad_step = count;
+            return -1;
+        }
+        commands[count++] = cmd;
+    }
+    
+    return count > 0 ? count : -2;
+}
+
+// Respuesta a un lote: un resumen y una línea por paso con su resultado.
+// 'applied' es el número de comandos aplicados (igual a 'count' si el lote se
+// ejecutó). Devuelve la longitud del resumen.
+static int format_batch_result(char* out, const CommandType* commands, int count,
+                                int applied, const VehicleState* steps, const char* reason) {
+    int len;
+    if (applied == count) {
+        len = sprintf(out, "Lote de %d comandos ejecutado", count);
+    } else {
+        len = sprintf(out, "Lote rechazado en el paso %d (%s): %s",
+                      applied + 1, command_to_string(commands[applied]), reason);
+    }
+    int summary_len = len;
+    
+    for (int i = 0; i < count; i++) {
+        len += sprintf(out + len, "\r\n%d. %s: ", i + 1, command_to_string(commands[i]));
+        if (applied == count) {
+            len += sprintf(out + len, "Speed: %.2f km/h, Direction: %s",
+                           steps[i].speed, steps[i].direction);
+        } else if (i < applied) {
+            len += sprintf(out + len, "válido");
+        } else if (i == applied) {
+            len += sprintf(out + len, "rechazado");
+        } else {
+            len += sprintf(out + len, "no evaluado");
         }
     }
+    return summary_len;
+}
+
+typedef struct {
+    char* buffer;
+    int offset;
+    int capacity;
+    int count;
+    int omitted;
+} UserListCtx;
+
+static void append_user(const ClientInfo* client, void* arg) {
+    UserListCtx* ctx = arg;
+    char line[128];
+    
+    ctx->count++;
+    int len = snprintf(line, sizeof(line), "%d. [%s:%d] - %s - %s\r\n",
+                       ctx->count,
+                       client->ip,
+                       client->port,
+                       client->user_type == USER_ADMIN ? "ADMIN" : "OBSERVER",
+                       client->authenticated ? client->username : "No autenticado");
     
-    pthread_mutex_unlock(&clients_mutex);
+    if (ctx->omitted || ctx->offset + len >= ctx->capacity) {
+        ctx->omitted++;
+        return;
+    }
+    memcpy(ctx->buffer + ctx->offset, line, len + 1);
+    ctx->offset += len;
 }
 
+// Lista los usuarios conectados sin bloquear altas/bajas. Si no caben todos
+// en la respuesta, se indica cuántos quedaron fuera.
 void list_connected_users(char* buffer) {
-    pthread_mutex_lock(&clients_mutex);
+    UserListCtx ctx = { buffer, 0, BUFFER_SIZE - 128, 0, 0 };
+    
+    ctx.offset += sprintf(buffer, "=== USUARIOS CONECTADOS ===\r\n");
+    registry_for_each(append_user, &ctx);
     
-    int offset = 0;
-    offset += sprintf(buffer + offset, "=== USUARIOS CONECTADOS ===\r\n");
+    if (ctx.count == 0) {
+        sprintf(buffer + ctx.offset, "No hay usuarios conectados\r\n");
+    } else if (ctx.omitted > 0) {
+        sprintf(buffer + ctx.offset, "... y %d usuarios más (total %d)\r\n",
+                ctx.omitted, ctx.count);
+    }
+}
+
+// Estado inicial de una conexión: texto y frecuencia por defecto (ver add_client)
+void client_session_init(ClientSession* session) {
+    session->encoding = ENCODING_TEXT;
+    session->rate_bucket = SCHEDULER_DEFAULT_BUCKET;
+    session->telemetry_mode = TELEMETRY_MODE_FULL;
+    telemetry_filter_init(&session->filter);
+    session->phase = SESSION_HANDSHAKE;
+    session->vehicles[0] = 0;
+    session->vehicle_count = 1;
+    session->completion.notify = NULL;
+    session->command_pending = 0;
+}
+
+// Lista de vehículos del header "Vehicle-Id" ("3" o "3,17,42"): IDs de la
+// flota, sin repetidos y como mucho MAX_VEHICLE_SUBSCRIPTIONS. Devuelve
+// cuántos hay, 0 si falta el header o -1 si no es válida.
+static int parse_vehicle_list(const MessageView* msg, uint32_t* vehicles) {
+    char text[MAX_VEHICLE_SUBSCRIPTIONS * 8];
+    if (view_copy(message_header(msg, "Vehicle-Id"), text, sizeof(text)) <= 0) return 0;
     
     int count = 0;
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (clients[i].active) {
-            count++;
-            offset += sprintf(buffer + offset, "%d. [%s:%d] - %s - %s\r\n",
-                            count,
-                            clients[i].ip,
-                            clients[i].port,
-                            clients[i].user_type == USER_ADMIN ? "ADMIN" : "OBSERVER",
-                            clients[i].authenticated ? clients[i].username : "No autenticado");
+    char* cursor = text;
+    while (1) {
+        char* end;
+        long id = strtol(cursor, &end, 10);
+        if (end == cursor || id < 0 || id >= telemetry_vehicle_count() ||
+            count == MAX_VEHICLE_SUBSCRIPTIONS) {
+            return -1;
+        }
+        for (int i = 0; i < count; i++) {
+            if (vehicles[i] == (uint32_t)id) return -1;
         }
+        vehicles[count++] = (uint32_t)id;
+        
+        while (*end == ' ') end++;
+        if (*end == '\0') return count;
+        if (*end != ',') return -1;
+        cursor = end + 1;
+    }
+}
+
+// Vehículo al que va una petición: el de su header "Vehicle-Id" o, si no lo
+// trae, el primero de la sesión. Devuelve 0 si el header no es válido.
+static int request_vehicle(const MessageView* msg, const ClientSession* session,
+                           uint32_t* vehicle) {
+    uint32_t vehicles[MAX_VEHICLE_SUBSCRIPTIONS];
+    int count = parse_vehicle_list(msg, vehicles);
+    if (count < 0 || count > 1) return 0;
+    *vehicle = count == 1 ? vehicles[0] : session->vehicles[0];
+    return 1;
+}
+
+// Nombres de los campos en "Fields" y "Threshold", en el orden de TELEMETRY_FIELD_*
+static const char* field_names[] = { "speed", "battery", "temperature", "direction", "moving" };
+#define FIELD_NAME_COUNT 5
+
+static int field_index(const char* name, int len) {
+    for (int i = 0; i < FIELD_NAME_COUNT; i++) {
+        if ((int)strlen(field_names[i]) == len && strncasecmp(name, field_names[i], len) == 0) return i;
+    }
+    return -1;
+}
+
+// Filtro de suscripción de un CONNECT:
+//   Fields: battery,temperature   campos a enviar ("all" por defecto, "none")
+//   Threshold: temperature=0.5    cambio mínimo de speed, battery o temperature
+//   Telemetry: on-change          modo completo, pero solo cuando algo cambie
+// Un admin sin "Fields" no recibe telemetría periódica: la pide con
+// GET_TELEMETRY. Devuelve 0 si algún header no es válido.
+static int parse_telemetry_filter(const MessageView* msg, UserType user_type,
+                                  TelemetryFilter* filter, TelemetryMode* mode) {
+    char text[128];
+    telemetry_filter_init(filter);
+    
+    *mode = TELEMETRY_MODE_FULL;
+    if (view_equals(message_header(msg, "Telemetry"), "delta")) {
+        *mode = TELEMETRY_MODE_DELTA;
+    } else if (view_equals(message_header(msg, "Telemetry"), "on-change")) {
+        filter->on_change = 1;
     }
     
-    if (count == 0) {
-        offset += sprintf(buffer + offset, "No hay usuarios conectados\r\n");
+    if (view_copy(message_header(msg, "Fields"), text, sizeof(text)) > 0) {
+        filter->fields = 0;
+        if (strcasecmp(text, "all") == 0) {
+            filter->fields = TELEMETRY_FIELD_ALL;
+        } else if (strcasecmp(text, "none") != 0) {
+            char* save;
+            for (char* name = strtok_r(text, ", ", &save); name; name = strtok_r(NULL, ", ", &save)) {
+                int field = field_index(name, strlen(name));
+                if (field < 0) return 0;
+                filter->fields |= 1u << field;
+            }
+        }
+    } else if (user_type == USER_ADMIN) {
+        filter->fields = 0;
     }
     
-    pthread_mutex_unlock(&clients_mutex);
+    if (view_copy(message_header(msg, "Threshold"), text, sizeof(text)) > 0) {
+        char* save;
+        for (char* item = strtok_r(text, ", ", &save); item; item = strtok_r(NULL, ", ", &save)) {
+            char* eq = strchr(item, '=');
+            int field = eq ? field_index(item, eq - item) : -1;
+            if (field < 0 || field >= TELEMETRY_THRESHOLD_COUNT) return 0;
+            
+            char* end;
+            float threshold = strtof(eq + 1, &end);
+            if (end == eq + 1 || *end != '\0' || !(threshold >= 0)) return 0;
+            filter->thresholds[field] = threshold;
+        }
+    }
+    return 1;
+}
+
+// Lista de vehículos para el log ("0" o "3,17,42")
+static void format_vehicle_list(const ClientSession* session, char* out, int size) {
+    int len = 0;
+    out[0] = '\0';
+    for (int i = 0; i < session->vehicle_count && len < size; i++) {
+        len += snprintf(out + len, size - len, i ? ",%u" : "%u", session->vehicles[i]);
+    }
 }
 
-// Función auxiliar para verificar admin autenticado
-static int check_admin_auth(int client_idx, int client_socket, const char* client_ip, int client_port) {
-    if (clients[client_idx].user_type != USER_ADMIN || !clients[client_idx].authenticated) {
+// Función auxiliar para verificar admin autenticado. Devuelve 0 si está
+// autorizado o la longitud de la respuesta de error ya construida.
+static int check_admin_auth(int client_idx, const char* client_ip, int client_port,
+                            ProtocolEncoding encoding, char* response) {
+    ClientInfo client;
+    if (!registry_get(client_idx, &client) ||
+        client.user_type != USER_ADMIN || !client.authenticated) {
         log_message(client_ip, client_port, "AUTH_ERROR", "No autorizado");
-        char response[BUFFER_SIZE];
-        build_response(response, MSG_RESPONSE_ERROR, "Debe ser administrador autenticado");
-        send(client_socket, response, strlen(response), 0);
-        return 0;
+        return encode_response(response, encoding, MSG_RESPONSE_ERROR, "Debe ser administrador autenticado");
     }
     
-    if (!validate_token(clients[client_idx].username, clients[client_idx].auth_token)) {
+    if (!validate_token(client.username, client.auth_token)) {
         log_message(client_ip, client_port, "TOKEN_ERROR", "Token inválido o expirado");
-        char response[BUFFER_SIZE];
-        build_response(response, MSG_RESPONSE_ERROR, "Token inválido. Reautentíquese");
-        send(client_socket, response, strlen(response), 0);
-        return 0;
+        return encode_response(response, encoding, MSG_RESPONSE_ERROR, "Token inválido. Reautentíquese");
     }
     
+    return 0;
+}
+
+// Respuesta RESPONSE_OK como frame propio, para bodies que no caben en
+// BUFFER_SIZE (informe de métricas, historial)
+static Frame* build_large_reply(ProtocolEncoding encoding, const char* body, int body_len) {
+    char* buffer = malloc(body_len + 64);
+    if (!buffer) return NULL;
+    
+    int len = encode_response(buffer, encoding, MSG_RESPONSE_OK, body);
+    Frame* frame = frame_create(buffer, len, 0);
+    free(buffer);
+    return frame;
+}
+
+static Frame* build_stats_reply(ProtocolEncoding encoding) {
+    char* report = malloc(METRICS_REPORT_MAX);
+    if (!report) return NULL;
+    
+    int len = metrics_render(report, METRICS_REPORT_MAX);
+    Frame* frame = build_large_reply(encoding, report, len);
+    free(report);
+    return frame;
+}
+
+// Entero de un header opcional: 1 si falta (deja 'value' igual), 0 si no es válido
+static int parse_int64_header(const MessageView* msg, const char* name, int64_t* value) {
+    char text[32];
+    if (view_copy(message_header(msg, name), text, sizeof(text)) <= 0) return 1;
+    
+    char* end;
+    long long parsed = strtoll(text, &end, 10);
+    if (*end != '\0' || parsed < 0) return 0;
+    *value = parsed;
     return 1;
 }
 
+// Consulta de GET_HISTORY a partir de sus headers "From", "To" (ms desde
+// epoch, incluidos) y "Buckets". Devuelve 0 si no es válida.
+static int parse_history_query(const MessageView* msg, HistoryQuery* query) {
+    int64_t buckets = 0;
+    query->from = INT64_MIN;
+    query->to = INT64_MAX;
+    
+    if (!parse_int64_header(msg, "From", &query->from) ||
+        !parse_int64_header(msg, "To", &query->to) ||
+        !parse_int64_header(msg, "Buckets", &buckets)) {
+        return 0;
+    }
+    query->buckets = (int)buckets;
+    return query->from <= query->to && buckets <= HISTORY_MAX_BUCKETS;
+}
+
+// Respuesta (y log) del COMMAND de la sesión, con 'applied' comandos aplicados
+static int command_result(const ClientSession* session, int applied, const char* client_ip,
+                          int client_port, char* response) {
+    const PendingCommand* command = &session->command;
+    ProtocolEncoding encoding = session->encoding;
+    char result[BUFFER_SIZE / 2];
+    
+    if (command->count > 1) {
+        // Se loguea solo el resumen: una línea por lote
+        char summary[256];
+        int summary_len = format_batch_result(result, command->commands, command->count, applied,
+                                              command->steps, command->reason);
+        snprintf(summary, sizeof(summary), "%.*s", summary_len, result);
+        log_message(client_ip, client_port,
+                    applied == command->count ? "COMMAND_OK" : "COMMAND_REJECTED", summary);
+        return encode_response(response, encoding,
+                               applied == command->count ? MSG_RESPONSE_OK : MSG_RESPONSE_ERROR,
+                               result);
+    }
+    
+    if (applied == 0) {
+        log_message(client_ip, client_port, "COMMAND_REJECTED", command->reason);
+        return encode_response(response, encoding, MSG_RESPONSE_ERROR, command->reason);
+    }
+    
+    sprintf(result, "Comando %s ejecutado. Speed: %.2f km/h, Direction: %s",
+           command_to_string(command->commands[0]), command->steps[0].speed,
+           command->steps[0].direction);
+    
+    log_message(client_ip, client_port, "COMMAND_OK", result);
+    return encode_response(response, encoding, MSG_RESPONSE_OK, result);
+}
+
+// Despacha el mensaje según su tipo (ver process_client_message)
+static int dispatch_message(int client_idx, const MessageView* msg,
+                            const char* client_ip, int client_port, ClientSession* session,
+                            char* response, int* close_after, Frame** shared_reply) {
+    ProtocolEncoding encoding = session->encoding; // La respuesta va en la codificación de la petición
+    
+    if (!msg->valid) {
+        log_message(client_ip, client_port, "ERROR", "Mensaje mal formado");
+        return encode_response(response, encoding, MSG_RESPONSE_ERROR, "Formato de mensaje inválido");
+    }
+    
+    // Procesar según tipo de mensaje
+    switch (msg->type) {
+        case MSG_CONNECT: {
+            // Conectar cliente
+            UserType user_type = view_equals(message_header(msg, "User-Type"), "ADMIN") ?
+                                 USER_ADMIN : USER_OBSERVER;
+            
+            // Vehículos a los que se suscribe ("Vehicle-Id: 3,17"), por defecto el 0
+            uint32_t vehicles[MAX_VEHICLE_SUBSCRIPTIONS];
+            int vehicle_count = parse_vehicle_list(msg, vehicles);
+            if (vehicle_count < 0) {
+                char error[96];
+                sprintf(error, "Vehicle-Id inválido (de 1 a %d IDs distintos, de 0 a %d)",
+                        MAX_VEHICLE_SUBSCRIPTIONS, telemetry_vehicle_count() - 1);
+                log_message(client_ip, client_port, "CONNECT_ERROR", "Vehicle-Id inválido");
+                return encode_response(response, encoding, MSG_RESPONSE_ERROR, error);
+            }
+            if (vehicle_count == 0) {
+                vehicles[0] = 0;
+                vehicle_count = 1;
+            }
+            
+            TelemetryFilter filter;
+            TelemetryMode mode;
+            if (!parse_telemetry_filter(msg, user_type, &filter, &mode)) {
+                log_message(client_ip, client_port, "CONNECT_ERROR", "Filtro de telemetría inválido");
+                return encode_response(response, encoding, MSG_RESPONSE_ERROR,
+                                       "Filtro inválido (Fields: speed,battery,temperature,direction,"
+                                       "moving|all|none; Threshold: campo=valor)");
+            }
+            
+            // "Transport: multicast": la telemetría periódica llega por el
+            // canal UDP y la conexión TCP queda para peticiones (GET_TELEMETRY
+            // recupera los huecos de la secuencia)
+            int multicast = view_equals(message_header(msg, "Transport"), "multicast");
+            if (multicast && !multicast_enabled()) {
+                log_message(client_ip, client_port, "CONNECT_ERROR", "Canal multicast no disponible");
+                return encode_response(response, encoding, MSG_RESPONSE_ERROR,
+                                       "Canal multicast no disponible");
+            }
+            if (multicast) filter.fields = 0;
+            
+            registry_set_user_type(client_idx, user_type);
+            
+            // Negociación de VATP/2.0: la respuesta a CONNECT aún va en texto,
+            // con la versión aceptada en la primera línea
+            const char* version = PROTOCOL_VERSION;
+            if (encoding == ENCODING_TEXT &&
+                view_equals(message_header(msg, "Protocol"), PROTOCOL_VERSION_BINARY)) {
+                version = PROTOCOL_VERSION_BINARY;
+                session->encoding = ENCODING_BINARY;
+            }
+            
+            // Frecuencia de telemetría pedida ("Rate: <Hz>"), por defecto 0.1 Hz
+            char rate_str[32];
+            double rate_hz = SCHEDULER_DEFAULT_RATE_HZ;
+            if (view_copy(message_header(msg, "Rate"), rate_str, sizeof(rate_str)) > 0) {
+                rate_hz = atof(rate_str);
+            }
+            int bucket = scheduler_subscribe(rate_hz);
+            scheduler_unsubscribe(session->rate_bucket);
+            
+            // Alta en los flujos nuevos antes de la baja: un vehículo que se
+            // mantiene no pierde su secuencia delta
+            subscriptions_add(bucket, vehicles, vehicle_count, &filter, mode);
+            subscriptions_remove(session->rate_bucket, session->vehicles, session->vehicle_count,
+                                 &session->filter, session->telemetry_mode);
+            session->rate_bucket = bucket;
+            memcpy(session->vehicles, vehicles, vehicle_count * sizeof(uint32_t));
+            session->vehicle_count = vehicle_count;
+            session->telemetry_mode = mode;
+            session->filter = filter;
+            
+            registry_set_session(client_idx, session->encoding, session->rate_bucket,
+                                 session->telemetry_mode, &session->filter, session->vehicles,
+                                 session->vehicle_count);
+            
+            // Un admin tiene que autenticarse antes de que venza su plazo
+            if (session->phase == SESSION_HANDSHAKE) {
+                session->phase = user_type == USER_ADMIN ? SESSION_AUTH : SESSION_READY;
+            }
+            
+            char vehicle_list[MAX_VEHICLE_SUBSCRIPTIONS * 8];
+            format_vehicle_list(session, vehicle_list, sizeof(vehicle_list));
+            
+            const char* telemetry = multicast ? "multicast" :
+                                    session->filter.fields == 0 ? "ninguna" :
+                                    !telemetry_filter_is_plain(&session->filter) ? "filtrada" :
+                                    session->telemetry_mode == TELEMETRY_MODE_DELTA ? "delta" :
+                                    "completa";
+            
+            char log_msg[384];
+            sprintf(log_msg, "Solicitud de conexión como %s (%s, telemetría %s cada %d ms, vehículo %s)", 
+                   user_type == USER_ADMIN ? "ADMIN" : "OBSERVER",
+                   session->encoding == ENCODING_BINARY ? PROTOCOL_VERSION_BINARY : PROTOCOL_VERSION,
+                   telemetry, scheduler_period_ms(multicast ? multicast_bucket() : bucket), vehicle_list);
+            log_message(client_ip, client_port, "CONNECT", log_msg);
+            
+            const char* text = user_type == USER_ADMIN ?
+                "Conectado como ADMIN. Debe autenticarse para enviar comandos" :
+                "Conectado como OBSERVER. Recibirá telemetría automáticamente";
+            
+            // La respuesta anuncia el canal: destino y periodo de publicación
+            char multicast_text[384];
+            if (multicast) {
+                snprintf(multicast_text, sizeof(multicast_text),
+                         "%s\r\nMulticast: %s\r\nInterval: %d",
+                         user_type == USER_ADMIN ? text : "Conectado como OBSERVER. Telemetría por UDP",
+                         multicast_targets(), scheduler_period_ms(multicast_bucket()));
+                text = multicast_text;
+            }
+            if (encoding == ENCODING_BINARY) {
+                return build_binary_response(response, MSG_RESPONSE_OK, text);
+            }
+            return build_versioned_response(response, version, MSG_RESPONSE_OK, text);
+        }
+        
+        case MSG_AUTH: {
+            // Autenticar administrador
+            ClientInfo client;
+            if (!registry_get(client_idx, &client) || client.user_type != USER_ADMIN) {
+                log_message(client_ip, client_port, "AUTH_ERROR", 
+                           "Usuario no es administrador");
+                return encode_response(response, encoding, MSG_RESPONSE_ERROR, 
+                                      "Solo administradores pueden autenticarse");
+            }
+            
+            // Parsear usuario y contraseña
+            char username[MAX_USERNAME];
+            char password[MAX_PASSWORD];
+            char token[MAX_TOKEN];
+            
+            view_copy(message_header(msg, "Username"), username, sizeof(username));
+            view_copy(message_header(msg, "Password"), password, sizeof(password));
+            
+            if (authenticate_user(username, password, token)) {
+                registry_set_auth(client_idx, username, token);
+                session->phase = SESSION_READY;
+                
+                char log_msg[256];
+                sprintf(log_msg, "Autenticación exitosa para usuario: %s", username);
+                log_message(client_ip, client_port, "AUTH_SUCCESS", log_msg);
+                
+                char resp_data[256];
+                sprintf(resp_data, "Autenticación exitosa. Token: %s", token);
+                return encode_response(response, encoding, MSG_RESPONSE_OK, resp_data);
+            }
+            
+            log_message(client_ip, client_port, "AUTH_FAILED", 
+                       "Credenciales inválidas");
+            return encode_response(response, encoding, MSG_RESPONSE_ERROR, 
+                                  "Credenciales inválidas");
+        }
+        
+        case MSG_COMMAND: {
+            int denied = check_admin_auth(client_idx, client_ip, client_port, encoding, response);
+            if (denied) {
+                return denied;
+            }
+            
+            uint32_t vehicle;
+            if (!request_vehicle(msg, session, &vehicle)) {
+                log_message(client_ip, client_port, "COMMAND_ERROR", "Vehicle-Id inválido");
+                return encode_response(response, encoding, MSG_RESPONSE_ERROR, "Vehículo inexistente");
+            }
+            
+            CommandType commands[COMMAND_MAX_BATCH];
+            int bad_step;
+            int count = parse_command_list(msg, encoding, commands, &bad_step);
+            if (count == -2) {
+                char error[64];
+                sprintf(error, "Lote inválido (de 1 a %d comandos)", COMMAND_MAX_BATCH);
+                log_message(client_ip, client_port, "COMMAND_ERROR", "Lote vacío o demasiado largo");
+                return encode_response(response, encoding, MSG_RESPONSE_ERROR, error);
+            }
+            if (count < 0) {
+                char error[64];
+                sprintf(error, "Comando no reconocido (paso %d)", bad_step + 1);
+                log_message(client_ip, client_port, "COMMAND_ERROR", "Comando desconocido");
+                return encode_response(response, encoding, MSG_RESPONSE_ERROR,
+                                       bad_step == 0 ? "Comando no reconocido" : error);
+            }
+            
+            // El actor valida y aplica en un solo paso (sin carreras entre
+            // admins); un lote se aplica entero o no se aplica
+            PendingCommand* command = &session->command;
+            command->count = count;
+            memcpy(command->commands, commands, count * sizeof(CommandType));
+            if (session->completion.notify) {
+                // Reactor: no se espera al actor, la respuesta la construye
+                // client_command_reply() cuando llegue el aviso
+                actor_post_commands(&session->completion, vehicle, command->commands, count,
+                                    command->steps, command->reason);
+                session->command_pending = 1;
+                return 0;
+            }
+            
+            int applied = actor_apply_commands(&session->completion, vehicle, command->commands,
+                                               count, command->steps, command->reason);
+            return command_result(session, applied, client_ip, client_port, response);
+        }
+        
+        case MSG_LIST_USERS: {
+            int denied = check_admin_auth(client_idx, client_ip, client_port, encoding, response);
+            if (denied) {
+                return denied;
+            }
+            
+            char user_list[BUFFER_SIZE];
+            list_connected_users(user_list);
+            log_message(client_ip, client_port, "LIST_USERS", "OK");
+            return encode_response(response, encoding, MSG_RESPONSE_OK, user_list);
+        }
+        
+        case MSG_GET_TELEMETRY: {
+            // Enviar telemetría inmediata (frame cacheado por versión del estado)
+            uint32_t vehicle;
+            if (!request_vehicle(msg, session, &vehicle)) {
+                log_message(client_ip, client_port, "GET_TELEMETRY", "Vehicle-Id inválido");
+                return encode_response(response, encoding, MSG_RESPONSE_ERROR, "Vehículo inexistente");
+            }
+            log_message(client_ip, client_port, "GET_TELEMETRY", 
+                       "Solicitó telemetría");
+            
+            *shared_reply = telemetry_get_frame(vehicle, encoding);
+            if (*shared_reply) {
+                return (*shared_reply)->len;
+            }
+            return encode_response(response, encoding, MSG_RESPONSE_ERROR, "Telemetría no disponible");
+        }
+        
+        case MSG_GET_HISTORY: {
+            // El historial solo se guarda para el vehículo 0
+            uint32_t vehicle = 0;
+            if (message_header(msg, "Vehicle-Id").len > 0 &&
+                (!request_vehicle(msg, session, &vehicle) || vehicle != 0)) {
+                log_message(client_ip, client_port, "HISTORY_ERROR", "Vehicle-Id sin historial");
+                return encode_response(response, encoding, MSG_RESPONSE_ERROR,
+                                       "Solo hay historial del vehículo 0");
+            }
+            
+            HistoryQuery query;
+            if (!parse_history_query(msg, &query)) {
+                char error[96];
+                sprintf(error, "Consulta inválida (From <= To en ms, Buckets de 0 a %d)",
+                        HISTORY_MAX_BUCKETS);
+                log_message(client_ip, client_port, "HISTORY_ERROR", "Consulta inválida");
+                return encode_response(response, encoding, MSG_RESPONSE_ERROR, error);
+            }
+            
+            log_message(client_ip, client_port, "GET_HISTORY", "Solicitó historial");
+            
+            char* body = malloc(HISTORY_REPLY_MAX);
+            if (body) {
+                int len = history_query(&query, body, HISTORY_REPLY_MAX);
+                *shared_reply = build_large_reply(encoding, body, len);
+                free(body);
+            }
+            if (*shared_reply) {
+                return (*shared_reply)->len;
+            }
+            return encode_response(response, encoding, MSG_RESPONSE_ERROR, "Historial no disponible");
+        }
+        
+        case MSG_RESYNC: {
+            // Keyframe con la base y la secuencia actuales del bucket: el
+            // cliente delta lo pide tras CONNECT o al ver un salto de secuencia
+            uint32_t vehicle;
+            if (!request_vehicle(msg, session, &vehicle)) {
+                log_message(client_ip, client_port, "RESYNC", "Vehicle-Id inválido");
+                return encode_response(response, encoding, MSG_RESPONSE_ERROR, "Vehículo inexistente");
+            }
+            log_message(client_ip, client_port, "RESYNC", "Solicitó keyframe");
+            
+            // Un vehículo sin flujo en el bucket (no suscrito) recibe el completo
+            *shared_reply = NULL;
+            if (session->telemetry_mode == TELEMETRY_MODE_DELTA) {
+                *shared_reply = telemetry_get_keyframe(session->rate_bucket, vehicle,
+                                                       &session->filter, encoding);
+            }
+            if (!*shared_reply) {
+                *shared_reply = telemetry_get_frame(vehicle, encoding);
+            }
+            if (*shared_reply) {
+                return (*shared_reply)->len;
+            }
+            return encode_response(response, encoding, MSG_RESPONSE_ERROR, "Telemetría no disponible");
+        }
+        
+        case MSG_STATS: {
+            int denied = check_admin_auth(client_idx, client_ip, client_port, encoding, response);
+            if (denied) {
+                return denied;
+            }
+            
+            log_message(client_ip, client_port, "STATS", "OK");
+            *shared_reply = build_stats_reply(encoding);
+            if (*shared_reply) {
+                return (*shared_reply)->len;
+            }
+            return encode_response(response, encoding, MSG_RESPONSE_ERROR, "Métricas no disponibles");
+        }
+        
+        case MSG_DISCONNECT: {
+            log_message(client_ip, client_port, "DISCONNECT", 
+                       "Cliente solicitó desconexión");
+            *close_after = 1;
+            return encode_response(response, encoding, MSG_RESPONSE_OK, "Desconectado correctamente");
+        }
+        
+        default:
+            log_message(client_ip, client_port, "ERROR", "Tipo de mensaje no soportado");
+            return encode_response(response, encoding, MSG_RESPONSE_ERROR, "Tipo de mensaje no soportado");
+    }
+}
+
+// Si la respuesta construida es un RESPONSE_ERROR (en cualquier codificación)
+static int is_error_reply(const char* reply, int len, ProtocolEncoding encoding) {
+    static const char error_type[] = "RESPONSE_ERROR";
+    
+    if (encoding == ENCODING_BINARY) {
+        return len > 1 && (unsigned char)reply[1] == MSG_RESPONSE_ERROR;
+    }
+    // "<versión> <tipo> <longitud>..."
+    const char* type = memchr(reply, ' ', len);
+    if (!type) return 0;
+    type++;
+    return reply + len - type >= (long)strlen(error_type) &&
+           memcmp(type, error_type, strlen(error_type)) == 0;
+}
+
+// Procesa un mensaje ya parseado por el StreamParser y deja la
+// respuesta en 'response'. Es independiente del modelo de I/O: la usan
+// tanto el modo thread-por-cliente como el reactor epoll.
+// Si la respuesta es un frame compartido (telemetría ya codificada), se
+// devuelve en *shared_reply con una referencia que el llamador debe soltar.
+// Cuenta la petición (y si falló) por tipo y mide el tiempo de servicio.
+// Un COMMAND en un reactor deja session->command_pending y devuelve 0: la
+// respuesta llega con client_command_reply().
+int process_client_message(int client_idx, const MessageView* msg,
+                           const char* client_ip, int client_port, ClientSession* session,
+                           char* response, int* close_after, Frame** shared_reply) {
+    ProtocolEncoding encoding = session->encoding;
+    unsigned long start = metrics_now_ns();
+    *close_after = 0;
+    *shared_reply = NULL;
+    
+    int len = dispatch_message(client_idx, msg, client_ip, client_port, session,
+                               response, close_after, shared_reply);
+    if (session->command_pending) {
+        // Sin respuesta todavía: se cuenta en client_command_reply()
+        session->command.start_ns = start;
+        return 0;
+    }
+    
+    metrics_record(METRIC_HIST_SERVICE, metrics_now_ns() - start);
+    if (!msg->valid) {
+        metrics_add(METRIC_INVALID_MESSAGES, 1);
+    } else {
+        metrics_request(msg->type, !*shared_reply && is_error_reply(response, len, encoding));
+    }
+    return len;
+}
+
+// Reactores: respuesta del COMMAND pendiente de la sesión, una vez que el
+// actor avisó por completion.notify. Lo cuenta como process_client_message.
+int client_command_reply(ClientSession* session, const char* client_ip, int client_port,
+                         char* response) {
+    int len = command_result(session, session->completion.applied, client_ip, client_port,
+                             response);
+    session->command_pending = 0;
+    
+    metrics_record(METRIC_HIST_SERVICE, metrics_now_ns() - session->command.start_ns);
+    metrics_request(MSG_COMMAND, is_error_reply(response, len, session->encoding));
+    return len;
+}
+
+// Modo thread-por-cliente (fallback): un thread bloqueado en recv() por socket
 void* handle_client(void* arg) {
     int client_socket = *((int*)arg);
     free(arg);
     
-    char buffer[BUFFER_SIZE];
-    char accumulated[BUFFER_SIZE * 2] = {0}; // Buffer acumulado
-    int acc_len = 0;
+    StreamParser* parser = malloc(sizeof(StreamParser));
+    MessageView msg;
+    ClientSession session;
     char response[BUFFER_SIZE];
-    Message msg;
     
     // Obtener información del cliente
     struct sockaddr_in addr;
@@ -126,205 +821,84 @@ void* handle_client(void* arg) {
     int client_port = ntohs(addr.sin_port);
     
     // Agregar cliente a la lista
-    int client_idx = add_client(client_socket, client_ip, client_port);
+    int client_idx = add_client(0, client_socket, client_ip, client_port);
     if (client_idx < 0) {
-        log_error("Máximo número de clientes alcanzado");
+        log_error("No se pudo registrar el cliente");
         close(client_socket);
         return NULL;
     }
     
-    // Loop principal del cliente
-    while (1) {
-        memset(buffer, 0, BUFFER_SIZE);
-        int bytes_received = recv(client_socket, buffer, BUFFER_SIZE - 1, 0);
+    if (!parser) {
+        log_error("Sin memoria para el buffer de recepción");
+        remove_client(client_idx);
+        return NULL;
+    }
+    
+    // El broadcast también escribe en este socket: cada respuesta sale entera
+    // con el lock de escritura tomado
+    ClientInfo info;
+    registry_get(client_idx, &info); // Recién dado de alta: siempre está
+    pthread_mutex_t* write_lock = info.write_lock;
+    parser_init(parser);
+    client_session_init(&session);
+    
+    ConnTimer timer;
+    timeouts_shared_start(&timer, client_socket);
+    
+    // Loop principal del cliente: recv() escribe directamente en el parser
+    int running = 1;
+    while (running) {
+        int space;
+        char* dst = parser_write_ptr(parser, &space);
+        int bytes_received = recv(client_socket, dst, space, 0);
         
         if (bytes_received <= 0) {
-            // Cliente desconectado
-            log_message(client_ip, client_port, "DISCONNECTED", "Conexión cerrada");
+            // Cliente desconectado (o cerrado por un plazo vencido, se loguea abajo)
+            if (atomic_load(&timer.expired) == TIMEOUT_NONE) {
+                log_message(client_ip, client_port, "DISCONNECTED", "Conexión cerrada");
+            }
             break;
         }
+        metrics_add(METRIC_BYTES_IN, bytes_received);
+        parser_commit(parser, bytes_received);
         
-        buffer[bytes_received] = '\0';
-        
-        // Acumular el mensaje recibido
-        if (acc_len + bytes_received < BUFFER_SIZE * 2 - 1) {
-            strcat(accumulated, buffer);
-            acc_len += bytes_received;
-        }
-        
-        // Buscar el fin del mensaje (\n\n o \r\n\r\n)
-        char* msg_end = strstr(accumulated, "\n\n");
-        if (!msg_end) {
-            msg_end = strstr(accumulated, "\r\n\r\n");
-        }
-        
-        if (!msg_end) {
-            // Mensaje incompleto, seguir acumulando
-            continue;
-        }
-        
-        // Tenemos un mensaje completo
-        *msg_end = '\0'; // Terminar el mensaje
-        
-        // Parsear mensaje
-        if (!parse_message(accumulated, &msg)) {
-            log_message(client_ip, client_port, "ERROR", "Mensaje mal formado");
-            build_response(response, MSG_RESPONSE_ERROR, "Formato de mensaje inválido");
-            send(client_socket, response, strlen(response), 0);
-            
-            // Limpiar buffer acumulado
-            memset(accumulated, 0, sizeof(accumulated));
-            acc_len = 0;
-            continue;
+        // Despachar todos los mensajes completos (pipelining)
+        int status = PARSE_NEED_MORE;
+        while (running && (status = parser_next(parser, &msg)) == PARSE_COMPLETE) {
+            int close_after;
+            Frame* shared;
+            int len = process_client_message(client_idx, &msg, client_ip, client_port, &session,
+                                             response, &close_after, &shared);
+            
+            pthread_mutex_lock(write_lock);
+            int sent = send(client_socket, shared ? shared->data : response, len, MSG_NOSIGNAL);
+            pthread_mutex_unlock(write_lock);
+            if (sent > 0) metrics_add(METRIC_BYTES_OUT, sent);
+            frame_unref(shared);
+            parser_set_encoding(parser, session.encoding);
+            timeouts_shared_update(&timer, session.phase);
+            if (close_after) running = 0;
         }
         
-        // Limpiar buffer acumulado para el siguiente mensaje
-        memset(accumulated, 0, sizeof(accumulated));
-        acc_len = 0;
-        
-        // Procesar según tipo de mensaje
-        switch (msg.type) {
-            case MSG_CONNECT: {
-                // Conectar cliente
-                UserType user_type = strcmp(msg.data, "ADMIN") == 0 ? USER_ADMIN : USER_OBSERVER;
-                
-                pthread_mutex_lock(&clients_mutex);
-                clients[client_idx].user_type = user_type;
-                pthread_mutex_unlock(&clients_mutex);
-                
-                char log_msg[256];
-                sprintf(log_msg, "Solicitud de conexión como %s", 
-                       user_type == USER_ADMIN ? "ADMIN" : "OBSERVER");
-                log_message(client_ip, client_port, "CONNECT", log_msg);
-                
-                if (user_type == USER_ADMIN) {
-                    build_response(response, MSG_RESPONSE_OK, 
-                                 "Conectado como ADMIN. Debe autenticarse para enviar comandos");
-                } else {
-                    build_response(response, MSG_RESPONSE_OK, 
-                                 "Conectado como OBSERVER. Recibirá telemetría automáticamente");
-                }
-                send(client_socket, response, strlen(response), 0);
-                break;
-            }
-            
-            case MSG_AUTH: {
-                // Autenticar administrador
-                if (clients[client_idx].user_type != USER_ADMIN) {
-                    log_message(client_ip, client_port, "AUTH_ERROR", 
-                               "Usuario no es administrador");
-                    build_response(response, MSG_RESPONSE_ERROR, 
-                                 "Solo administradores pueden autenticarse");
-                    send(client_socket, response, strlen(response), 0);
-                    break;
-                }
-                
-                // Parsear usuario y contraseña
-                char username[MAX_USERNAME];
-                char password[MAX_PASSWORD];
-                char token[MAX_TOKEN];
-                
-                // El username viene en msg.username y password en msg.auth_token
-                strncpy(username, msg.username, MAX_USERNAME - 1);
-                strncpy(password, msg.auth_token, MAX_PASSWORD - 1);
-                
-                if (authenticate_user(username, password, token)) {
-                    pthread_mutex_lock(&clients_mutex);
-                    clients[client_idx].authenticated = 1;
-                    strncpy(clients[client_idx].username, username, MAX_USERNAME - 1);
-                    strncpy(clients[client_idx].auth_token, token, MAX_TOKEN - 1);
-                    pthread_mutex_unlock(&clients_mutex);
-                    
-                    char log_msg[256];
-                    sprintf(log_msg, "Autenticación exitosa para usuario: %s", username);
-                    log_message(client_ip, client_port, "AUTH_SUCCESS", log_msg);
-                    
-                    char resp_data[256];
-                    sprintf(resp_data, "Autenticación exitosa. Token: %s", token);
-                    build_response(response, MSG_RESPONSE_OK, resp_data);
-                } else {
-                    log_message(client_ip, client_port, "AUTH_FAILED", 
-                               "Credenciales inválidas");
-                    build_response(response, MSG_RESPONSE_ERROR, 
-                                 "Credenciales inválidas");
-                }
-                send(client_socket, response, strlen(response), 0);
-                break;
-            }
-            
-            case MSG_COMMAND: {
-                if (!check_admin_auth(client_idx, client_socket, client_ip, client_port)) break;
-                
-                CommandType cmd = parse_command(msg.command);
-                if (cmd == CMD_UNKNOWN) {
-                    log_message(client_ip, client_port, "COMMAND_ERROR", "Comando desconocido");
-                    build_response(response, MSG_RESPONSE_ERROR, "Comando no reconocido");
-                    send(client_socket, response, strlen(response), 0);
-                    break;
-                }
-                
-                char reason[256];
-                if (!can_execute_command(cmd, reason)) {
-                    log_message(client_ip, client_port, "COMMAND_REJECTED", reason);
-                    build_response(response, MSG_RESPONSE_ERROR, reason);
-                    send(client_socket, response, strlen(response), 0);
-                    break;
-                }
-                
-                update_vehicle_state(cmd);
-                
-                pthread_mutex_lock(&vehicle_mutex);
-                sprintf(response, "Comando %s ejecutado. Speed: %.2f km/h, Direction: %s",
-                       command_to_string(cmd), vehicle_state.speed, vehicle_state.direction);
-                pthread_mutex_unlock(&vehicle_mutex);
-                
-                log_message(client_ip, client_port, "COMMAND_OK", response);
-                build_response(response, MSG_RESPONSE_OK, response);
-                send(client_socket, response, strlen(response), 0);
-                break;
-            }
-            
-            case MSG_LIST_USERS: {
-                if (!check_admin_auth(client_idx, client_socket, client_ip, client_port)) break;
-                
-                char user_list[BUFFER_SIZE];
-                list_connected_users(user_list);
-                build_response(response, MSG_RESPONSE_OK, user_list);
-                send(client_socket, response, strlen(response), 0);
-                log_message(client_ip, client_port, "LIST_USERS", "OK");
-                break;
-            }
-            
-            case MSG_GET_TELEMETRY: {
-                // Enviar telemetría inmediata
-                pthread_mutex_lock(&vehicle_mutex);
-                build_telemetry_message(response, &vehicle_state);
-                pthread_mutex_unlock(&vehicle_mutex);
-                
-                log_message(client_ip, client_port, "GET_TELEMETRY", 
-                           "Solicitó telemetría");
-                
-                send(client_socket, response, strlen(response), 0);
-                break;
-            }
-            
-            case MSG_DISCONNECT: {
-                log_message(client_ip, client_port, "DISCONNECT", 
-                           "Cliente solicitó desconexión");
-                build_response(response, MSG_RESPONSE_OK, "Desconectado correctamente");
-                send(client_socket, response, strlen(response), 0);
-                goto cleanup;
-            }
-            
-            default:
-                log_message(client_ip, client_port, "ERROR", "Tipo de mensaje no soportado");
-                build_response(response, MSG_RESPONSE_ERROR, "Tipo de mensaje no soportado");
-                send(client_socket, response, strlen(response), 0);
-                break;
+        if (running && status < 0) {
+            const char* error = status == PARSE_TOO_LARGE ? "Mensaje demasiado grande" :
+                                                            "Trama binaria inválida";
+            log_message(client_ip, client_port, "ERROR", error);
+            int len = encode_response(response, session.encoding, MSG_RESPONSE_ERROR, error);
+            pthread_mutex_lock(write_lock);
+            int sent = send(client_socket, response, len, MSG_NOSIGNAL);
+            pthread_mutex_unlock(write_lock);
+            if (sent > 0) metrics_add(METRIC_BYTES_OUT, sent);
+            running = 0;
         }
     }
     
-cleanup:
-    remove_client(client_socket);
+    TimeoutKind timed_out = timeouts_shared_stop(&timer);
+    if (timed_out != TIMEOUT_NONE) {
+        log_message(client_ip, client_port, "TIMEOUT", timeout_reason(timed_out));
+    }
+    
+    free(parser);
+    remove_client(client_idx);
     return NULL;
-}
\ No newline at end of file
+}
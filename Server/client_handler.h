@@ -4,10 +4,51 @@
 #define CLIENT_HANDLER_H
 
 #include "protocol.h"
+#include "frame.h"
+#include "parser.h"
+#include "actor.h"
+
+// Fase de la sesión (decide qué plazo de timeouts.c se le aplica)
+typedef enum {
+    SESSION_HANDSHAKE,   // Aceptada, sin CONNECT todavía
+    SESSION_AUTH,        // CONNECT como ADMIN, sin AUTH todavía
+    SESSION_READY        // Observer conectado o admin autenticado
+} SessionPhase;
+
+// COMMAND entregado al actor: lo necesario para responder cuando se aplique
+typedef struct {
+    int count;
+    CommandType commands[COMMAND_MAX_BATCH];
+    VehicleState steps[COMMAND_MAX_BATCH];
+    char reason[256];
+    unsigned long start_ns;     // Inicio del servicio (METRIC_HIST_SERVICE)
+} PendingCommand;
+
+// Estado de protocolo de una conexión que el dispatch puede cambiar (CONNECT, AUTH)
+typedef struct {
+    ProtocolEncoding encoding;
+    int rate_bucket;
+    TelemetryMode telemetry_mode;
+    TelemetryFilter filter;
+    SessionPhase phase;
+    uint32_t vehicles[MAX_VEHICLE_SUBSCRIPTIONS];  // Vehículos suscritos (Vehicle-Id)
+    int vehicle_count;
+    ActorCompletion completion;                     // Resultado de sus COMMAND (actor.c)
+    // Con completion.notify (reactores) el COMMAND no espera al actor: queda
+    // pendiente y la respuesta se construye con client_command_reply()
+    PendingCommand command;
+    int command_pending;
+} ClientSession;
 
 void* handle_client(void* arg);
-int add_client(int socket_fd, const char* ip, int port);
-void remove_client(int socket_fd);
+void client_session_init(ClientSession* session);
+int process_client_message(int client_idx, const MessageView* msg,
+                           const char* client_ip, int client_port, ClientSession* session,
+                           char* response, int* close_after, Frame** shared_reply);
+int client_command_reply(ClientSession* session, const char* client_ip, int client_port,
+                         char* response);
+int add_client(int shard, int socket_fd, const char* ip, int port);
+void remove_client(int client_idx);
 void list_connected_users(char* buffer);
 
 #endif // CLIENT_HANDLER_H
\ No newline at end of file
@@ -0,0 +1,28 @@
+// ============= frame.c =============
+#include "frame.h"
+#include <stdlib.h>
+#include <string.h>
+
+Frame* frame_create(const char* data, int len, unsigned long version) {
+    Frame* frame = malloc(sizeof(Frame) + len + 1);
+    if (!frame) return NULL;
+
+    atomic_init(&frame->refcount, 1);
+    frame->version = version;
+    frame->vehicle = 0;
+    frame->len = len;
+    memcpy(frame->data, data, len);
+    frame->data[len] = '\0';
+    return frame;
+}
+
+Frame* frame_ref(Frame* frame) {
+    atomic_fetch_add_explicit(&frame->refcount, 1, memory_order_relaxed);
+    return frame;
+}
+
+void frame_unref(Frame* frame) {
+    if (frame && atomic_fetch_sub_explicit(&frame->refcount, 1, memory_order_acq_rel) == 1) {
+        free(frame);
+    }
+}
@@ -0,0 +1,23 @@
+// ============= frame.h =============
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Frame VATP ya codificado, inmutable y con contador de referencias.
+// Se construye una vez y lo comparten las colas de salida de todas las
+// conexiones; se libera cuando la última lo suelta.
+typedef struct {
+    atomic_int refcount;
+    unsigned long version;   // Versión del estado que representa (0 = no aplica)
+    uint32_t vehicle;        // Vehículo de un frame de telemetría
+    int len;
+    char data[];
+} Frame;
+
+Frame* frame_create(const char* data, int len, unsigned long version);
+Frame* frame_ref(Frame* frame);
+void frame_unref(Frame* frame);
+
+#endif // FRAME_H
@@ -0,0 +1,196 @@
+// ============= history.c =============
+// Historial de telemetría en memoria: un ring de capacidad fija con una
+// muestra cada 10 s (el bucket por defecto, con independencia de
+// --sim-rate), en formato struct-of-arrays (un array por campo) para que los
+// recorridos por campo de las consultas agregadas lean memoria contigua.
+//
+// Un solo escritor (el thread de telemetría) y lectores sin lock: el
+// escritor anuncia qué índice va a sobrescribir ('claimed') antes de tocar
+// el slot y lo publica ('written') al terminar. Un lector calcula su
+// respuesta y, si entretanto se reclamó algún slot que usó, la repite, como
+// el seqlock del estado del vehículo.
+#include "history.h"
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+
+#define HISTORY_MASK (HISTORY_CAPACITY - 1)
+
+typedef struct {
+    int64_t timestamp[HISTORY_CAPACITY];    // ms desde epoch, no decreciente
+    float speed[HISTORY_CAPACITY];
+    float battery[HISTORY_CAPACITY];
+    float temperature[HISTORY_CAPACITY];
+    uint8_t direction[HISTORY_CAPACITY];    // ID de VATP/2.0
+    uint8_t moving[HISTORY_CAPACITY];
+} HistoryRing;
+
+static HistoryRing ring;
+static atomic_ulong written = 0;    // Muestras publicadas (índice lógico de la siguiente)
+static atomic_ulong claimed = 0;    // Índice en escritura + 1
+
+static int64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void history_append(const VehicleState* state) {
+    unsigned long index = atomic_load_explicit(&written, memory_order_relaxed);
+    int slot = index & HISTORY_MASK;
+
+    // La búsqueda binaria necesita timestamps ordenados aunque el reloj retroceda
+    int64_t timestamp = now_ms();
+    if (index > 0 && timestamp < ring.timestamp[(index - 1) & HISTORY_MASK]) {
+        timestamp = ring.timestamp[(index - 1) & HISTORY_MASK];
+    }
+
+    atomic_store_explicit(&claimed, index + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    ring.timestamp[slot] = timestamp;
+    ring.speed[slot] = state->speed;
+    ring.battery[slot] = state->battery;
+    ring.temperature[slot] = state->temperature;
+    ring.direction[slot] = direction_to_id(state->direction);
+    ring.moving[slot] = state->is_moving ? 1 : 0;
+
+    atomic_store_explicit(&written, index + 1, memory_order_release);
+}
+
+// Primer índice lógico de [lo, hi) con timestamp >= value (hi si no hay)
+static unsigned long lower_bound(unsigned long lo, unsigned long hi, int64_t value) {
+    while (lo < hi) {
+        unsigned long mid = lo + (hi - lo) / 2;
+        if (ring.timestamp[mid & HISTORY_MASK] < value) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+typedef struct {
+    float min;
+    float max;
+    double sum;
+} FieldStats;
+
+// Un solo campo sobre [start, end): el bucle recorre un array contiguo
+static FieldStats field_stats(const float* field, unsigned long start, unsigned long end) {
+    FieldStats stats = { field[start & HISTORY_MASK], field[start & HISTORY_MASK], 0 };
+    for (unsigned long i = start; i < end; i++) {
+        float value = field[i & HISTORY_MASK];
+        if (value < stats.min) stats.min = value;
+        if (value > stats.max) stats.max = value;
+        stats.sum += value;
+    }
+    return stats;
+}
+
+static char* append_str(char* out, const char* str) {
+    int len = strlen(str);
+    memcpy(out, str, len);
+    return out + len;
+}
+
+static char* append_field(char* out, float value) {
+    *out++ = ',';
+    return out + format_fixed2(out, value);
+}
+
+static char* append_stats(char* out, FieldStats stats, unsigned long count) {
+    out = append_field(out, stats.min);
+    out = append_field(out, stats.max);
+    return append_field(out, (float)(stats.sum / count));
+}
+
+// Una línea por muestra: las HISTORY_MAX_POINTS más recientes de [lo, hi)
+static int format_samples(char* out, int size, unsigned long lo, unsigned long hi) {
+    unsigned long total = hi - lo;
+    if (total > HISTORY_MAX_POINTS) lo = hi - HISTORY_MAX_POINTS;
+
+    char* p = out;
+    p = append_str(p, "Samples: ");
+    p += format_uint(p, hi - lo);
+    p = append_str(p, "\r\nTotal: ");
+    p += format_uint(p, total);
+    p = append_str(p, "\r\nTimestamp,Speed,Battery,Temperature,Direction,Moving");
+
+    for (unsigned long i = lo; i < hi && p + 96 < out + size; i++) {
+        int slot = i & HISTORY_MASK;
+        p = append_str(p, "\r\n");
+        p += format_uint(p, ring.timestamp[slot]);
+        p = append_field(p, ring.speed[slot]);
+        p = append_field(p, ring.battery[slot]);
+        p = append_field(p, ring.temperature[slot]);
+        *p++ = ',';
+        p = append_str(p, direction_from_id(ring.direction[slot]));
+        *p++ = ',';
+        *p++ = ring.moving[slot] ? '1' : '0';
+    }
+    *p = '\0';
+    return p - out;
+}
+
+// El rango [lo, hi) en 'buckets' intervalos de igual duración; cada uno con
+// su número de muestras y el mínimo, máximo y media de cada campo numérico.
+// Los límites de cada intervalo se buscan por bisección y los vacíos se omiten.
+static int format_buckets(char* out, int size, unsigned long lo, unsigned long hi,
+                          const HistoryQuery* query) {
+    char* p = out;
+    int64_t start = 0, width = 0;
+    if (lo < hi) {
+        int64_t end = ring.timestamp[(hi - 1) & HISTORY_MASK];
+        start = ring.timestamp[lo & HISTORY_MASK];
+        if (query->from > start) start = query->from;
+        if (query->to < end) end = query->to;
+        width = (end - start + query->buckets) / query->buckets; // Redondeo hacia arriba
+    }
+
+    p = append_str(p, "Buckets: ");
+    p += format_uint(p, query->buckets);
+    p = append_str(p, "\r\nInterval: ");
+    p += format_uint(p, width);
+    p = append_str(p, "\r\nStart,Count,Speed-Min,Speed-Max,Speed-Avg,Battery-Min,Battery-Max,"
+                      "Battery-Avg,Temperature-Min,Temperature-Max,Temperature-Avg");
+
+    unsigned long first = lo;
+    for (int b = 0; b < query->buckets && first < hi && p + 192 < out + size; b++) {
+        int64_t bucket_start = start + b * width;
+        unsigned long last = lower_bound(first, hi, bucket_start + width);
+        if (last == first) continue;
+
+        unsigned long count = last - first;
+        p = append_str(p, "\r\n");
+        p += format_uint(p, bucket_start);
+        *p++ = ',';
+        p += format_uint(p, count);
+        p = append_stats(p, field_stats(ring.speed, first, last), count);
+        p = append_stats(p, field_stats(ring.battery, first, last), count);
+        p = append_stats(p, field_stats(ring.temperature, first, last), count);
+        first = last;
+    }
+    *p = '\0';
+    return p - out;
+}
+
+int history_query(const HistoryQuery* query, char* out, int size) {
+    while (1) {
+        unsigned long head = atomic_load_explicit(&written, memory_order_acquire);
+        unsigned long oldest = head > HISTORY_CAPACITY ? head - HISTORY_CAPACITY : 0;
+
+        unsigned long lo = lower_bound(oldest, head, query->from);
+        unsigned long hi = query->to == INT64_MAX ? head : lower_bound(lo, head, query->to + 1);
+
+        int len = query->buckets ? format_buckets(out, size, lo, hi, query)
+                                 : format_samples(out, size, lo, hi);
+
+        // Válido si el escritor no reclamó ningún slot desde 'oldest'
+        atomic_thread_fence(memory_order_acquire);
+        if (oldest + HISTORY_CAPACITY >= atomic_load_explicit(&claimed, memory_order_relaxed)) {
+            return len;
+        }
+    }
+}
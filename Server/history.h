@@ -0,0 +1,30 @@
+// ============= history.h =============
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "protocol.h"
+#include <stdint.h>
+
+// Muestras que guarda el ring (potencia de 2). Con la simulación cada 10 s
+// son unas 22 horas.
+#define HISTORY_CAPACITY 8192
+// Máximo de muestras en una respuesta sin agregar (las más recientes del rango)
+#define HISTORY_MAX_POINTS 512
+// Máximo de intervalos en una respuesta agregada ("Buckets")
+#define HISTORY_MAX_BUCKETS 512
+// Tamaño máximo del body de una respuesta a GET_HISTORY
+#define HISTORY_REPLY_MAX 65536
+
+// Rango de una consulta: timestamps en ms desde epoch, ambos incluidos
+typedef struct {
+    int64_t from;
+    int64_t to;
+    int buckets;        // 0 = muestras tal cual; N = N intervalos con min/max/media
+} HistoryQuery;
+
+// Un solo escritor (el thread de telemetría)
+void history_append(const VehicleState* state);
+// Lectores sin lock. Deja en 'out' el body de la respuesta y devuelve su longitud.
+int history_query(const HistoryQuery* query, char* out, int size);
+
+#endif // HISTORY_H
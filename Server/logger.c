@@ -1,78 +1,220 @@
 // ============= logger.c =============
+// Logger asíncrono: los threads que loguean formatean la línea en un buffer
+// propio y la encolan sin locks en un ring MPSC (cola acotada de Vyukov con
+// número de secuencia por celda). Un único thread escritor vacía el ring por
+// lotes hacia consola y archivo, con el timestamp cacheado por segundo.
 #include "logger.h"
+#include "metrics.h"
 #include <time.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sched.h>
+
+typedef struct {
+    atomic_size_t seq;
+    time_t timestamp;
+    FILE* stream;           // stdout o stderr
+    int len;
+    char text[LOG_LINE_MAX];
+} LogEntry;
+
+static LogEntry ring[LOG_RING_SIZE];
+static atomic_size_t enqueue_pos = 0;
+static size_t dequeue_pos = 0;          // Solo lo usa el thread escritor
 
 static FILE* log_file_handle = NULL;
-static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static LogPolicy log_policy = LOG_POLICY_DROP;
+static atomic_ulong dropped_count = 0;
 
-// Función unificada de logging
-static void write_log(FILE* stream, const char* format, ...) {
-    pthread_mutex_lock(&log_mutex);
-    
-    time_t now = time(NULL);
-    struct tm* tm_info = localtime(&now);
-    char timestamp[64];
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", tm_info);
-    
-    fprintf(stream, "[%s] ", timestamp);
-    if (log_file_handle && stream != log_file_handle) {
-        fprintf(log_file_handle, "[%s] ", timestamp);
+static pthread_t writer_thread;
+static atomic_int writer_running = 0;
+
+static void format_timestamp(time_t now, char* out, size_t size) {
+    struct tm tm_info;
+    localtime_r(&now, &tm_info);
+    strftime(out, size, "%Y-%m-%d %H:%M:%S", &tm_info);
+}
+
+// Reserva una celda libre del ring. Devuelve NULL si está lleno.
+static LogEntry* ring_claim(size_t* pos_out) {
+    size_t pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+
+    while (1) {
+        LogEntry* entry = &ring[pos & (LOG_RING_SIZE - 1)];
+        size_t seq = atomic_load_explicit(&entry->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                *pos_out = pos;
+                return entry;
+            }
+        } else if (diff < 0) {
+            return NULL; // Lleno: el escritor aún no liberó esta celda
+        } else {
+            pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+        }
     }
-    
+}
+
+// Función unificada de logging (lado productor: sin locks ni I/O)
+static void write_log(FILE* stream, const char* format, ...) {
+    static __thread char line[LOG_LINE_MAX];
+
     va_list args;
     va_start(args, format);
-    vfprintf(stream, format, args);
-    if (log_file_handle && stream != log_file_handle) {
-        va_start(args, format);
-        vfprintf(log_file_handle, format, args);
+    int len = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    if (len < 0) return;
+    if (len >= LOG_LINE_MAX) {
+        // Línea truncada: se conserva el salto de línea final
+        len = LOG_LINE_MAX - 1;
+        line[len - 1] = '\n';
+    }
+
+    size_t pos;
+    LogEntry* entry = ring_claim(&pos);
+    unsigned long wait_start = 0;
+    while (!entry) {
+        if (log_policy == LOG_POLICY_DROP || !atomic_load(&writer_running)) {
+            atomic_fetch_add_explicit(&dropped_count, 1, memory_order_relaxed);
+            return;
+        }
+        if (!wait_start) wait_start = metrics_now_ns();
+        sched_yield(); // LOG_POLICY_BLOCK: esperar a que el escritor libere hueco
+        entry = ring_claim(&pos);
+    }
+    if (wait_start) metrics_lock_wait(METRIC_LOCK_LOG, metrics_now_ns() - wait_start);
+
+    entry->timestamp = time(NULL);
+    entry->stream = stream;
+    entry->len = len;
+    memcpy(entry->text, line, len);
+    atomic_store_explicit(&entry->seq, pos + 1, memory_order_release);
+}
+
+// Saca del ring todo lo publicado y lo escribe por lotes. Devuelve las líneas escritas.
+static int drain_ring() {
+    static time_t cached_second = 0;
+    static char timestamp[64];
+    int written = 0;
+
+    while (1) {
+        LogEntry* entry = &ring[dequeue_pos & (LOG_RING_SIZE - 1)];
+        size_t seq = atomic_load_explicit(&entry->seq, memory_order_acquire);
+        if (seq != dequeue_pos + 1) break; // Vacío (o la celda aún se está llenando)
+
+        if (entry->timestamp != cached_second) {
+            cached_second = entry->timestamp;
+            format_timestamp(cached_second, timestamp, sizeof(timestamp));
+        }
+
+        fprintf(entry->stream, "[%s] %.*s", timestamp, entry->len, entry->text);
+        if (log_file_handle) {
+            fprintf(log_file_handle, "[%s] %.*s", timestamp, entry->len, entry->text);
+        }
+
+        atomic_store_explicit(&entry->seq, dequeue_pos + LOG_RING_SIZE, memory_order_release);
+        dequeue_pos++;
+        written++;
+    }
+
+    if (written > 0) {
+        fflush(stdout);
+        fflush(stderr);
+        if (log_file_handle) fflush(log_file_handle);
+    }
+    return written;
+}
+
+static void report_drops(unsigned long* reported) {
+    unsigned long dropped = atomic_load(&dropped_count);
+    if (dropped == *reported) return;
+
+    char timestamp[64];
+    format_timestamp(time(NULL), timestamp, sizeof(timestamp));
+    fprintf(stderr, "[%s] WARN: %lu mensajes de log descartados (ring lleno)\n",
+            timestamp, dropped - *reported);
+    if (log_file_handle) {
+        fprintf(log_file_handle, "[%s] WARN: %lu mensajes de log descartados (ring lleno)\n",
+                timestamp, dropped - *reported);
         fflush(log_file_handle);
     }
-    va_end(args);
-    
-    fflush(stream);
-    pthread_mutex_unlock(&log_mutex);
+    *reported = dropped;
+}
+
+static void* log_writer(void* arg) {
+    (void)arg;
+    unsigned long reported = 0;
+    struct timespec idle = { 0, LOG_IDLE_SLEEP_NS };
+
+    while (atomic_load(&writer_running)) {
+        if (drain_ring() == 0) {
+            report_drops(&reported);
+            nanosleep(&idle, NULL);
+        }
+    }
+
+    // Vaciado final: lo que se encoló antes de logger_close()
+    drain_ring();
+    report_drops(&reported);
+    return NULL;
+}
+
+void logger_set_policy(LogPolicy policy) {
+    log_policy = policy;
+}
+
+unsigned long logger_dropped() {
+    return atomic_load(&dropped_count);
 }
 
 void logger_init(const char* log_file) {
-    pthread_mutex_lock(&log_mutex);
-    
+    for (size_t i = 0; i < LOG_RING_SIZE; i++) {
+        atomic_init(&ring[i].seq, i);
+    }
+
     log_file_handle = fopen(log_file, "a");
     if (log_file_handle == NULL) {
         fprintf(stderr, "ERROR: No se pudo abrir el archivo de log: %s\n", log_file);
-        pthread_mutex_unlock(&log_mutex);
-        return;
     }
-    
+
     // Log de inicio
-    time_t now = time(NULL);
-    struct tm* tm_info = localtime(&now);
     char timestamp[64];
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", tm_info);
-    
-    fprintf(log_file_handle, "\n========== SERVER STARTED [%s] ==========\n", timestamp);
+    format_timestamp(time(NULL), timestamp, sizeof(timestamp));
+
+    if (log_file_handle) {
+        fprintf(log_file_handle, "\n========== SERVER STARTED [%s] ==========\n", timestamp);
+        fflush(log_file_handle);
+    }
     fprintf(stdout, "\n========== SERVER STARTED [%s] ==========\n", timestamp);
-    fflush(log_file_handle);
-    
-    pthread_mutex_unlock(&log_mutex);
+
+    atomic_store(&writer_running, 1);
+    if (pthread_create(&writer_thread, NULL, log_writer, NULL) != 0) {
+        atomic_store(&writer_running, 0);
+        fprintf(stderr, "ERROR: No se pudo crear el thread del logger\n");
+    }
 }
 
 void logger_close() {
-    pthread_mutex_lock(&log_mutex);
-    
+    // Detener el escritor tras vaciar el ring
+    if (atomic_exchange(&writer_running, 0)) {
+        pthread_join(writer_thread, NULL);
+    }
+
     if (log_file_handle != NULL) {
-        time_t now = time(NULL);
-        struct tm* tm_info = localtime(&now);
         char timestamp[64];
-        strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", tm_info);
-        
+        format_timestamp(time(NULL), timestamp, sizeof(timestamp));
+
         fprintf(log_file_handle, "========== SERVER STOPPED [%s] ==========\n\n", timestamp);
         fclose(log_file_handle);
         log_file_handle = NULL;
     }
-    
-    pthread_mutex_unlock(&log_mutex);
 }
 
 void log_message(const char* client_ip, int client_port, const char* msg_type, const char* content) {
@@ -85,4 +227,4 @@ void log_error(const char* error_msg) {
 
 void log_info(const char* info_msg) {
     write_log(stdout, "INFO: %s\n", info_msg);
-}
\ No newline at end of file
+}
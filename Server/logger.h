@@ -5,10 +5,24 @@
 #include <stdio.h>
 #include <pthread.h>
 
+// Ring de líneas pendientes (potencia de 2) y tamaño máximo de una línea
+#define LOG_RING_SIZE 4096
+#define LOG_LINE_MAX 512
+// Pausa del thread escritor cuando el ring está vacío
+#define LOG_IDLE_SLEEP_NS (2 * 1000 * 1000)
+
+// Qué hacer cuando el ring está lleno
+typedef enum {
+    LOG_POLICY_DROP,    // Descartar la línea y contarla (por defecto)
+    LOG_POLICY_BLOCK    // Esperar a que el escritor libere espacio
+} LogPolicy;
+
 void logger_init(const char* log_file);
 void logger_close();
+void logger_set_policy(LogPolicy policy);
+unsigned long logger_dropped();
 void log_message(const char* client_ip, int client_port, const char* msg_type, const char* content);
 void log_error(const char* error_msg);
 void log_info(const char* info_msg);
 
-#endif // LOGGER_H
\ No newline at end of file
+#endif // LOGGER_H
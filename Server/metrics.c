@@ -0,0 +1,426 @@
+// ============= metrics.c =============
+// Métricas internas del servidor: contadores e histogramas de latencia.
+//
+// Cada thread que registra algo tiene su propio shard (reservado en su primer
+// uso y enlazado en una lista global), así que los caminos calientes solo
+// hacen cargas y stores relajados sobre memoria propia: ni locks ni
+// operaciones atómicas de lectura-modificación-escritura compartidas. Al
+// terminar un thread (modo threads) su shard se suma a los totales retirados.
+// El informe recorre todos los shards; lo que lea puede ir un incremento
+// por detrás, nunca más.
+#include "metrics.h"
+#include "logger.h"
+#include "recorder.h"
+#include "registry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+typedef struct {
+    atomic_uint buckets[METRICS_BUCKETS];
+    atomic_ulong count;
+    atomic_ulong sum;
+    atomic_ulong max;
+} Histogram;
+
+typedef struct MetricsShard {
+    atomic_ulong counters[METRIC_COUNTER_COUNT];
+    atomic_ulong requests[METRICS_MSG_TYPES];
+    atomic_ulong errors[METRICS_MSG_TYPES];
+    atomic_ulong lock_acquired[METRIC_LOCK_COUNT];
+    atomic_ulong lock_contended[METRIC_LOCK_COUNT];
+    Histogram hists[METRIC_HIST_COUNT];
+    struct MetricsShard* next;
+} MetricsShard;
+
+// Suma de todos los shards para el informe
+typedef struct {
+    unsigned long counters[METRIC_COUNTER_COUNT];
+    unsigned long requests[METRICS_MSG_TYPES];
+    unsigned long errors[METRICS_MSG_TYPES];
+    unsigned long lock_acquired[METRIC_LOCK_COUNT];
+    unsigned long lock_contended[METRIC_LOCK_COUNT];
+    unsigned long buckets[METRIC_HIST_COUNT][METRICS_BUCKETS];
+    unsigned long count[METRIC_HIST_COUNT];
+    unsigned long sum[METRIC_HIST_COUNT];
+    unsigned long max[METRIC_HIST_COUNT];
+} MetricsTotals;
+
+static pthread_mutex_t shards_mutex = PTHREAD_MUTEX_INITIALIZER;
+static MetricsShard* shards = NULL;     // Shards de los threads vivos
+static MetricsShard retired;            // Totales de los threads que terminaron
+static pthread_key_t shard_key;
+static __thread MetricsShard* local = NULL;
+static pthread_once_t shard_once = PTHREAD_ONCE_INIT;
+static time_t start_time;
+
+static const char* lock_names[METRIC_LOCK_COUNT] = { "clients", "vehicle", "log", "tokens" };
+
+// Incremento de un solo escritor: no necesita RMW atómico
+static inline void bump(atomic_ulong* counter, unsigned long value) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value,
+                          memory_order_relaxed);
+}
+
+static inline unsigned long load(const atomic_ulong* counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+// Suma 'src' a 'dst'. Requiere shards_mutex (dst es 'retired').
+static void merge_shard(MetricsShard* dst, MetricsShard* src) {
+    for (int i = 0; i < METRIC_COUNTER_COUNT; i++) bump(&dst->counters[i], load(&src->counters[i]));
+    for (int i = 0; i < METRICS_MSG_TYPES; i++) {
+        bump(&dst->requests[i], load(&src->requests[i]));
+        bump(&dst->errors[i], load(&src->errors[i]));
+    }
+    for (int i = 0; i < METRIC_LOCK_COUNT; i++) {
+        bump(&dst->lock_acquired[i], load(&src->lock_acquired[i]));
+        bump(&dst->lock_contended[i], load(&src->lock_contended[i]));
+    }
+    for (int h = 0; h < METRIC_HIST_COUNT; h++) {
+        Histogram* d = &dst->hists[h];
+        Histogram* s = &src->hists[h];
+        for (int b = 0; b < METRICS_BUCKETS; b++) {
+            unsigned int n = atomic_load_explicit(&s->buckets[b], memory_order_relaxed);
+            if (n) atomic_fetch_add_explicit(&d->buckets[b], n, memory_order_relaxed);
+        }
+        bump(&d->count, load(&s->count));
+        bump(&d->sum, load(&s->sum));
+        if (load(&s->max) > load(&d->max)) atomic_store(&d->max, load(&s->max));
+    }
+}
+
+// Destructor de la clave: el thread termina y su shard pasa a los retirados
+static void retire_shard(void* arg) {
+    MetricsShard* shard = arg;
+
+    pthread_mutex_lock(&shards_mutex);
+    MetricsShard** link = &shards;
+    while (*link && *link != shard) link = &(*link)->next;
+    if (*link) *link = shard->next;
+    merge_shard(&retired, shard);
+    pthread_mutex_unlock(&shards_mutex);
+
+    local = NULL; // Si otro destructor registra algo, tendrá un shard nuevo
+    free(shard);
+}
+
+static void create_shard_key() {
+    pthread_key_create(&shard_key, retire_shard);
+}
+
+// Shard del thread actual (NULL si no hay memoria: la métrica se pierde)
+static MetricsShard* local_shard() {
+    if (local) return local;
+
+    pthread_once(&shard_once, create_shard_key);
+    MetricsShard* shard = calloc(1, sizeof(MetricsShard));
+    if (!shard) return NULL;
+
+    pthread_mutex_lock(&shards_mutex);
+    shard->next = shards;
+    shards = shard;
+    pthread_mutex_unlock(&shards_mutex);
+
+    pthread_setspecific(shard_key, shard);
+    local = shard;
+    return shard;
+}
+
+void metrics_init() {
+    start_time = time(NULL);
+    pthread_once(&shard_once, create_shard_key);
+}
+
+unsigned long metrics_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+// ---- Histogramas ----
+
+// Valores menores que 2^SUB_BITS tienen bucket propio; a partir de ahí, cada
+// potencia de 2 se reparte en 2^SUB_BITS buckets del mismo ancho
+static int bucket_index(unsigned long value) {
+    if (value >= 1UL << (METRICS_MAX_EXP + 1)) value = (1UL << (METRICS_MAX_EXP + 1)) - 1;
+    if (value < 1UL << METRICS_SUB_BITS) return (int)value;
+
+    int exp = 63 - __builtin_clzl(value);
+    int shift = exp - METRICS_SUB_BITS;
+    int sub = (value >> shift) & ((1 << METRICS_SUB_BITS) - 1);
+    return ((shift + 1) << METRICS_SUB_BITS) + sub;
+}
+
+// Mayor valor que cae en el bucket
+static unsigned long bucket_upper(int index) {
+    if (index < 1 << METRICS_SUB_BITS) return index;
+
+    int shift = (index >> METRICS_SUB_BITS) - 1;
+    unsigned long sub = index & ((1 << METRICS_SUB_BITS) - 1);
+    unsigned long low = ((1UL << METRICS_SUB_BITS) + sub) << shift;
+    return low + (1UL << shift) - 1;
+}
+
+static void histogram_record(Histogram* hist, unsigned long value) {
+    atomic_uint* bucket = &hist->buckets[bucket_index(value)];
+    atomic_store_explicit(bucket, atomic_load_explicit(bucket, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    bump(&hist->count, 1);
+    bump(&hist->sum, value);
+    if (value > load(&hist->max)) atomic_store_explicit(&hist->max, value, memory_order_relaxed);
+}
+
+// ---- Escritores ----
+
+void metrics_add(MetricCounter counter, unsigned long value) {
+    MetricsShard* shard = local_shard();
+    if (shard) bump(&shard->counters[counter], value);
+}
+
+void metrics_request(MessageType type, int error) {
+    MetricsShard* shard = local_shard();
+    if (!shard || (unsigned int)type >= METRICS_MSG_TYPES) return;
+
+    bump(&shard->requests[type], 1);
+    if (error) bump(&shard->errors[type], 1);
+}
+
+void metrics_record(MetricHistogram hist, unsigned long ns) {
+    MetricsShard* shard = local_shard();
+    if (shard) histogram_record(&shard->hists[hist], ns);
+}
+
+// Sin contención el coste es un trylock; solo se toma la hora cuando hay que esperar
+void metrics_lock(pthread_mutex_t* mutex, MetricLock lock) {
+    MetricsShard* shard = local_shard();
+
+    if (pthread_mutex_trylock(mutex) == 0) {
+        if (shard) bump(&shard->lock_acquired[lock], 1);
+        return;
+    }
+
+    unsigned long start = metrics_now_ns();
+    pthread_mutex_lock(mutex);
+    if (shard) {
+        bump(&shard->lock_acquired[lock], 1);
+        bump(&shard->lock_contended[lock], 1);
+        histogram_record(&shard->hists[METRIC_HIST_LOCK_WAIT + lock], metrics_now_ns() - start);
+    }
+}
+
+void metrics_lock_wait(MetricLock lock, unsigned long ns) {
+    MetricsShard* shard = local_shard();
+    if (!shard) return;
+
+    bump(&shard->lock_acquired[lock], 1);
+    bump(&shard->lock_contended[lock], 1);
+    histogram_record(&shard->hists[METRIC_HIST_LOCK_WAIT + lock], ns);
+}
+
+// ---- Informe ----
+
+static void add_shard(MetricsTotals* totals, MetricsShard* shard) {
+    for (int i = 0; i < METRIC_COUNTER_COUNT; i++) totals->counters[i] += load(&shard->counters[i]);
+    for (int i = 0; i < METRICS_MSG_TYPES; i++) {
+        totals->requests[i] += load(&shard->requests[i]);
+        totals->errors[i] += load(&shard->errors[i]);
+    }
+    for (int i = 0; i < METRIC_LOCK_COUNT; i++) {
+        totals->lock_acquired[i] += load(&shard->lock_acquired[i]);
+        totals->lock_contended[i] += load(&shard->lock_contended[i]);
+    }
+    for (int h = 0; h < METRIC_HIST_COUNT; h++) {
+        Histogram* hist = &shard->hists[h];
+        for (int b = 0; b < METRICS_BUCKETS; b++) {
+            totals->buckets[h][b] += atomic_load_explicit(&hist->buckets[b], memory_order_relaxed);
+        }
+        totals->count[h] += load(&hist->count);
+        totals->sum[h] += load(&hist->sum);
+        if (load(&hist->max) > totals->max[h]) totals->max[h] = load(&hist->max);
+    }
+}
+
+// Cuantil del histograma (cota superior del bucket, nunca mayor que el máximo)
+static unsigned long quantile(const MetricsTotals* totals, int hist, double q) {
+    unsigned long total = 0;
+    for (int b = 0; b < METRICS_BUCKETS; b++) total += totals->buckets[hist][b];
+    if (total == 0) return 0;
+
+    unsigned long rank = (unsigned long)(q * total);
+    if (rank >= total) rank = total - 1;
+
+    unsigned long seen = 0;
+    for (int b = 0; b < METRICS_BUCKETS; b++) {
+        seen += totals->buckets[hist][b];
+        if (seen > rank) {
+            unsigned long upper = bucket_upper(b);
+            return upper < totals->max[hist] ? upper : totals->max[hist];
+        }
+    }
+    return totals->max[hist];
+}
+
+typedef struct {
+    char* out;
+    int size;
+    int len;
+} Report;
+
+static void emit(Report* report, const char* format, ...) {
+    if (report->len >= report->size - 1) return;
+
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(report->out + report->len, report->size - report->len, format, args);
+    va_end(args);
+
+    if (n > 0) report->len += n;
+    if (report->len >= report->size) report->len = report->size - 1; // Truncado
+}
+
+// Histograma como "summary" de Prometheus, en segundos
+static void emit_summary(Report* report, const MetricsTotals* totals, int hist,
+                         const char* name, const char* labels) {
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    const char* sep = labels[0] ? "," : "";
+
+    for (size_t i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); i++) {
+        emit(report, "%s{%s%squantile=\"%g\"} %.9f\n", name, labels, sep, quantiles[i],
+             quantile(totals, hist, quantiles[i]) / 1e9);
+    }
+    emit(report, "%s_max%s%s%s %.9f\n", name, labels[0] ? "{" : "", labels, labels[0] ? "}" : "",
+         totals->max[hist] / 1e9);
+    emit(report, "%s_sum%s%s%s %.9f\n", name, labels[0] ? "{" : "", labels, labels[0] ? "}" : "",
+         totals->sum[hist] / 1e9);
+    emit(report, "%s_count%s%s%s %lu\n", name, labels[0] ? "{" : "", labels, labels[0] ? "}" : "",
+         totals->count[hist]);
+}
+
+int metrics_render(char* out, int size) {
+    MetricsTotals* totals = calloc(1, sizeof(MetricsTotals));
+    if (!totals) return snprintf(out, size, "# Sin memoria para el informe\n");
+
+    pthread_mutex_lock(&shards_mutex);
+    add_shard(totals, &retired);
+    for (MetricsShard* shard = shards; shard; shard = shard->next) {
+        add_shard(totals, shard);
+    }
+    pthread_mutex_unlock(&shards_mutex);
+
+    Report report = { out, size, 0 };
+    out[0] = '\0';
+
+    emit(&report, "vatp_uptime_seconds %ld\n", (long)(time(NULL) - start_time));
+    emit(&report, "vatp_clients %d\n", registry_count());
+
+    for (int i = 0; i < METRICS_MSG_TYPES; i++) {
+        if (!is_client_message_type(i)) continue;
+        const char* name = message_type_to_string(i);
+        if (strcmp(name, "UNKNOWN") == 0) continue;
+        emit(&report, "vatp_requests_total{type=\"%s\"} %lu\n", name, totals->requests[i]);
+        emit(&report, "vatp_errors_total{type=\"%s\"} %lu\n", name, totals->errors[i]);
+    }
+    emit(&report, "vatp_invalid_messages_total %lu\n", totals->counters[METRIC_INVALID_MESSAGES]);
+    emit_summary(&report, totals, METRIC_HIST_SERVICE, "vatp_service_seconds", "");
+
+    emit(&report, "vatp_bytes_in_total %lu\n", totals->counters[METRIC_BYTES_IN]);
+    emit(&report, "vatp_bytes_out_total %lu\n", totals->counters[METRIC_BYTES_OUT]);
+
+    emit(&report, "vatp_broadcast_ticks_total %lu\n", totals->counters[METRIC_BROADCAST_TICKS]);
+    emit(&report, "vatp_broadcast_sends_total %lu\n", totals->counters[METRIC_BROADCAST_SENDS]);
+    emit(&report, "vatp_broadcast_failures_total %lu\n", totals->counters[METRIC_BROADCAST_FAILURES]);
+    emit(&report, "vatp_broadcast_coalesced_total %lu\n", totals->counters[METRIC_BROADCAST_COALESCED]);
+    emit_summary(&report, totals, METRIC_HIST_FANOUT, "vatp_broadcast_fanout_seconds", "");
+    emit_summary(&report, totals, METRIC_HIST_SIMULATION, "vatp_simulation_step_seconds", "");
+    emit(&report, "vatp_multicast_datagrams_total %lu\n", totals->counters[METRIC_MULTICAST_DATAGRAMS]);
+    emit(&report, "vatp_multicast_failures_total %lu\n", totals->counters[METRIC_MULTICAST_FAILURES]);
+    emit(&report, "vatp_actor_messages_total %lu\n", totals->counters[METRIC_ACTOR_MESSAGES]);
+    emit(&report, "vatp_actor_batches_total %lu\n", totals->counters[METRIC_ACTOR_BATCHES]);
+
+    for (int i = 0; i < METRIC_LOCK_COUNT; i++) {
+        char labels[32];
+        snprintf(labels, sizeof(labels), "lock=\"%s\"", lock_names[i]);
+        emit(&report, "vatp_lock_acquisitions_total{%s} %lu\n", labels, totals->lock_acquired[i]);
+        emit(&report, "vatp_lock_contended_total{%s} %lu\n", labels, totals->lock_contended[i]);
+        emit_summary(&report, totals, METRIC_HIST_LOCK_WAIT + i, "vatp_lock_wait_seconds", labels);
+    }
+    emit(&report, "vatp_log_dropped_total %lu\n", logger_dropped());
+    emit(&report, "vatp_recorder_dropped_total %lu\n", recorder_dropped());
+
+    free(totals);
+    return report.len;
+}
+
+// ---- Endpoint de scrape ----
+
+// Atiende las conexiones de una en una: lee la petición (sea cual sea),
+// responde con el informe y cierra
+static void* metrics_http_thread(void* arg) {
+    int listen_fd = (int)(long)arg;
+    static char body[METRICS_REPORT_MAX];
+
+    while (1) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            usleep(10000); // Sin descriptores o interrumpido: reintentar sin girar en vacío
+            continue;
+        }
+
+        struct timeval timeout = { 1, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        char request[1024];
+        if (recv(fd, request, sizeof(request), 0) < 0) {
+            close(fd);
+            continue;
+        }
+
+        int len = metrics_render(body, sizeof(body));
+        char header[160];
+        int header_len = snprintf(header, sizeof(header),
+                                  "HTTP/1.0 200 OK\r\n"
+                                  "Content-Type: text/plain; version=0.0.4\r\n"
+                                  "Content-Length: %d\r\n"
+                                  "Connection: close\r\n\r\n", len);
+        send(fd, header, header_len, MSG_NOSIGNAL);
+        send(fd, body, len, MSG_NOSIGNAL);
+        close(fd);
+    }
+    return NULL;
+}
+
+int metrics_start_http(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    // Solo local: las métricas no se exponen fuera de la máquina
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+
+    pthread_t thread;
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0 ||
+        pthread_create(&thread, NULL, metrics_http_thread, (void*)(long)fd) != 0) {
+        close(fd);
+        return -1;
+    }
+    pthread_detach(thread);
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "Métricas disponibles en http://127.0.0.1:%d/metrics", port);
+    log_info(msg);
+    return 0;
+}
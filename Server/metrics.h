@@ -0,0 +1,68 @@
+// ============= metrics.h =============
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "protocol.h"
+#include <pthread.h>
+
+// Histogramas log-lineales (estilo HDR) en nanosegundos: cada potencia de 2
+// se divide en 2^METRICS_SUB_BITS sub-buckets (error relativo < 12.5%)
+#define METRICS_SUB_BITS 3
+#define METRICS_MAX_EXP 40          // ~18 minutos; lo mayor cae en el último bucket
+#define METRICS_BUCKETS ((METRICS_MAX_EXP - METRICS_SUB_BITS + 2) << METRICS_SUB_BITS)
+// Tipos de mensaje con contador propio (los IDs de VATP/2.0)
+#define METRICS_MSG_TYPES 16
+// Tamaño máximo del informe de texto (STATS y endpoint de scrape)
+#define METRICS_REPORT_MAX 8192
+
+typedef enum {
+    METRIC_BYTES_IN,             // Bytes recibidos de los clientes
+    METRIC_BYTES_OUT,            // Bytes enviados (respuestas y telemetría)
+    METRIC_BROADCAST_TICKS,      // Ticks de telemetría repartidos
+    METRIC_BROADCAST_SENDS,      // Frames de telemetría entregados o encolados
+    METRIC_BROADCAST_FAILURES,   // Frames que no llegaron a un cliente que se desconecta
+    METRIC_BROADCAST_COALESCED,  // Frames omitidos o reemplazados por uno más nuevo (coalesce)
+    METRIC_INVALID_MESSAGES,     // Mensajes mal formados (sin tipo válido)
+    METRIC_MULTICAST_DATAGRAMS,  // Datagramas del canal UDP enviados (por destino)
+    METRIC_MULTICAST_FAILURES,   // Datagramas del canal UDP descartados
+    METRIC_ACTOR_MESSAGES,       // Mensajes aplicados por el actor de vehículos
+    METRIC_ACTOR_BATCHES,        // Despertares del actor con mensajes (lotes)
+    METRIC_COUNTER_COUNT
+} MetricCounter;
+
+// Locks instrumentados (ver metrics_lock)
+typedef enum {
+    METRIC_LOCK_CLIENTS,         // Mutex de los shards del registro de clientes
+    METRIC_LOCK_VEHICLE,         // Espera por hueco en la cola del actor de vehículos
+    METRIC_LOCK_LOG,             // Espera por hueco en el ring del logger (política block)
+    METRIC_LOCK_TOKENS,          // Mutex de los shards de tokens
+    METRIC_LOCK_COUNT
+} MetricLock;
+
+typedef enum {
+    METRIC_HIST_SERVICE,         // process_client_message, por mensaje
+    METRIC_HIST_FANOUT,          // Reparto de un tick de telemetría (por shard en epoll)
+    METRIC_HIST_SIMULATION,      // Un paso de la simulación física de toda la flota
+    METRIC_HIST_LOCK_WAIT,       // Primero de METRIC_LOCK_COUNT: espera por lock contendido
+    METRIC_HIST_COUNT = METRIC_HIST_LOCK_WAIT + METRIC_LOCK_COUNT
+} MetricHistogram;
+
+void metrics_init();
+unsigned long metrics_now_ns();
+
+// Escritores: cada thread escribe en su propio shard, sin locks ni RMW atómicos
+void metrics_add(MetricCounter counter, unsigned long value);
+void metrics_request(MessageType type, int error);
+void metrics_record(MetricHistogram hist, unsigned long ns);
+
+// Toma 'mutex' contando la adquisición; si estaba ocupado, mide la espera
+void metrics_lock(pthread_mutex_t* mutex, MetricLock lock);
+// Para esperas que no son un mutex: anota una espera de 'ns' en 'lock'
+void metrics_lock_wait(MetricLock lock, unsigned long ns);
+
+// Informe de texto (formato de exposición de Prometheus). Devuelve su longitud.
+int metrics_render(char* out, int size);
+// Endpoint HTTP de solo lectura en 127.0.0.1:port. Devuelve -1 si falla.
+int metrics_start_http(int port);
+
+#endif // METRICS_H
@@ -0,0 +1,201 @@
+// ============= multicast.c =============
+// Canal UDP de telemetría para observers. Un solo escritor (el thread de
+// telemetría): en cada tick del canal recorre la flota, codifica en binario
+// los vehículos cuya versión cambió desde el tick anterior y los agrupa en
+// datagramas de hasta MULTICAST_DATAGRAM_MAX bytes. Cada datagrama sale una
+// vez por destino: con un grupo multicast el coste no depende del número de
+// observers.
+#include "multicast.h"
+#include "protocol.h"
+#include "telemetry.h"
+#include "scheduler.h"
+#include "metrics.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static int channel_socket = -1;
+static int channel_bucket = -1;
+static struct sockaddr_in destinations[MULTICAST_MAX_TARGETS];
+static int destination_count = 0;
+static char announced[256];
+
+static unsigned long sequence = 0;      // Secuencia del siguiente datagrama
+static unsigned long* published = NULL; // Versión publicada de cada vehículo
+
+// "A.B.C.D:PUERTO". Devuelve 0 si no es válido.
+static int parse_target(const char* text, struct sockaddr_in* addr) {
+    char host[64];
+    const char* colon = strrchr(text, ':');
+    if (!colon || colon == text || colon - text >= (int)sizeof(host)) return 0;
+
+    memcpy(host, text, colon - text);
+    host[colon - text] = '\0';
+
+    char* end;
+    long port = strtol(colon + 1, &end, 10);
+    if (*end != '\0' || port <= 0 || port > 65535) return 0;
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons((uint16_t)port);
+    return inet_pton(AF_INET, host, &addr->sin_addr) == 1;
+}
+
+static int parse_targets(const char* targets) {
+    char list[256];
+    if (strlen(targets) >= sizeof(list)) return 0;
+    strcpy(list, targets);
+
+    destination_count = 0;
+    char* save;
+    for (char* item = strtok_r(list, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        if (destination_count == MULTICAST_MAX_TARGETS ||
+            !parse_target(item, &destinations[destination_count])) {
+            return 0;
+        }
+        destination_count++;
+    }
+    return destination_count > 0;
+}
+
+static int configure_multicast(const char* interface, int ttl) {
+    unsigned char ttl_byte = (unsigned char)ttl;
+    unsigned char loop = 1; // Observers en la misma máquina (loopback)
+    if (setsockopt(channel_socket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl_byte, sizeof(ttl_byte)) < 0 ||
+        setsockopt(channel_socket, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0) {
+        return 0;
+    }
+
+    if (interface) {
+        struct in_addr iface;
+        if (inet_pton(AF_INET, interface, &iface) != 1 ||
+            setsockopt(channel_socket, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof(iface)) < 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int multicast_start(const char* targets, const char* interface, int ttl, double rate_hz) {
+    if (!parse_targets(targets) || ttl < 0 || ttl > 255) return -1;
+
+    channel_socket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (channel_socket < 0) return -1;
+
+    int has_group = 0;
+    for (int i = 0; i < destination_count; i++) {
+        if (IN_MULTICAST(ntohl(destinations[i].sin_addr.s_addr))) has_group = 1;
+    }
+    if (has_group && !configure_multicast(interface, ttl)) {
+        close(channel_socket);
+        channel_socket = -1;
+        return -1;
+    }
+
+    int count = telemetry_vehicle_count();
+    published = malloc(count * sizeof(unsigned long));
+    if (!published) {
+        close(channel_socket);
+        channel_socket = -1;
+        return -1;
+    }
+    // El primer tick publica toda la flota
+    for (int i = 0; i < count; i++) published[i] = ULONG_MAX;
+
+    snprintf(announced, sizeof(announced), "%s", targets);
+    channel_bucket = scheduler_subscribe(rate_hz);
+
+    char log_msg[384];
+    snprintf(log_msg, sizeof(log_msg), "Canal de telemetría UDP hacia %s (cada %d ms)",
+             announced, scheduler_period_ms(channel_bucket));
+    log_info(log_msg);
+    return 0;
+}
+
+// Solo cierra el socket: el thread de telemetría puede estar publicando
+void multicast_close() {
+    int fd = channel_socket;
+    channel_socket = -1;
+    if (fd >= 0) close(fd);
+}
+
+int multicast_enabled() {
+    return channel_socket >= 0;
+}
+
+int multicast_bucket() {
+    return channel_bucket;
+}
+
+const char* multicast_targets() {
+    return announced;
+}
+
+static void put_u32(char* p, uint32_t value) {
+    p[0] = value & 0xFF;
+    p[1] = (value >> 8) & 0xFF;
+    p[2] = (value >> 16) & 0xFF;
+    p[3] = (value >> 24) & 0xFF;
+}
+
+// Completa la cabecera y envía el datagrama a cada destino. La secuencia
+// avanza aunque falle el envío: el observer ve el hueco y lo recupera.
+static void send_datagram(char* datagram, int len, uint32_t frames) {
+    put_u32(datagram, (uint32_t)sequence);
+    put_u32(datagram + 4, (uint32_t)(sequence >> 32));
+    put_u32(datagram + 8, frames);
+    put_u32(datagram + 12, 0);
+    sequence++;
+
+    for (int i = 0; i < destination_count; i++) {
+        // Nunca bloquea el thread de telemetría: con el buffer lleno se descarta
+        if (sendto(channel_socket, datagram, len, MSG_DONTWAIT,
+                   (struct sockaddr*)&destinations[i], sizeof(destinations[i])) == len) {
+            metrics_add(METRIC_MULTICAST_DATAGRAMS, 1);
+            metrics_add(METRIC_BYTES_OUT, len);
+        } else {
+            metrics_add(METRIC_MULTICAST_FAILURES, 1);
+        }
+    }
+}
+
+void multicast_publish() {
+    if (channel_socket < 0) return;
+
+    char datagram[MULTICAST_DATAGRAM_MAX];
+    char record[BUFFER_SIZE];
+    int len = MULTICAST_HEADER_SIZE;
+    uint32_t frames = 0;
+    unsigned long first = sequence;
+
+    int count = telemetry_vehicle_count();
+    for (int v = 0; v < count; v++) {
+        if (telemetry_version(v) == published[v]) continue;
+
+        VehicleState state;
+        published[v] = telemetry_snapshot(v, &state);
+        int record_len = encode_telemetry(record, ENCODING_BINARY,
+                                          count > 1 ? v : VEHICLE_NO_ID, &state);
+
+        if (len + record_len > MULTICAST_DATAGRAM_MAX) {
+            send_datagram(datagram, len, frames);
+            len = MULTICAST_HEADER_SIZE;
+            frames = 0;
+        }
+        memcpy(datagram + len, record, record_len);
+        len += record_len;
+        frames++;
+    }
+
+    // Un tick sin cambios publica igualmente un datagrama vacío (latido)
+    if (frames > 0 || sequence == first) {
+        send_datagram(datagram, len, frames);
+    }
+}
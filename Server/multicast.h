@@ -0,0 +1,38 @@
+// ============= multicast.h =============
+#ifndef MULTICAST_H
+#define MULTICAST_H
+
+// Canal UDP de solo lectura para observers: cada tick del canal se publica
+// una vez, sea cual sea el número de observers. Cada datagrama lleva una
+// cabecera de 16 bytes (little-endian):
+//   [0..7] secuencia (u64, +1 por datagrama)  [8..11] número de frames (u32)
+//   [12..15] reservado (0)
+// seguida de esos frames TELEMETRY_DATA de VATP/2.0 (cabecera de 8 bytes
+// incluida), uno por vehículo cambiado desde el tick anterior. Un tick sin
+// cambios publica un datagrama sin frames (latido). Un salto en la
+// secuencia se recupera con GET_TELEMETRY por TCP.
+#define MULTICAST_HEADER_SIZE 16
+// Datagrama máximo sin fragmentar en Ethernet (MTU 1500 - IP - UDP)
+#define MULTICAST_DATAGRAM_MAX 1472
+// Destinos de una lista unicast ("--multicast 10.0.0.5:7000,10.0.0.6:7000")
+#define MULTICAST_MAX_TARGETS 8
+// TTL por defecto de los datagramas multicast (1 = no sale de la red local)
+#define MULTICAST_DEFAULT_TTL 1
+
+// Abre el canal hacia 'targets' ("GRUPO:PUERTO" o una lista separada por
+// comas de destinos unicast) a 'rate_hz'. 'interface' es la IPv4 de la
+// interfaz de salida del multicast (NULL = la de la ruta por defecto).
+// Devuelve -1 si la configuración no es válida o falla el socket.
+int multicast_start(const char* targets, const char* interface, int ttl, double rate_hz);
+void multicast_close();
+// 1 si el canal está abierto
+int multicast_enabled();
+// Bucket del scheduler del canal (-1 si no está abierto)
+int multicast_bucket();
+// Destinos tal como se anuncian en la respuesta a CONNECT
+const char* multicast_targets();
+// Publica los vehículos cambiados (lo llama el thread de telemetría cuando
+// vence el bucket del canal)
+void multicast_publish();
+
+#endif // MULTICAST_H
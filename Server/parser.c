@@ -0,0 +1,367 @@
+// ============= parser.c =============
+// Parser incremental de VATP sobre el flujo TCP.
+//
+// recv() escribe directamente en el buffer del parser y los mensajes se
+// parsean en sitio: headers y body son vistas (puntero + longitud), sin
+// copias ni strtok. Se despachan todos los mensajes completos de cada lectura
+// (pipelining) y el body se delimita con el campo LONGITUD de la primera línea.
+// Solo se mueven bytes cuando queda un mensaje a medias al final del buffer y
+// hace falta espacio para seguir recibiendo.
+//
+// Tras negociar VATP/2.0 el mismo buffer se interpreta como tramas binarias
+// y el payload se traduce a los mismos headers que usa el modo texto, así el
+// despacho de mensajes no depende de la codificación.
+#include "parser.h"
+#include <string.h>
+#include <stdint.h>
+
+void parser_init(StreamParser* parser) {
+    parser->start = 0;
+    parser->line_start = 0;
+    parser->scan = 0;
+    parser->end = 0;
+    parser->state = PARSE_START_LINE;
+    parser->encoding = ENCODING_TEXT;
+}
+
+// Cambia la codificación de los mensajes siguientes (tras CONNECT)
+void parser_set_encoding(StreamParser* parser, ProtocolEncoding encoding) {
+    parser->encoding = encoding;
+}
+
+// Devuelve dónde escribir los próximos bytes recibidos. Si el espacio libre al
+// final se agotó, mueve el mensaje a medias al principio del buffer.
+char* parser_write_ptr(StreamParser* parser, int* space) {
+    if (parser->start > 0 && parser->end == (int)sizeof(parser->data)) {
+        int shift = parser->start;
+        memmove(parser->data, parser->data + shift, parser->end - shift);
+        parser->start = 0;
+        parser->line_start -= shift;
+        parser->scan -= shift;
+        parser->end -= shift;
+    } else if (parser->start == parser->end) {
+        // Todo consumido: volver al principio sin mover nada
+        parser->start = parser->line_start = parser->scan = parser->end = 0;
+    }
+
+    *space = sizeof(parser->data) - parser->end;
+    return parser->data + parser->end;
+}
+
+void parser_commit(StreamParser* parser, int bytes) {
+    parser->end += bytes;
+}
+
+// Busca la siguiente línea completa (sin "\r\n" ni "\n"). Devuelve 0 si falta el fin de línea.
+static int next_line(StreamParser* parser, int* line_off, int* line_len) {
+    char* nl = memchr(parser->data + parser->scan, '\n', parser->end - parser->scan);
+    if (!nl) {
+        parser->scan = parser->end;
+        return 0;
+    }
+
+    int nl_pos = nl - parser->data;
+    int len = nl_pos - parser->line_start;
+    if (len > 0 && parser->data[nl_pos - 1] == '\r') len--;
+
+    *line_off = parser->line_start;
+    *line_len = len;
+    parser->line_start = parser->scan = nl_pos + 1;
+    return 1;
+}
+
+// Siguiente token separado por espacios dentro de [*pos, end)
+static int next_token(const char* data, int* pos, int end, int* tok_off, int* tok_len) {
+    while (*pos < end && data[*pos] == ' ') (*pos)++;
+    *tok_off = *pos;
+    while (*pos < end && data[*pos] != ' ') (*pos)++;
+    *tok_len = *pos - *tok_off;
+    return *tok_len > 0;
+}
+
+// "VATP/1.0 TIPO LONGITUD"
+static void parse_start_line(StreamParser* parser, int off, int len) {
+    const char* data = parser->data;
+    int pos = off, end = off + len;
+    int type_off, type_len, len_off, len_len;
+
+    parser->valid = 0;
+    parser->length = 0;
+    parser->header_count = 0;
+
+    if (!next_token(data, &pos, end, &parser->version_off, &parser->version_len) ||
+        !next_token(data, &pos, end, &type_off, &type_len) ||
+        !next_token(data, &pos, end, &len_off, &len_len)) {
+        return;
+    }
+    parser->version_off -= parser->start;
+
+    int length = 0;
+    for (int i = len_off; i < len_off + len_len; i++) {
+        if (data[i] < '0' || data[i] > '9' || length > VATP_RECV_BUFFER) return;
+        length = length * 10 + (data[i] - '0');
+    }
+
+    if (!parse_message_type(data + type_off, type_len, &parser->type)) return;
+
+    parser->length = length;
+    parser->valid = 1;
+}
+
+// "Nombre: valor" (se ignoran espacios alrededor del valor)
+static void parse_header(StreamParser* parser, int off, int len) {
+    const char* colon = memchr(parser->data + off, ':', len);
+    if (!colon || parser->header_count >= VATP_MAX_HEADERS) return;
+
+    int name_len = colon - (parser->data + off);
+    int value_off = name_len + 1 + off;
+    int value_end = off + len;
+    while (value_off < value_end && parser->data[value_off] == ' ') value_off++;
+    while (value_end > value_off && parser->data[value_end - 1] == ' ') value_end--;
+
+    HeaderSpan* span = &parser->headers[parser->header_count++];
+    span->name_off = off - parser->start;
+    span->name_len = name_len;
+    span->value_off = value_off - parser->start;
+    span->value_len = value_end - value_off;
+}
+
+static void fill_view(StreamParser* parser, MessageView* msg) {
+    const char* base = parser->data + parser->start;
+
+    msg->valid = parser->valid;
+    msg->version.ptr = base + parser->version_off;
+    msg->version.len = parser->valid ? parser->version_len : 0;
+    msg->type = parser->type;
+    msg->length = parser->length;
+    msg->header_count = parser->header_count;
+    for (int i = 0; i < parser->header_count; i++) {
+        msg->headers[i].name.ptr = base + parser->headers[i].name_off;
+        msg->headers[i].name.len = parser->headers[i].name_len;
+        msg->headers[i].value.ptr = base + parser->headers[i].value_off;
+        msg->headers[i].value.len = parser->headers[i].value_len;
+    }
+    msg->body.ptr = base + parser->body_off;
+    msg->body.len = parser->length;
+}
+
+static void add_binary_header(MessageView* msg, const char* name, const char* value, int len) {
+    Header* header = &msg->headers[msg->header_count++];
+    header->name.ptr = name;
+    header->name.len = strlen(name);
+    header->value.ptr = value;
+    header->value.len = len;
+}
+
+// Campo "longitud (u8) + bytes" de un payload binario. Devuelve 0 si se sale del payload.
+static int read_binary_string(const char* payload, int len, int* pos, const char** out, int* out_len) {
+    if (*pos >= len) return 0;
+    *out_len = (unsigned char)payload[*pos];
+    *out = payload + *pos + 1;
+    *pos += 1 + *out_len;
+    return *pos <= len;
+}
+
+// Traduce el payload binario a los headers del modo texto:
+//   CONNECT  u8 tipo de usuario (0 OBSERVER, 1 ADMIN) [, u8 len + frecuencia en Hz
+//            como texto [, u8 modo de telemetría (0 completo, 1 delta,
+//            2 on-change) [, u8 len + Vehicle-Id [, u8 len + Fields
+//            [, u8 len + Threshold [, u8 len + Transport]]]], en texto]];
+//            un campo vacío es un header ausente
+//   AUTH     u8 len + usuario, u8 len + contraseña
+//   COMMAND  u8 ID de comando; con más de uno es un lote y los IDs se
+//            quedan en el body
+//   GET_HISTORY  [u8 len + From [, u8 len + To [, u8 len + Buckets]]], en
+//            texto; un campo vacío es un header ausente
+//   GET_TELEMETRY, RESYNC  [u8 len + Vehicle-Id como texto]
+//   resto    sin payload
+static int decode_binary_payload(MessageView* msg) {
+    const char* payload = msg->body.ptr;
+    int len = msg->body.len;
+    int pos = 0;
+
+    switch (msg->type) {
+        case MSG_CONNECT: {
+            if (len < 1) return 0;
+            add_binary_header(msg, "User-Type", payload[0] == USER_ADMIN ? "ADMIN" : "OBSERVER",
+                              payload[0] == USER_ADMIN ? 5 : 8);
+            pos = 1;
+            if (pos < len) {
+                const char* value;
+                int value_len;
+                if (!read_binary_string(payload, len, &pos, &value, &value_len)) return 0;
+                add_binary_header(msg, "Rate", value, value_len);
+            }
+            if (pos < len) {
+                static const char* modes[] = { "full", "delta", "on-change" };
+                unsigned char mode = payload[pos++];
+                const char* name = modes[mode < 3 ? mode : 0];
+                add_binary_header(msg, "Telemetry", name, strlen(name));
+            }
+            static const char* names[] = { "Vehicle-Id", "Fields", "Threshold", "Transport" };
+            for (int i = 0; i < 4 && pos < len; i++) {
+                const char* value;
+                int value_len;
+                if (!read_binary_string(payload, len, &pos, &value, &value_len)) return 0;
+                if (value_len > 0) add_binary_header(msg, names[i], value, value_len);
+            }
+            return 1;
+        }
+
+        case MSG_AUTH: {
+            const char* value;
+            int value_len;
+            if (!read_binary_string(payload, len, &pos, &value, &value_len)) return 0;
+            add_binary_header(msg, "Username", value, value_len);
+            if (!read_binary_string(payload, len, &pos, &value, &value_len)) return 0;
+            add_binary_header(msg, "Password", value, value_len);
+            return 1;
+        }
+
+        case MSG_COMMAND: {
+            if (len < 1) return 0;
+            if (len > 1) return 1;
+            const char* name = command_to_string((unsigned char)payload[0]);
+            add_binary_header(msg, "Command", name, strlen(name));
+            return 1;
+        }
+
+        case MSG_GET_HISTORY: {
+            static const char* names[] = { "From", "To", "Buckets" };
+            for (int i = 0; i < 3 && pos < len; i++) {
+                const char* value;
+                int value_len;
+                if (!read_binary_string(payload, len, &pos, &value, &value_len)) return 0;
+                if (value_len > 0) add_binary_header(msg, names[i], value, value_len);
+            }
+            return 1;
+        }
+
+        case MSG_GET_TELEMETRY:
+        case MSG_RESYNC: {
+            if (pos < len) {
+                const char* value;
+                int value_len;
+                if (!read_binary_string(payload, len, &pos, &value, &value_len)) return 0;
+                if (value_len > 0) add_binary_header(msg, "Vehicle-Id", value, value_len);
+            }
+            return 1;
+        }
+
+        default:
+            return 1;
+    }
+}
+
+// Trama VATP/2.0: cabecera fija de 8 bytes + payload de 'longitud' bytes
+static int parse_binary(StreamParser* parser, MessageView* msg) {
+    int available = parser->end - parser->start;
+    if (available < BINARY_HEADER_SIZE) return PARSE_NEED_MORE;
+
+    const unsigned char* header = (const unsigned char*)parser->data + parser->start;
+    uint32_t length = header[4] | (header[5] << 8) | (header[6] << 16) | ((uint32_t)header[7] << 24);
+
+    if (header[0] != BINARY_VERSION) return PARSE_CORRUPT;
+    if (length > VATP_RECV_BUFFER - BINARY_HEADER_SIZE) return PARSE_TOO_LARGE;
+    if ((uint32_t)available < BINARY_HEADER_SIZE + length) return PARSE_NEED_MORE;
+
+    msg->version.ptr = PROTOCOL_VERSION_BINARY;
+    msg->version.len = strlen(PROTOCOL_VERSION_BINARY);
+    msg->length = length;
+    msg->header_count = 0;
+    msg->body.ptr = parser->data + parser->start + BINARY_HEADER_SIZE;
+    msg->body.len = length;
+    msg->valid = is_client_message_type(header[1]);
+    if (msg->valid) {
+        msg->type = header[1];
+        msg->valid = decode_binary_payload(msg);
+    }
+
+    parser->start += BINARY_HEADER_SIZE + length;
+    parser->line_start = parser->scan = parser->start;
+    return PARSE_COMPLETE;
+}
+
+// Avanza el parser con los datos disponibles. Devuelve PARSE_COMPLETE y rellena
+// 'msg' cuando hay un mensaje entero, PARSE_NEED_MORE si faltan datos y
+// PARSE_TOO_LARGE si el mensaje no cabe en el buffer o PARSE_CORRUPT si la
+// trama binaria es inválida (en ambos casos la conexión debe cerrarse).
+int parser_next(StreamParser* parser, MessageView* msg) {
+    int line_off, line_len;
+
+    if (parser->encoding == ENCODING_BINARY) {
+        return parse_binary(parser, msg);
+    }
+
+    while (1) {
+        switch (parser->state) {
+            case PARSE_START_LINE:
+                if (!next_line(parser, &line_off, &line_len)) goto need_more;
+                if (line_len == 0) {
+                    // Líneas vacías entre mensajes: se ignoran
+                    parser->start = parser->line_start;
+                    continue;
+                }
+                parse_start_line(parser, line_off, line_len);
+                parser->state = PARSE_HEADERS;
+                break;
+
+            case PARSE_HEADERS:
+                if (!next_line(parser, &line_off, &line_len)) goto need_more;
+                if (line_len > 0) {
+                    parse_header(parser, line_off, line_len);
+                    break;
+                }
+                parser->body_off = parser->line_start - parser->start;
+                if (parser->body_off + parser->length > VATP_RECV_BUFFER) {
+                    return PARSE_TOO_LARGE;
+                }
+                parser->state = PARSE_BODY;
+                break;
+
+            case PARSE_BODY: {
+                int body_start = parser->start + parser->body_off;
+                if (parser->end - body_start < parser->length) goto need_more;
+
+                fill_view(parser, msg);
+
+                // El siguiente mensaje empieza justo después del body
+                parser->start = parser->line_start = parser->scan = body_start + parser->length;
+                parser->state = PARSE_START_LINE;
+                return PARSE_COMPLETE;
+            }
+        }
+    }
+
+need_more:
+    if (parser->end - parser->start >= VATP_RECV_BUFFER) {
+        return PARSE_TOO_LARGE;
+    }
+    return PARSE_NEED_MORE;
+}
+
+// Valor del header 'name' (vista vacía si no está)
+StrView message_header(const MessageView* msg, const char* name) {
+    int name_len = strlen(name);
+    for (int i = 0; i < msg->header_count; i++) {
+        if (msg->headers[i].name.len == name_len &&
+            memcmp(msg->headers[i].name.ptr, name, name_len) == 0) {
+            return msg->headers[i].value;
+        }
+    }
+    StrView empty = { "", 0 };
+    return empty;
+}
+
+int view_equals(StrView view, const char* str) {
+    int len = strlen(str);
+    return view.len == len && memcmp(view.ptr, str, len) == 0;
+}
+
+// Copia la vista como string terminada en '\0' (truncando si no cabe)
+int view_copy(StrView view, char* out, int size) {
+    int len = view.len < size - 1 ? view.len : size - 1;
+    memcpy(out, view.ptr, len);
+    out[len] = '\0';
+    return len;
+}
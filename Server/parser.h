@@ -0,0 +1,83 @@
+// ============= parser.h =============
+#ifndef PARSER_H
+#define PARSER_H
+
+#include "protocol.h"
+
+// Buffer de recepción por conexión: un mensaje completo (headers + body)
+// tiene que caber entero
+#define VATP_RECV_BUFFER (BUFFER_SIZE * 2)
+#define VATP_MAX_HEADERS 16
+
+// Vista sobre bytes del buffer de recepción (no termina en '\0')
+typedef struct {
+    const char* ptr;
+    int len;
+} StrView;
+
+typedef struct {
+    StrView name;
+    StrView value;
+} Header;
+
+// Mensaje parseado en sitio. Las vistas apuntan al buffer del parser y solo
+// son válidas hasta la siguiente llamada a parser_write_ptr().
+typedef struct {
+    int valid;              // 0 si la línea inicial no es "<versión> <TIPO> <LONGITUD>"
+    StrView version;
+    MessageType type;
+    int length;
+    int header_count;
+    Header headers[VATP_MAX_HEADERS];
+    StrView body;           // Exactamente 'length' bytes tras la línea vacía
+} MessageView;
+
+typedef enum {
+    PARSE_START_LINE,
+    PARSE_HEADERS,
+    PARSE_BODY
+} ParseState;
+
+typedef struct {
+    int name_off, name_len;
+    int value_off, value_len;
+} HeaderSpan;
+
+// Parser reanudable: conserva el estado entre lecturas, de modo que cada byte
+// se examina una sola vez aunque el mensaje llegue fragmentado.
+typedef struct {
+    char data[VATP_RECV_BUFFER];
+    int start;          // Inicio del mensaje en curso
+    int line_start;     // Inicio de la línea en curso
+    int scan;           // Hasta dónde ya se buscó el fin de línea
+    int end;            // Fin de los datos recibidos
+    ParseState state;
+    ProtocolEncoding encoding;
+
+    // Mensaje en curso (offsets relativos a 'start', sobreviven a la compactación)
+    int valid;
+    int version_off, version_len;
+    MessageType type;
+    int length;
+    int header_count;
+    HeaderSpan headers[VATP_MAX_HEADERS];
+    int body_off;
+} StreamParser;
+
+// Resultado de parser_next()
+#define PARSE_NEED_MORE 0
+#define PARSE_COMPLETE 1
+#define PARSE_TOO_LARGE -1
+#define PARSE_CORRUPT -2     // Trama binaria inválida: no se puede resincronizar
+
+void parser_init(StreamParser* parser);
+void parser_set_encoding(StreamParser* parser, ProtocolEncoding encoding);
+char* parser_write_ptr(StreamParser* parser, int* space);
+void parser_commit(StreamParser* parser, int bytes);
+int parser_next(StreamParser* parser, MessageView* msg);
+
+StrView message_header(const MessageView* msg, const char* name);
+int view_equals(StrView view, const char* str);
+int view_copy(StrView view, char* out, int size);
+
+#endif // PARSER_H
@@ -0,0 +1,279 @@
+// ============= physics.c =============
+// Simulación física de la flota con paso fijo. El estado vive en arrays
+// separados por magnitud (SoA) para que el bucle de integración sea
+// vectorizable: sin ramas (min/max y selecciones), sin llamadas y sin
+// dependencias entre vehículos. Las exponenciales de cada relajación se
+// calculan una vez en physics_start() para el 'dt' fijo (discretización
+// exacta: estable a 0.1 Hz y a 100 Hz).
+//
+// Modelo, por vehículo:
+// - Velocidad: se relaja hacia la que fijó el último comando, con ruido de
+//   conducción (Ornstein-Uhlenbeck) solo en marcha. Con consigna 0 se
+//   detiene del todo por debajo de PHYSICS_STOP_KMH.
+// - Rumbo: el del comando más una desviación que vuelve a 0 (ruido de carril)
+// - Batería: consumo proporcional a la velocidad. Con la reserva
+//   (PHYSICS_BATTERY_RESERVE) se detiene, como en la simulación original.
+// - Temperatura: se relaja hacia la de equilibrio (ambiente más el calor
+//   proporcional a la velocidad), con ruido y entre 15 y 45 °C.
+//
+// El ruido no sale de un generador con estado sino de un hash de (semilla,
+// paso, vehículo): cada thread genera el de sus bloques sin compartir nada y
+// el resultado es idéntico con cualquier número de threads.
+#include "physics.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#define PHYSICS_MAX_KMH 100.0f
+#define PHYSICS_STOP_KMH 0.5f
+#define PHYSICS_SPEED_RELAX 0.5f        // 1/s
+#define PHYSICS_SPEED_SIGMA 1.0f        // km/h/√s
+#define PHYSICS_HEADING_RELAX 0.2f      // 1/s
+#define PHYSICS_HEADING_SIGMA 1.0f      // grados/√s
+#define PHYSICS_BATTERY_DRAIN 0.001f    // %/s por km/h (0.5 % cada 10 s a 50 km/h)
+#define PHYSICS_BATTERY_RESERVE 5.0f    // %
+#define PHYSICS_AMBIENT_C 25.0f
+#define PHYSICS_HEAT_PER_KMH 0.15f      // °C de equilibrio por km/h
+#define PHYSICS_THERMAL_TAU 60.0f       // s
+#define PHYSICS_THERMAL_SIGMA 0.3f      // °C/√s
+#define PHYSICS_MIN_C 15.0f
+#define PHYSICS_MAX_C 45.0f
+
+static const char* directions[] = {"NORTH", "EAST", "SOUTH", "WEST"};
+
+// Un array por magnitud, alineados a línea de caché
+static struct {
+    float* speed;           // km/h
+    float* target_speed;    // km/h (0 = detenerse)
+    float* heading;         // Rumbo del comando (0, 90, 180, 270)
+    float* heading_error;   // Desviación sobre él (grados)
+    float* battery;         // %
+    float* temperature;     // °C
+} model;
+
+static int vehicle_count = 0;
+
+// Coeficientes de un paso de 'dt' (ver physics_start)
+static struct {
+    float speed_keep, speed_noise;
+    float heading_keep, heading_noise;
+    float thermal_keep, thermal_noise;
+    float drain;
+} coef;
+
+static uint32_t seed_key = 0;
+static unsigned long step_count = 0;
+static uint32_t step_key = 0;           // Clave del ruido del paso en curso
+static PhysicsPublish publish_fn = NULL;
+static void* publish_arg = NULL;
+
+static int thread_count = 1;
+static pthread_barrier_t step_start;
+static pthread_barrier_t step_done;
+
+// Hash de 32 bits (mezcla tipo murmur): solo sumas, xor y productos de 32
+// bits, que se vectorizan
+static inline uint32_t mix32(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// Uniforme en [-√3, √3): media 0 y varianza 1
+static inline float noise(uint32_t bits) {
+    return (float)(int32_t)bits * (1.7320508f / 2147483648.0f);
+}
+
+static float* alloc_array(size_t count) {
+    return aligned_alloc(64, count * sizeof(float));
+}
+
+int physics_init(int count) {
+    // Redondeado a bloques: el último bloque se integra entero
+    size_t padded = ((size_t)count + PHYSICS_BLOCK - 1) / PHYSICS_BLOCK * PHYSICS_BLOCK;
+    float** arrays[] = { &model.speed, &model.target_speed, &model.heading,
+                         &model.heading_error, &model.battery, &model.temperature };
+
+    for (size_t a = 0; a < sizeof(arrays) / sizeof(arrays[0]); a++) {
+        *arrays[a] = alloc_array(padded);
+        if (!*arrays[a]) return -1;
+        memset(*arrays[a], 0, padded * sizeof(float));
+    }
+    for (size_t i = 0; i < padded; i++) {
+        model.battery[i] = 100.0f;
+        model.temperature[i] = PHYSICS_AMBIENT_C;
+    }
+    vehicle_count = count;
+    return 0;
+}
+
+// Integra los vehículos [first, last)
+static void integrate(uint32_t first, uint32_t last, uint32_t key) {
+    float* restrict speed = model.speed;
+    float* restrict target_speed = model.target_speed;
+    float* restrict heading_error = model.heading_error;
+    float* restrict battery = model.battery;
+    float* restrict temperature = model.temperature;
+    float speed_keep = coef.speed_keep, speed_noise = coef.speed_noise;
+    float heading_keep = coef.heading_keep, heading_noise = coef.heading_noise;
+    float thermal_keep = coef.thermal_keep, thermal_noise = coef.thermal_noise;
+    float drain = coef.drain;
+
+    for (size_t i = first; i < last; i++) {
+        uint32_t r1 = mix32((uint32_t)i ^ key);
+        uint32_t r2 = mix32(r1 + 0x9e3779b9u);
+        uint32_t r3 = mix32(r2 + 0x9e3779b9u);
+
+        // Velocidad (ruido solo en marcha); con consigna 0 se detiene del todo
+        float target = target_speed[i];
+        float jitter = speed_noise * noise(r1);
+        jitter = target > 0.0f ? jitter : 0.0f;
+        float v = target + (speed[i] - target) * speed_keep + jitter;
+        v = v < 0.0f ? 0.0f : v;
+        v = v > PHYSICS_MAX_KMH ? PHYSICS_MAX_KMH : v;
+        float stop_below = target > 0.0f ? 0.0f : PHYSICS_STOP_KMH;
+        v = v >= stop_below ? v : 0.0f;
+
+        // Batería proporcional a la velocidad; en la reserva se detiene
+        float b = battery[i] - drain * v;
+        b = b < 0.0f ? 0.0f : b;
+        v = b > PHYSICS_BATTERY_RESERVE ? v : 0.0f;
+        target_speed[i] = b > PHYSICS_BATTERY_RESERVE ? target : 0.0f;
+        speed[i] = v;
+        battery[i] = b;
+
+        // Desviación del rumbo
+        float wander = heading_noise * noise(r2);
+        wander = target > 0.0f ? wander : 0.0f;
+        heading_error[i] = heading_error[i] * heading_keep + wander;
+
+        // Temperatura hacia la de equilibrio a esta velocidad
+        float equilibrium = PHYSICS_AMBIENT_C + PHYSICS_HEAT_PER_KMH * v;
+        float t = equilibrium + (temperature[i] - equilibrium) * thermal_keep +
+                  thermal_noise * noise(r3);
+        t = t < PHYSICS_MIN_C ? PHYSICS_MIN_C : t;
+        temperature[i] = t > PHYSICS_MAX_C ? PHYSICS_MAX_C : t;
+    }
+}
+
+// La parte de un thread: bloques contiguos, integrados y publicados en
+// seguida (aún en caché)
+static void run_share(int index) {
+    uint32_t blocks = ((uint32_t)vehicle_count + PHYSICS_BLOCK - 1) / PHYSICS_BLOCK;
+    uint32_t begin = (uint32_t)((uint64_t)blocks * index / thread_count);
+    uint32_t end = (uint32_t)((uint64_t)blocks * (index + 1) / thread_count);
+
+    for (uint32_t block = begin; block < end; block++) {
+        uint32_t first = block * PHYSICS_BLOCK;
+        uint32_t last = first + PHYSICS_BLOCK;
+        integrate(first, last, step_key);
+
+        if (last > (uint32_t)vehicle_count) last = vehicle_count;
+        if (publish_fn) publish_fn(first, last, publish_arg);
+    }
+}
+
+static void* physics_worker(void* arg) {
+    int index = (int)(intptr_t)arg;
+
+    while (1) {
+        pthread_barrier_wait(&step_start);
+        run_share(index);
+        pthread_barrier_wait(&step_done);
+    }
+
+    return NULL;
+}
+
+// Ruido de Ornstein-Uhlenbeck discretizado exactamente para 'dt': factor de
+// relajación 'keep' y desviación del ruido de un paso
+static void ou_coefficients(float relax, float sigma, double dt, float* keep, float* noise_sd) {
+    *keep = (float)exp(-relax * dt);
+    *noise_sd = (float)(sigma * sqrt((1.0 - exp(-2.0 * relax * dt)) / (2.0 * relax)));
+}
+
+int physics_start(double dt, int threads, uint32_t seed, PhysicsPublish publish, void* arg) {
+    ou_coefficients(PHYSICS_SPEED_RELAX, PHYSICS_SPEED_SIGMA, dt, &coef.speed_keep, &coef.speed_noise);
+    ou_coefficients(PHYSICS_HEADING_RELAX, PHYSICS_HEADING_SIGMA, dt,
+                    &coef.heading_keep, &coef.heading_noise);
+    ou_coefficients(1.0f / PHYSICS_THERMAL_TAU, PHYSICS_THERMAL_SIGMA, dt,
+                    &coef.thermal_keep, &coef.thermal_noise);
+    coef.drain = (float)(PHYSICS_BATTERY_DRAIN * dt);
+
+    seed_key = mix32(seed ^ 0x5bd1e995u);
+    publish_fn = publish;
+    publish_arg = arg;
+
+    // Nunca más threads que bloques
+    int blocks = (vehicle_count + PHYSICS_BLOCK - 1) / PHYSICS_BLOCK;
+    if (threads > blocks) threads = blocks;
+    if (threads > PHYSICS_MAX_THREADS) threads = PHYSICS_MAX_THREADS;
+    if (threads < 1) threads = 1;
+    thread_count = threads;
+    if (thread_count == 1) return 0;
+
+    if (pthread_barrier_init(&step_start, NULL, thread_count) != 0 ||
+        pthread_barrier_init(&step_done, NULL, thread_count) != 0) {
+        return -1;
+    }
+    for (int i = 1; i < thread_count; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, physics_worker, (void*)(intptr_t)i) != 0) return -1;
+        pthread_detach(thread);
+    }
+    return 0;
+}
+
+void physics_step() {
+    // Clave del ruido de este paso: depende solo de la semilla y del número de paso
+    step_key = mix32(seed_key ^ mix32((uint32_t)step_count) ^ mix32((uint32_t)(step_count >> 32) + 1));
+    step_count++;
+
+    if (thread_count > 1) pthread_barrier_wait(&step_start);
+    run_share(0);
+    if (thread_count > 1) pthread_barrier_wait(&step_done);
+}
+
+unsigned long physics_steps() {
+    return step_count;
+}
+
+int physics_threads() {
+    return thread_count;
+}
+
+static int direction_index(const char* direction) {
+    for (int i = 0; i < 4; i++) {
+        if (strcmp(direction, directions[i]) == 0) return i;
+    }
+    return 0;
+}
+
+// Un comando o un estado grabado: la consigna pasa a ser el estado nuevo
+void physics_load(uint32_t vehicle, const VehicleState* state) {
+    float heading = 90.0f * direction_index(state->direction);
+    if (heading != model.heading[vehicle]) model.heading_error[vehicle] = 0.0f;
+
+    model.speed[vehicle] = state->speed;
+    model.target_speed[vehicle] = state->is_moving ? state->speed : 0.0f;
+    model.heading[vehicle] = heading;
+    model.battery[vehicle] = state->battery;
+    model.temperature[vehicle] = state->temperature;
+}
+
+void physics_state(uint32_t vehicle, VehicleState* out) {
+    memset(out, 0, sizeof(*out));
+    out->speed = model.speed[vehicle];
+    out->battery = model.battery[vehicle];
+    out->temperature = model.temperature[vehicle];
+    out->is_moving = out->speed > 0.0f;
+
+    // Punto cardinal más cercano al rumbo real
+    float heading = model.heading[vehicle] + model.heading_error[vehicle] + 45.0f;
+    int quadrant = (int)floorf(heading / 90.0f);
+    strcpy(out->direction, directions[((quadrant % 4) + 4) % 4]);
+}
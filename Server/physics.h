@@ -0,0 +1,36 @@
+// ============= physics.h =============
+#ifndef PHYSICS_H
+#define PHYSICS_H
+
+#include "protocol.h"
+#include <stdint.h>
+
+// Vehículos por bloque: la unidad de reparto entre threads (múltiplo del
+// ancho SIMD, y de 16 floats = una línea de caché por array)
+#define PHYSICS_BLOCK 1024
+#define PHYSICS_MAX_THREADS 64
+// Frecuencia por defecto de la simulación (la del tick original, cada 10 s)
+#define PHYSICS_DEFAULT_RATE_HZ 0.1
+#define PHYSICS_DEFAULT_SEED 1
+
+// Tras integrar un rango [first, last) el thread que lo integró lo publica
+typedef void (*PhysicsPublish)(uint32_t first, uint32_t last, void* arg);
+
+// Reserva el modelo de 'count' vehículos en el estado inicial (parado, 100 %
+// de batería, 25 °C, rumbo norte). Devuelve -1 si no hay memoria.
+int physics_init(int count);
+// Prepara los pasos de 'dt' segundos con 'threads' threads (incluido el que
+// llama a physics_step) y la semilla del ruido. Devuelve -1 si falla.
+int physics_start(double dt, int threads, uint32_t seed, PhysicsPublish publish, void* arg);
+// Un paso de integración de toda la flota. El resultado solo depende de la
+// semilla, del número de paso y del estado previo, no del número de threads.
+// Un solo llamador a la vez.
+void physics_step();
+unsigned long physics_steps();
+int physics_threads();
+
+// Conversión entre el modelo y el estado publicado. Solo entre pasos.
+void physics_load(uint32_t vehicle, const VehicleState* state);
+void physics_state(uint32_t vehicle, VehicleState* out);
+
+#endif // PHYSICS_H
@@ -2,96 +2,345 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 
-int parse_message(const char* raw_msg, Message* msg) {
-    // Copiar el mensaje raw para parsearlo
-    char buffer[BUFFER_SIZE];
-    strncpy(buffer, raw_msg, BUFFER_SIZE - 1);
-    buffer[BUFFER_SIZE - 1] = '\0';
-    
-    // Limpiar la estructura
-    memset(msg, 0, sizeof(Message));
-    
-    // Parsear primera línea: "VATP/1.0 TYPE LENGTH"
-    char* line = strtok(buffer, "\r\n");
-    if (!line) return 0;
-    
-    char version[16], type_str[32];
-    int length;
-    
-    if (sscanf(line, "%s %s %d", version, type_str, &length) != 3) {
-        return 0;
-    }
-    
-    strncpy(msg->version, version, 15);
-    msg->length = length;
-    
-    // Determinar tipo de mensaje
-    if (strcmp(type_str, "CONNECT") == 0) {
-        msg->type = MSG_CONNECT;
-    } else if (strcmp(type_str, "AUTH") == 0) {
-        msg->type = MSG_AUTH;
-    } else if (strcmp(type_str, "GET_TELEMETRY") == 0) {
-        msg->type = MSG_GET_TELEMETRY;
-    } else if (strcmp(type_str, "COMMAND") == 0) {
-        msg->type = MSG_COMMAND;
-    } else if (strcmp(type_str, "LIST_USERS") == 0) {
-        msg->type = MSG_LIST_USERS;
-    } else if (strcmp(type_str, "DISCONNECT") == 0) {
-        msg->type = MSG_DISCONNECT;
-    } else {
-        return 0; // Tipo desconocido
-    }
-    
-    // Parsear headers
-    while ((line = strtok(NULL, "\r\n")) != NULL) {
-        if (strlen(line) == 0) break; // Línea vacía = fin de headers
-        
-        char key[64], value[BUFFER_SIZE];
-        if (sscanf(line, "%[^:]: %[^\r\n]", key, value) == 2) {
-            if (strcmp(key, "User-Type") == 0) {
-                strncpy(msg->data, value, BUFFER_SIZE - 1);
-            } else if (strcmp(key, "Username") == 0) {
-                strncpy(msg->username, value, MAX_USERNAME - 1);
-            } else if (strcmp(key, "Password") == 0) {
-                strncpy(msg->auth_token, value, MAX_TOKEN - 1);
-            } else if (strcmp(key, "Command") == 0) {
-                strncpy(msg->command, value, 31);
-            }
-        }
-    }
+// ---- Formateo rápido (sin printf) ----
+
+// Copia una cadena y devuelve el puntero a su final
+static char* append_str(char* out, const char* str) {
+    int len = strlen(str);
+    memcpy(out, str, len);
+    return out + len;
+}
+
+// Entero sin signo en decimal. Devuelve los bytes escritos.
+int format_uint(char* out, unsigned long value) {
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
     
-    // Si hay body después de los headers (para algunos mensajes)
-    if (line != NULL && strlen(line) > 0) {
-        line = strtok(NULL, "\0"); // Resto del mensaje
-        if (line) {
-            strncpy(msg->data, line, BUFFER_SIZE - 1);
-        }
-    }
+    for (int i = 0; i < n; i++) out[i] = digits[n - 1 - i];
+    return n;
+}
+
+// Equivalente a "%.2f" en punto fijo. value * 100 es exacto en double para
+// cualquier float, así que redondear al par en los empates da el mismo
+// resultado que printf. Fuera de rango (o NaN/inf) se delega en sprintf.
+// Devuelve los bytes escritos (sin terminador).
+int format_fixed2(char* out, float value) {
+    double scaled = fabs((double)value * 100.0);
+    if (!(scaled < 1e15)) return sprintf(out, "%.2f", value);
+    
+    int len = 0;
+    if (signbit(value)) out[len++] = '-';
     
-    return 1; // Éxito
+    unsigned long units = (unsigned long)scaled;
+    double rest = scaled - units;
+    if (rest > 0.5 || (rest == 0.5 && (units & 1))) units++;
+    
+    len += format_uint(out + len, units / 100);
+    out[len++] = '.';
+    out[len++] = '0' + units / 10 % 10;
+    out[len++] = '0' + units % 10;
+    return len;
 }
 
 int build_response(char* buffer, MessageType type, const char* data) {
+    return build_versioned_response(buffer, PROTOCOL_VERSION, type, data);
+}
+
+int build_versioned_response(char* buffer, const char* version, MessageType type, const char* data) {
     const char* type_str = message_type_to_string(type);
     int length = data ? strlen(data) : 0;
     
-    sprintf(buffer, "%s %s %d\r\n\r\n%s", 
-            PROTOCOL_VERSION, type_str, length, data ? data : "");
+    // "<versión> <tipo> <longitud>\r\n\r\n<data>"
+    char* p = append_str(buffer, version);
+    *p++ = ' ';
+    p = append_str(p, type_str);
+    *p++ = ' ';
+    p += format_uint(p, length);
+    p = append_str(p, "\r\n\r\n");
+    if (length) memcpy(p, data, length);
+    p[length] = '\0';
     
-    return strlen(buffer);
+    return p + length - buffer;
 }
 
-int build_telemetry_message(char* buffer, VehicleState* state) {
+// Body de TELEMETRY_DATA en texto; en una flota empieza con "Vehicle-Id: N"
+static int build_text_telemetry(char* buffer, int vehicle, const VehicleState* state) {
     char data[512];
-    sprintf(data, "Speed: %.2f km/h\r\nBattery: %.2f%%\r\nTemperature: %.2f C\r\n"
-                  "Direction: %s\r\nMoving: %s",
-            state->speed, state->battery, state->temperature,
-            state->direction, state->is_moving ? "Yes" : "No");
+    char* p = data;
+    if (vehicle != VEHICLE_NO_ID) {
+        p = append_str(p, "Vehicle-Id: ");
+        p += format_uint(p, vehicle);
+        p = append_str(p, "\r\n");
+    }
+    p = append_str(p, "Speed: ");
+    p += format_fixed2(p, state->speed);
+    p = append_str(p, " km/h\r\nBattery: ");
+    p += format_fixed2(p, state->battery);
+    p = append_str(p, "%\r\nTemperature: ");
+    p += format_fixed2(p, state->temperature);
+    p = append_str(p, " C\r\nDirection: ");
+    p = append_str(p, state->direction);
+    p = append_str(p, state->is_moving ? "\r\nMoving: Yes" : "\r\nMoving: No");
+    *p = '\0';
     
     return build_response(buffer, MSG_TELEMETRY_DATA, data);
 }
 
+int build_telemetry_message(char* buffer, VehicleState* state) {
+    return build_text_telemetry(buffer, VEHICLE_NO_ID, state);
+}
+
+// ---- VATP/2.0 (binario) ----
+
+static const char* direction_table[] = { "NORTH", "EAST", "SOUTH", "WEST" };
+
+int direction_to_id(const char* direction) {
+    for (int i = 0; i < 4; i++) {
+        if (strcmp(direction, direction_table[i]) == 0) return i;
+    }
+    return 0;
+}
+
+const char* direction_from_id(int id) {
+    return id >= 0 && id < 4 ? direction_table[id] : "UNKNOWN";
+}
+
+static void put_u32le(char* out, uint32_t value) {
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+    out[2] = (value >> 16) & 0xFF;
+    out[3] = (value >> 24) & 0xFF;
+}
+
+static uint32_t get_u32le(const char* in) {
+    const unsigned char* p = (const unsigned char*)in;
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put_f32le(char* out, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put_u32le(out, bits);
+}
+
+static float get_f32le(const char* in) {
+    uint32_t bits = get_u32le(in);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+int build_binary_header(char* buffer, MessageType type, int length) {
+    buffer[0] = BINARY_VERSION;
+    buffer[1] = type;
+    buffer[2] = 0;
+    buffer[3] = 0;
+    put_u32le(buffer + 4, length);
+    return BINARY_HEADER_SIZE;
+}
+
+// Respuesta binaria: el payload es el texto de la respuesta (sin '\0')
+int build_binary_response(char* buffer, MessageType type, const char* data) {
+    int length = data ? strlen(data) : 0;
+    
+    build_binary_header(buffer, type, length);
+    memcpy(buffer + BINARY_HEADER_SIZE, data ? data : "", length);
+    buffer[BINARY_HEADER_SIZE + length] = '\0';
+    
+    return BINARY_HEADER_SIZE + length;
+}
+
+static int build_binary_record(char* buffer, int vehicle, const VehicleState* state) {
+    char* record = buffer + BINARY_HEADER_SIZE;
+    int len = TELEMETRY_RECORD_SIZE;
+    
+    put_f32le(record, state->speed);
+    put_f32le(record + 4, state->battery);
+    put_f32le(record + 8, state->temperature);
+    record[12] = direction_to_id(state->direction);
+    record[13] = state->is_moving ? 1 : 0;
+    record[14] = 0;
+    record[15] = 0;
+    if (vehicle != VEHICLE_NO_ID) {
+        put_u32le(record + len, vehicle);
+        len += 4;
+    }
+    
+    build_binary_header(buffer, MSG_TELEMETRY_DATA, len);
+    return BINARY_HEADER_SIZE + len;
+}
+
+int build_binary_telemetry(char* buffer, const VehicleState* state) {
+    return build_binary_record(buffer, VEHICLE_NO_ID, state);
+}
+
+// Decodifica el payload de un TELEMETRY_DATA binario. Devuelve 0 si no es válido.
+int decode_binary_telemetry(const char* payload, int len, VehicleState* state) {
+    if (len < TELEMETRY_RECORD_SIZE) return 0;
+    
+    state->speed = get_f32le(payload);
+    state->battery = get_f32le(payload + 4);
+    state->temperature = get_f32le(payload + 8);
+    strcpy(state->direction, direction_from_id((unsigned char)payload[12]));
+    state->is_moving = payload[13] != 0;
+    return 1;
+}
+
+// Respuesta en la codificación negociada por la conexión
+int encode_response(char* buffer, ProtocolEncoding encoding, MessageType type, const char* data) {
+    if (encoding == ENCODING_BINARY) {
+        return build_binary_response(buffer, type, data);
+    }
+    return build_response(buffer, type, data);
+}
+
+// TELEMETRY_DATA de un vehículo (VEHICLE_NO_ID: sin identificarlo)
+int encode_telemetry(char* buffer, ProtocolEncoding encoding, int vehicle, const VehicleState* state) {
+    if (encoding == ENCODING_BINARY) {
+        return build_binary_record(buffer, vehicle, state);
+    }
+    return build_text_telemetry(buffer, vehicle, state);
+}
+
+// Campos que difieren entre dos estados (máscara TELEMETRY_FIELD_*)
+unsigned int telemetry_changed_fields(const VehicleState* old_state, const VehicleState* new_state) {
+    unsigned int fields = 0;
+    
+    if (old_state->speed != new_state->speed) fields |= TELEMETRY_FIELD_SPEED;
+    if (old_state->battery != new_state->battery) fields |= TELEMETRY_FIELD_BATTERY;
+    if (old_state->temperature != new_state->temperature) fields |= TELEMETRY_FIELD_TEMPERATURE;
+    if (strcmp(old_state->direction, new_state->direction) != 0) fields |= TELEMETRY_FIELD_DIRECTION;
+    if (old_state->is_moving != new_state->is_moving) fields |= TELEMETRY_FIELD_MOVING;
+    
+    return fields;
+}
+
+// Filtro por defecto: todos los campos en cada envío
+void telemetry_filter_init(TelemetryFilter* filter) {
+    memset(filter, 0, sizeof(TelemetryFilter));
+    filter->fields = TELEMETRY_FIELD_ALL;
+}
+
+int telemetry_filter_is_plain(const TelemetryFilter* filter) {
+    TelemetryFilter plain;
+    telemetry_filter_init(&plain);
+    return telemetry_filter_equals(filter, &plain);
+}
+
+int telemetry_filter_equals(const TelemetryFilter* a, const TelemetryFilter* b) {
+    if (a->fields != b->fields || a->on_change != b->on_change) return 0;
+    for (int i = 0; i < TELEMETRY_THRESHOLD_COUNT; i++) {
+        if (a->thresholds[i] != b->thresholds[i]) return 0;
+    }
+    return 1;
+}
+
+// Diferencia que supera el umbral (0 = cualquier cambio)
+static int exceeds(float sent, float value, float threshold) {
+    float diff = value > sent ? value - sent : sent - value;
+    return threshold > 0 ? diff > threshold : diff != 0;
+}
+
+// Campos del filtro que cambiaron respecto a lo último enviado lo bastante
+// para volver a enviarse (máscara TELEMETRY_FIELD_*)
+unsigned int telemetry_filter_changes(const TelemetryFilter* filter, const VehicleState* sent,
+                                      const VehicleState* state) {
+    unsigned int fields = 0;
+    
+    if (exceeds(sent->speed, state->speed, filter->thresholds[0])) fields |= TELEMETRY_FIELD_SPEED;
+    if (exceeds(sent->battery, state->battery, filter->thresholds[1])) fields |= TELEMETRY_FIELD_BATTERY;
+    if (exceeds(sent->temperature, state->temperature, filter->thresholds[2])) {
+        fields |= TELEMETRY_FIELD_TEMPERATURE;
+    }
+    if (strcmp(sent->direction, state->direction) != 0) fields |= TELEMETRY_FIELD_DIRECTION;
+    if (sent->is_moving != state->is_moving) fields |= TELEMETRY_FIELD_MOVING;
+    
+    return fields & filter->fields;
+}
+
+// TELEMETRY_DELTA en texto: "Vehicle-Id: N" en una flota, "Seq: N",
+// "Keyframe: Yes" si lo es, y solo las líneas de TELEMETRY_DATA de los campos indicados
+static int build_text_delta(char* buffer, int vehicle, unsigned long seq, int keyframe,
+                            unsigned int fields, const VehicleState* state) {
+    char data[512];
+    char* p = data;
+    if (vehicle != VEHICLE_NO_ID) {
+        p = append_str(p, "Vehicle-Id: ");
+        p += format_uint(p, vehicle);
+        p = append_str(p, "\r\n");
+    }
+    p = append_str(p, "Seq: ");
+    p += format_uint(p, seq);
+    
+    if (keyframe) p = append_str(p, "\r\nKeyframe: Yes");
+    if (fields & TELEMETRY_FIELD_SPEED) {
+        p = append_str(p, "\r\nSpeed: ");
+        p += format_fixed2(p, state->speed);
+        p = append_str(p, " km/h");
+    }
+    if (fields & TELEMETRY_FIELD_BATTERY) {
+        p = append_str(p, "\r\nBattery: ");
+        p += format_fixed2(p, state->battery);
+        *p++ = '%';
+    }
+    if (fields & TELEMETRY_FIELD_TEMPERATURE) {
+        p = append_str(p, "\r\nTemperature: ");
+        p += format_fixed2(p, state->temperature);
+        p = append_str(p, " C");
+    }
+    if (fields & TELEMETRY_FIELD_DIRECTION) {
+        p = append_str(p, "\r\nDirection: ");
+        p = append_str(p, state->direction);
+    }
+    if (fields & TELEMETRY_FIELD_MOVING) {
+        p = append_str(p, state->is_moving ? "\r\nMoving: Yes" : "\r\nMoving: No");
+    }
+    *p = '\0';
+    
+    return build_response(buffer, MSG_TELEMETRY_DELTA, data);
+}
+
+static int build_binary_delta(char* buffer, int vehicle, unsigned long seq, int keyframe,
+                              unsigned int fields, const VehicleState* state) {
+    char* payload = buffer + BINARY_HEADER_SIZE;
+    int len = 0;
+    
+    put_u32le(payload, seq);
+    payload[4] = keyframe ? TELEMETRY_DELTA_KEYFRAME : 0;
+    payload[5] = fields;
+    len = 6;
+    if (vehicle != VEHICLE_NO_ID) {
+        payload[4] |= TELEMETRY_DELTA_VEHICLE;
+        put_u32le(payload + len, vehicle);
+        len += 4;
+    }
+    
+    if (fields & TELEMETRY_FIELD_SPEED) { put_f32le(payload + len, state->speed); len += 4; }
+    if (fields & TELEMETRY_FIELD_BATTERY) { put_f32le(payload + len, state->battery); len += 4; }
+    if (fields & TELEMETRY_FIELD_TEMPERATURE) { put_f32le(payload + len, state->temperature); len += 4; }
+    if (fields & TELEMETRY_FIELD_DIRECTION) payload[len++] = direction_to_id(state->direction);
+    if (fields & TELEMETRY_FIELD_MOVING) payload[len++] = state->is_moving ? 1 : 0;
+    
+    build_binary_header(buffer, MSG_TELEMETRY_DELTA, len);
+    return BINARY_HEADER_SIZE + len;
+}
+
+// Frame TELEMETRY_DELTA con los campos indicados. Un keyframe lleva todos
+// los campos del flujo (TELEMETRY_FIELD_ALL, o los del filtro de suscripción).
+int encode_telemetry_delta(char* buffer, ProtocolEncoding encoding, int vehicle, unsigned long seq,
+                           int keyframe, unsigned int fields, const VehicleState* state) {
+    if (encoding == ENCODING_BINARY) {
+        return build_binary_delta(buffer, vehicle, seq, keyframe, fields, state);
+    }
+    return build_text_delta(buffer, vehicle, seq, keyframe, fields, state);
+}
+
 // Tabla de comandos
 static const struct {
     const char* name;
@@ -136,6 +385,10 @@ static const struct {
     {"RESPONSE_OK", MSG_RESPONSE_OK},
     {"RESPONSE_ERROR", MSG_RESPONSE_ERROR},
     {"TELEMETRY_DATA", MSG_TELEMETRY_DATA},
+    {"TELEMETRY_DELTA", MSG_TELEMETRY_DELTA},
+    {"RESYNC", MSG_RESYNC},
+    {"STATS", MSG_STATS},
+    {"GET_HISTORY", MSG_GET_HISTORY},
     {NULL, MSG_CONNECT}
 };
 
@@ -146,4 +399,24 @@ const char* message_type_to_string(MessageType type) {
         }
     }
     return "UNKNOWN";
-}
\ No newline at end of file
+}
+
+// Tipos que puede enviar un cliente (el resto solo los envía el servidor)
+int is_client_message_type(MessageType type) {
+    return type <= MSG_DISCONNECT || type == MSG_RESYNC || type == MSG_STATS ||
+           type == MSG_GET_HISTORY;
+}
+
+// Tipo de mensaje a partir del nombre (no terminado en '\0'). Solo acepta
+// los tipos que puede enviar un cliente.
+int parse_message_type(const char* name, int len, MessageType* type) {
+    for (int i = 0; message_table[i].name != NULL; i++) {
+        if (!is_client_message_type(message_table[i].type)) continue;
+        if ((int)strlen(message_table[i].name) == len &&
+            memcmp(message_table[i].name, name, len) == 0) {
+            *type = message_table[i].type;
+            return 1;
+        }
+    }
+    return 0;
+}
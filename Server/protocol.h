@@ -2,45 +2,92 @@
 #define PROTOCOL_H
 
 #include <stdint.h>
+#include <pthread.h>
 
 // Versión del protocolo
 #define PROTOCOL_VERSION "VATP/1.0"
+// Framing binario, negociado en CONNECT con el header "Protocol: VATP/2.0"
+#define PROTOCOL_VERSION_BINARY "VATP/2.0"
 
 // Tamaños de buffer
 #define BUFFER_SIZE 2048
-#define MAX_CLIENTS 50
 #define MAX_USERNAME 32
 #define MAX_PASSWORD 64
 #define MAX_TOKEN 128
 
-// Tipos de mensaje
+// Tipos de mensaje (el valor es el ID numérico en VATP/2.0)
 typedef enum {
-    MSG_CONNECT,
-    MSG_AUTH,
-    MSG_GET_TELEMETRY,
-    MSG_COMMAND,
-    MSG_LIST_USERS,
-    MSG_DISCONNECT,
-    MSG_RESPONSE_OK,
-    MSG_RESPONSE_ERROR,
-    MSG_TELEMETRY_DATA
+    MSG_CONNECT = 0,
+    MSG_AUTH = 1,
+    MSG_GET_TELEMETRY = 2,
+    MSG_COMMAND = 3,
+    MSG_LIST_USERS = 4,
+    MSG_DISCONNECT = 5,
+    MSG_RESPONSE_OK = 6,
+    MSG_RESPONSE_ERROR = 7,
+    MSG_TELEMETRY_DATA = 8,
+    MSG_TELEMETRY_DELTA = 9,
+    MSG_RESYNC = 10,
+    MSG_STATS = 11,
+    MSG_GET_HISTORY = 12
 } MessageType;
 
+// Codificación de los mensajes de una conexión
+typedef enum {
+    ENCODING_TEXT,      // VATP/1.0 (por defecto)
+    ENCODING_BINARY,    // VATP/2.0
+    ENCODING_COUNT
+} ProtocolEncoding;
+
+// Modo de la telemetría periódica de una conexión
+typedef enum {
+    TELEMETRY_MODE_FULL,    // TELEMETRY_DATA completo en cada envío (por defecto)
+    TELEMETRY_MODE_DELTA,   // TELEMETRY_DELTA: solo campos cambiados + secuencia
+    TELEMETRY_MODE_COUNT
+} TelemetryMode;
+
+// Campos de VehicleState en un TELEMETRY_DELTA (máscara de bits)
+#define TELEMETRY_FIELD_SPEED 0x01
+#define TELEMETRY_FIELD_BATTERY 0x02
+#define TELEMETRY_FIELD_TEMPERATURE 0x04
+#define TELEMETRY_FIELD_DIRECTION 0x08
+#define TELEMETRY_FIELD_MOVING 0x10
+#define TELEMETRY_FIELD_ALL 0x1F
+
+// Filtro de suscripción declarado en CONNECT: qué campos interesan y cuánto
+// tienen que cambiar para enviarse. Los umbrales son de los campos numéricos
+// (speed, battery, temperature); dirección y movimiento cuentan cualquier cambio.
+#define TELEMETRY_THRESHOLD_COUNT 3
+typedef struct {
+    unsigned int fields;        // TELEMETRY_FIELD_* a enviar (0 = sin telemetría periódica)
+    int on_change;              // Solo cuando cambie alguno de esos campos
+    float thresholds[TELEMETRY_THRESHOLD_COUNT];  // Cambio mínimo (0 = cualquiera)
+} TelemetryFilter;
+
 // Tipos de usuario
 typedef enum {
     USER_OBSERVER,
     USER_ADMIN
 } UserType;
 
-// Comandos de control
+// Comandos de control (el valor es el ID numérico en VATP/2.0)
 typedef enum {
-    CMD_SPEED_UP,
-    CMD_SLOW_DOWN,
-    CMD_TURN_LEFT,
-    CMD_TURN_RIGHT,
+    CMD_SPEED_UP = 0,
+    CMD_SLOW_DOWN = 1,
+    CMD_TURN_LEFT = 2,
+    CMD_TURN_RIGHT = 3,
     CMD_UNKNOWN
 } CommandType;
 
+// Máximo de comandos en un COMMAND por lotes
+#define COMMAND_MAX_BATCH 16
+
+// Flota: los vehículos se identifican de 0 a N-1 (header "Vehicle-Id"). Con
+// un solo vehículo la telemetría no lleva el ID (VEHICLE_NO_ID), como antes.
+#define VEHICLE_NO_ID -1
+// Vehículos a los que se puede suscribir una conexión
+#define MAX_VEHICLE_SUBSCRIPTIONS 16
+
 // Estado del vehículo
 typedef struct {
     float speed;           // km/h
@@ -53,6 +100,10 @@ typedef struct {
 // Información del cliente
 typedef struct {
     int socket_fd;
+    // Modo threads: serializa las escrituras en el socket del thread del
+    // cliente y del broadcast (cada mensaje sale entero). Vive lo mismo que
+    // el descriptor: lo libera el registro al cerrarlo.
+    pthread_mutex_t* write_lock;
     char ip[16];
     int port;
     UserType user_type;
@@ -60,23 +111,52 @@ typedef struct {
     char auth_token[MAX_TOKEN];
     int authenticated;
     int active;
+    ProtocolEncoding encoding;
+    int rate_bucket;        // Bucket de frecuencia de telemetría (scheduler.c)
+    TelemetryMode telemetry_mode;
+    TelemetryFilter filter;
+    uint32_t vehicles[MAX_VEHICLE_SUBSCRIPTIONS];  // Vehículos suscritos
+    int vehicle_count;
 } ClientInfo;
 
-// Estructura de mensaje
-typedef struct {
-    char version[16];
-    MessageType type;
-    int length;
-    char username[MAX_USERNAME];
-    char auth_token[MAX_TOKEN];
-    char command[32];
-    char data[BUFFER_SIZE];
-} Message;
+// VATP/2.0: cabecera fija de 8 bytes, enteros y floats en little-endian
+//   [0] versión (2)  [1] tipo  [2..3] reservado (0)  [4..7] longitud del payload
+#define BINARY_VERSION 2
+#define BINARY_HEADER_SIZE 8
+// Registro TELEMETRY_DATA de tamaño fijo:
+//   speed, battery, temperature (float32), dirección (u8), en movimiento (u8), reservado (u16)
+// En una flota el payload sigue con el ID del vehículo (u32)
+#define TELEMETRY_RECORD_SIZE 16
+// TELEMETRY_DELTA: u32 secuencia, u8 flags (bit 0 = keyframe), u8 máscara de
+// campos, el ID del vehículo (u32) si lleva TELEMETRY_DELTA_VEHICLE, y luego
+// solo los campos presentes, en el orden del registro
+#define TELEMETRY_DELTA_KEYFRAME 0x01
+#define TELEMETRY_DELTA_VEHICLE 0x02
 
 // Funciones del protocolo
-int parse_message(const char* raw_msg, Message* msg);
+int parse_message_type(const char* name, int len, MessageType* type);
 int build_response(char* buffer, MessageType type, const char* data);
+int build_versioned_response(char* buffer, const char* version, MessageType type, const char* data);
 int build_telemetry_message(char* buffer, VehicleState* state);
+int format_uint(char* out, unsigned long value);
+int format_fixed2(char* out, float value);
+int build_binary_header(char* buffer, MessageType type, int length);
+int build_binary_response(char* buffer, MessageType type, const char* data);
+int build_binary_telemetry(char* buffer, const VehicleState* state);
+int decode_binary_telemetry(const char* payload, int len, VehicleState* state);
+int encode_response(char* buffer, ProtocolEncoding encoding, MessageType type, const char* data);
+int encode_telemetry(char* buffer, ProtocolEncoding encoding, int vehicle, const VehicleState* state);
+unsigned int telemetry_changed_fields(const VehicleState* old_state, const VehicleState* new_state);
+void telemetry_filter_init(TelemetryFilter* filter);
+int telemetry_filter_is_plain(const TelemetryFilter* filter);
+int telemetry_filter_equals(const TelemetryFilter* a, const TelemetryFilter* b);
+unsigned int telemetry_filter_changes(const TelemetryFilter* filter, const VehicleState* sent,
+                                      const VehicleState* state);
+int encode_telemetry_delta(char* buffer, ProtocolEncoding encoding, int vehicle, unsigned long seq,
+                           int keyframe, unsigned int fields, const VehicleState* state);
+int is_client_message_type(MessageType type);
+int direction_to_id(const char* direction);
+const char* direction_from_id(int id);
 CommandType parse_command(const char* cmd_str);
 const char* command_to_string(CommandType cmd);
 const char* message_type_to_string(MessageType type);
@@ -0,0 +1,1081 @@
+// ============= reactor.c =============
+// Reactor epoll edge-triggered con sockets no bloqueantes, repartido en
+// shards: cada shard es un thread con su propio socket de escucha
+// (SO_REUSEPORT, el kernel reparte las conexiones entrantes), su epoll, sus
+// conexiones y su shard del registro. Los shards no comparten locks entre sí;
+// el trabajo que los cruza (la telemetría) llega por el buzón de cada shard.
+//
+// Cada conexión es una pequeña máquina de estados (leyendo -> escribiendo ->
+// cerrando) y los mensajes VATP se despachan con la misma lógica que el modo
+// thread-por-cliente (process_client_message).
+//
+// Un COMMAND no espera al actor de vehículos: el shard lo encola y sigue con
+// las demás conexiones; el actor deja el resultado en el buzón del shard y
+// lo despierta por su eventfd. Mientras tanto esa conexión no parsea más
+// entrada, así que sus respuestas salen en orden.
+//
+// Con --mode uring cada shard usa un io_uring en lugar de epoll (uring.c): un
+// accept multishot en su socket de escucha, un recv multishot por conexión
+// sobre un anillo de buffers provistos, un read del eventfd del buzón y un
+// sendmsg en vuelo por conexión. Todo lo que se prepara al procesar un lote
+// de completados (p. ej. los envíos de un tick de telemetría) sale en la
+// siguiente y única llamada a io_uring_enter(), que además espera el lote
+// siguiente. Una conexión cerrada se libera cuando no le quedan peticiones
+// en vuelo.
+#define _GNU_SOURCE
+#include "reactor.h"
+#include "client_handler.h"
+#include "logger.h"
+#include "send_queue.h"
+#include "scheduler.h"
+#include "timeouts.h"
+#include "metrics.h"
+#include "uring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+extern volatile sig_atomic_t server_running;
+
+// Estados de la máquina de estados de cada conexión
+typedef enum {
+    CONN_READING,   // Esperando (o acumulando) un mensaje completo
+    CONN_WRITING,   // Respuesta pendiente; se espera EPOLLOUT para continuar
+    CONN_CLOSING,   // DISCONNECT recibido: cerrar al vaciar el buffer de salida
+    CONN_CLOSED     // Cerrada; se libera al terminar el ciclo de eventos
+} ConnState;
+
+typedef struct ReactorShard ReactorShard;
+typedef struct Connection Connection;
+
+// Suscripción de una conexión a un vehículo: nodo de la lista de suscriptores
+// de ese vehículo en su bucket (solo la recorre el broadcast)
+typedef struct Subscription {
+    Connection* conn;
+    uint32_t vehicle;
+    struct Subscription* prev;
+    struct Subscription* next;
+} Subscription;
+
+struct Connection {
+    ReactorShard* shard;
+    int fd;
+    int client_idx;
+    char ip[16];
+    int port;
+    ConnState state;
+
+    StreamParser parser;    // Buffer de recepción y estado del parseo incremental
+    ClientSession session;  // Codificación y bucket de frecuencia
+
+    SendQueue sendq;    // Frames pendientes de enviar (acotada)
+    ConnTimer timer;    // Plazos de handshake, AUTH e inactividad
+
+    // COMMAND en el actor: siguiente en la lista de resultados del shard y,
+    // con io_uring, lo recibido que no cabe en el parser mientras tanto
+    struct Connection* done_next;
+    char* stash;
+    int stash_len;
+
+    struct Connection* prev;
+    struct Connection* next;
+
+    // Suscripciones vigentes y el bucket de frecuencia en el que están
+    int bucket;
+    int sub_count;
+    Subscription subs[MAX_VEHICLE_SUBSCRIPTIONS];
+
+    // Peticiones en vuelo: las de io_uring (recv multishot y como mucho un
+    // sendmsg) y el COMMAND en el actor. No se libera con alguna pendiente.
+    int inflight;
+    int recv_armed;
+    int recv_paused;    // Recv cancelado hasta vaciar el stash
+    int send_armed;
+    struct msghdr send_msg;
+    struct iovec send_iov[SEND_QUEUE_IOV_MAX];
+};
+
+// Marcadores para distinguir el socket de escucha y el eventfd en epoll
+static int listen_tag;
+static int wakeup_tag;
+
+// io_uring: el user_data de cada petición es el puntero a la conexión (o a
+// un marcador) con el tipo de operación en los bits bajos
+#define URING_OP_RECV 1
+#define URING_OP_SEND 2
+#define URING_OP_CANCEL 3    // Su completado se ignora
+#define URING_OP_MASK 3ULL
+#define URING_RECV_GROUP 0
+// Lo que una conexión puede acumular sin parsear mientras su COMMAND espera
+// al actor: como mucho el anillo de buffers entero llega antes de que la
+// cancelación del recv surta efecto
+#define URING_STASH_MAX (URING_RECV_BUFFERS * URING_RECV_BUFFER_SIZE)
+
+struct ReactorShard {
+    int id;
+    int epoll_fd;
+    int wakeup_fd;
+    int listen_fd;
+    pthread_t thread;
+
+    Connection* connections;    // Conexiones vivas
+    Connection* graveyard;      // Cerradas en este ciclo
+    TimerWheel timers;          // Plazos de sus conexiones (ticks de TIMEOUT_TICK_MS)
+    // Por bucket, vehículo -> lista de suscripciones del shard (cada array
+    // se reserva con la primera suscripción del bucket)
+    Subscription** feeds[SCHEDULER_MAX_BUCKETS];
+    volatile int bucket_counts[SCHEDULER_MAX_BUCKETS];  // Suscripciones por bucket
+
+    // Buzón del shard: últimos frames de broadcast pendientes de cada bucket
+    // y máscara de buckets con frames por repartir (lo llena el thread de
+    // telemetría), y conexiones cuyo COMMAND ya aplicó el actor (las añade
+    // el actor). Lo vacía el shard al despertar por su eventfd.
+    pthread_mutex_t broadcast_mutex;
+    TelemetryFrames* broadcast_frames[SCHEDULER_MAX_BUCKETS];
+    unsigned int broadcast_buckets;
+    Connection* commands_done;
+
+    // Solo con io_uring (los crea el propio thread del shard)
+    Uring ring;
+    UringBufRing recv_buffers;
+    int accept_armed;
+    int wakeup_armed;
+    uint64_t wakeup_value;      // Destino del read del eventfd
+};
+
+static ReactorShard shards[REACTOR_MAX_SHARDS];
+static int shard_count = 0;
+static volatile int reactor_running = 0;
+static ServerMode backend = SERVER_MODE_EPOLL;
+
+// Apunta la conexión a las listas de sus vehículos en el bucket de su sesión
+// (ninguna si su filtro no pide telemetría periódica)
+static void conn_subscribe(Connection* conn) {
+    ReactorShard* shard = conn->shard;
+    int bucket = conn->session.rate_bucket;
+    if (conn->session.filter.fields == 0) return;
+
+    if (!shard->feeds[bucket]) {
+        shard->feeds[bucket] = calloc(telemetry_vehicle_count(), sizeof(Subscription*));
+        if (!shard->feeds[bucket]) {
+            log_error("Sin memoria para las suscripciones del reactor");
+            return;
+        }
+    }
+
+    conn->bucket = bucket;
+    for (int i = 0; i < conn->session.vehicle_count; i++) {
+        Subscription* sub = &conn->subs[conn->sub_count++];
+        Subscription** head = &shard->feeds[bucket][conn->session.vehicles[i]];
+        sub->conn = conn;
+        sub->vehicle = conn->session.vehicles[i];
+        sub->prev = NULL;
+        sub->next = *head;
+        if (*head) (*head)->prev = sub;
+        *head = sub;
+    }
+    shard->bucket_counts[bucket] += conn->sub_count;
+}
+
+static void conn_unsubscribe(Connection* conn) {
+    ReactorShard* shard = conn->shard;
+    for (int i = 0; i < conn->sub_count; i++) {
+        Subscription* sub = &conn->subs[i];
+        if (sub->prev) sub->prev->next = sub->next;
+        else shard->feeds[conn->bucket][sub->vehicle] = sub->next;
+        if (sub->next) sub->next->prev = sub->prev;
+    }
+    shard->bucket_counts[conn->bucket] -= conn->sub_count;
+    conn->sub_count = 0;
+}
+
+static void conn_close(Connection* conn) {
+    if (conn->state == CONN_CLOSED) return;
+
+    ReactorShard* shard = conn->shard;
+    if (conn->prev) conn->prev->next = conn->next;
+    else shard->connections = conn->next;
+    if (conn->next) conn->next->prev = conn->prev;
+    conn_unsubscribe(conn);
+    conn_timer_stop(&conn->timer);
+
+    conn->state = CONN_CLOSED;
+    // El registro cierra el descriptor más tarde (reclamación por épocas): se
+    // saca ya de epoll. Con io_uring el shutdown() de remove_client completa
+    // las peticiones en vuelo.
+    if (backend == SERVER_MODE_EPOLL) epoll_ctl(shard->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    remove_client(conn->client_idx);
+
+    // Puede haber eventos pendientes para esta conexión en el lote actual
+    conn->next = shard->graveyard;
+    shard->graveyard = conn;
+}
+
+// Libera las conexiones cerradas. Las que aún tienen peticiones de io_uring
+// en vuelo esperan a sus completados.
+static void free_graveyard(ReactorShard* shard) {
+    Connection** link = &shard->graveyard;
+    while (*link) {
+        Connection* conn = *link;
+        if (conn->inflight > 0) {
+            link = &conn->next;
+            continue;
+        }
+        *link = conn->next;
+        send_queue_clear(&conn->sendq);
+        free(conn->stash);
+        free(conn);
+    }
+}
+
+// Despierta al shard para que vacíe su buzón
+static void shard_wakeup(ReactorShard* shard) {
+    uint64_t one = 1;
+    if (write(shard->wakeup_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        log_error("No se pudo despertar al reactor");
+    }
+}
+
+// Siguiente SQE del anillo del shard. NULL si io_uring_enter() falla.
+static struct io_uring_sqe* shard_sqe(ReactorShard* shard) {
+    struct io_uring_sqe* sqe = uring_get_sqe(&shard->ring);
+    if (!sqe) log_error("Error en io_uring_enter(): cola de envío llena");
+    return sqe;
+}
+
+static int conn_arm_recv(Connection* conn) {
+    struct io_uring_sqe* sqe = shard_sqe(conn->shard);
+    if (!sqe) return -1;
+    uring_prep_recv_multishot(sqe, conn->fd, URING_RECV_GROUP,
+                              (uintptr_t)conn | URING_OP_RECV);
+    conn->recv_armed = 1;
+    conn->inflight++;
+    return 0;
+}
+
+// Deja de recibir mientras el COMMAND espera al actor y ya hay entrada en el
+// stash: lo que siga llegando espera en el socket y el cliente nota la
+// contrapresión de TCP, como con epoll. Se rearma en conn_resume.
+static void conn_pause_recv(Connection* conn) {
+    if (conn->recv_paused) return;
+    conn->recv_paused = 1;
+    if (!conn->recv_armed) return;
+
+    struct io_uring_sqe* sqe = shard_sqe(conn->shard);
+    if (sqe) {
+        uring_prep_cancel(sqe, (uintptr_t)conn | URING_OP_RECV,
+                          (uintptr_t)conn | URING_OP_CANCEL);
+    }
+}
+
+// io_uring: un sendmsg en vuelo por conexión con todo lo encolado; al
+// completarse se lanza el siguiente (conn_send_done)
+static int conn_flush_uring(Connection* conn) {
+    if (conn->send_armed) return 0;
+
+    int count = send_queue_prepare(&conn->sendq, conn->send_iov, SEND_QUEUE_IOV_MAX);
+    if (count == 0) {
+        if (conn->state == CONN_CLOSING) conn_close(conn);
+        else conn->state = CONN_READING;
+        return 0;
+    }
+
+    struct io_uring_sqe* sqe = shard_sqe(conn->shard);
+    if (!sqe) return -1;
+    memset(&conn->send_msg, 0, sizeof(conn->send_msg));
+    conn->send_msg.msg_iov = conn->send_iov;
+    conn->send_msg.msg_iovlen = count;
+    uring_prep_sendmsg(sqe, conn->fd, &conn->send_msg, MSG_NOSIGNAL,
+                       (uintptr_t)conn | URING_OP_SEND);
+    conn->send_armed = 1;
+    conn->inflight++;
+    if (conn->state == CONN_READING) conn->state = CONN_WRITING;
+    return 0;
+}
+
+// Envía todo lo posible de la cola de salida. Devuelve -1 si el socket falló.
+static int conn_flush(Connection* conn) {
+    if (backend == SERVER_MODE_URING) return conn_flush_uring(conn);
+
+    int status = send_queue_flush(&conn->sendq, conn->fd);
+    if (status < 0) return -1;
+
+    if (status == 0) {
+        // Socket lleno: se continúa con EPOLLOUT
+        if (conn->state == CONN_READING) conn->state = CONN_WRITING;
+        return 0;
+    }
+
+    if (conn->state == CONN_CLOSING) {
+        conn_close(conn);
+    } else {
+        conn->state = CONN_READING;
+    }
+    return 0;
+}
+
+// Encola un frame e intenta enviarlo de inmediato. Devuelve -1 si la cola
+// desbordó o el socket falló.
+static int conn_queue(Connection* conn, FrameKind kind, Frame* frame) {
+    SendQueueResult result = send_queue_push(&conn->sendq, kind, frame);
+    if (result == SQ_OVERFLOW) {
+        log_message(conn->ip, conn->port, "SLOW_CONSUMER",
+                   "Cola de salida llena, cliente desconectado");
+        return -1;
+    }
+    if (result == SQ_COALESCED) {
+        metrics_add(METRIC_BROADCAST_COALESCED, 1); // El frame reemplazado nunca salió
+    }
+
+    // Si ya esperamos EPOLLOUT no tiene sentido intentar enviar ahora
+    if (conn->state == CONN_WRITING) return 0;
+    return conn_flush(conn);
+}
+
+// Despacha todos los mensajes completos recibidos hasta ahora
+static void conn_process_input(Connection* conn) {
+    char response[BUFFER_SIZE];
+    MessageView msg;
+    int status;
+
+    while ((conn->state == CONN_READING || conn->state == CONN_WRITING) &&
+           !conn->session.command_pending) {
+        status = parser_next(&conn->parser, &msg);
+        if (status == PARSE_NEED_MORE) return;
+
+        int close_after = 0;
+        Frame* reply = NULL;
+        int len;
+        if (status < 0) {
+            // No cabe en el buffer de recepción o trama binaria rota: responder y cerrar
+            const char* error = status == PARSE_TOO_LARGE ? "Mensaje demasiado grande" :
+                                                            "Trama binaria inválida";
+            log_message(conn->ip, conn->port, "ERROR", error);
+            len = encode_response(response, conn->session.encoding, MSG_RESPONSE_ERROR, error);
+            close_after = 1;
+        } else {
+            len = process_client_message(conn->client_idx, &msg, conn->ip, conn->port,
+                                         &conn->session, response, &close_after, &reply);
+            parser_set_encoding(&conn->parser, conn->session.encoding);
+            conn_timer_update(&conn->shard->timers, &conn->timer, conn->session.phase);
+            if (msg.type == MSG_CONNECT) {
+                // CONNECT puede cambiar la frecuencia y los vehículos suscritos
+                conn_unsubscribe(conn);
+                conn_subscribe(conn);
+            }
+            if (conn->session.command_pending) {
+                // COMMAND en el actor: responde deliver_command_results()
+                conn->inflight++;
+                return;
+            }
+        }
+
+        // Las respuestas propias se empaquetan en un frame; la telemetría ya viene compartida
+        if (!reply) reply = frame_create(response, len, 0);
+        if (close_after) conn->state = CONN_CLOSING;
+
+        int queued = reply ? conn_queue(conn, FRAME_REPLY, reply) : -1;
+        frame_unref(reply);
+        if (queued < 0) {
+            conn_close(conn);
+            return;
+        }
+    }
+}
+
+static void conn_read(Connection* conn) {
+    while (conn->state != CONN_CLOSED && conn->state != CONN_CLOSING) {
+        // Lo que llegue mientras el COMMAND espera al actor se queda en el
+        // socket: se lee al reanudar (conn_resume)
+        if (conn->session.command_pending) return;
+
+        int space;
+        char* dst = parser_write_ptr(&conn->parser, &space);
+        ssize_t received = recv(conn->fd, dst, space, 0);
+
+        if (received > 0) {
+            metrics_add(METRIC_BYTES_IN, received);
+            parser_commit(&conn->parser, received);
+            conn_process_input(conn);
+            continue;
+        }
+
+        if (received < 0 && errno == EINTR) continue;
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+
+        // Cliente desconectado (received == 0) o error de socket
+        log_message(conn->ip, conn->port, "DISCONNECTED", "Conexión cerrada");
+        conn_close(conn);
+        return;
+    }
+}
+
+// io_uring: copia bytes recibidos al parser (que necesita el mensaje
+// contiguo) y despacha lo completo. Devuelve cuántos entraron: el parser se
+// llena si un COMMAND espera al actor o si el mensaje no cabe (y entonces
+// conn_process_input ya respondió "demasiado grande").
+static int conn_feed(Connection* conn, const char* data, int len) {
+    int used = 0;
+    while (used < len && conn->state != CONN_CLOSED && conn->state != CONN_CLOSING) {
+        int space;
+        char* dst = parser_write_ptr(&conn->parser, &space);
+        if (space <= 0) break;
+
+        int n = len - used < space ? len - used : space;
+        memcpy(dst, data + used, n);
+        parser_commit(&conn->parser, n);
+        used += n;
+        conn_process_input(conn);
+    }
+    return used;
+}
+
+// io_uring: guarda lo que no cupo en el parser mientras el COMMAND espera al
+// actor. Devuelve -1 si se supera URING_STASH_MAX.
+static int conn_stash(Connection* conn, const char* data, int len) {
+    if (conn->stash_len + len > URING_STASH_MAX) return -1;
+
+    char* stash = realloc(conn->stash, conn->stash_len + len);
+    if (!stash) return -1;
+    memcpy(stash + conn->stash_len, data, len);
+    conn->stash = stash;
+    conn->stash_len += len;
+    return 0;
+}
+
+// io_uring: bytes de un recv multishot, en el buffer provisto 'bid'. Se
+// copian al parser (o al stash) y el buffer vuelve al anillo enseguida.
+static void conn_recv_done(Connection* conn, const struct io_uring_cqe* cqe) {
+    ReactorShard* shard = conn->shard;
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        conn->recv_armed = 0;
+        conn->inflight--;
+    }
+
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        unsigned int bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        const char* data = uring_buf_ptr(&shard->recv_buffers, bid);
+        int left = cqe->res > 0 ? cqe->res : 0;
+
+        if (left > 0 && conn->state != CONN_CLOSED) metrics_add(METRIC_BYTES_IN, left);
+        // Si ya hay algo en el stash, lo nuevo va detrás
+        int used = conn->stash_len > 0 ? 0 : conn_feed(conn, data, left);
+        if (used < left && conn->session.command_pending && conn->state != CONN_CLOSED) {
+            // Lo recibido antes de que la cancelación surta efecto también va
+            // al stash
+            if (conn_stash(conn, data + used, left - used) < 0) {
+                log_message(conn->ip, conn->port, "SLOW_CONSUMER",
+                           "Demasiadas peticiones en espera, cliente desconectado");
+                conn_close(conn);
+            } else {
+                conn_pause_recv(conn);
+            }
+        }
+        uring_buf_recycle(&shard->recv_buffers, bid);
+    }
+    if (conn->state == CONN_CLOSED) return;
+
+    if (cqe->res == 0 || (cqe->res < 0 && cqe->res != -ENOBUFS && cqe->res != -ECANCELED)) {
+        // Cliente desconectado o error de socket
+        log_message(conn->ip, conn->port, "DISCONNECTED", "Conexión cerrada");
+        conn_close(conn);
+        return;
+    }
+
+    // El multishot termina si se agotan los buffers provistos (-ENOBUFS): se
+    // rearma, y para entonces este lote ya los habrá devuelto. Pausado por
+    // conn_pause_recv() lo rearma conn_resume().
+    if (!conn->recv_armed && !conn->recv_paused && conn->state != CONN_CLOSING &&
+        conn_arm_recv(conn) < 0) {
+        conn_close(conn);
+    }
+}
+
+static void conn_send_done(Connection* conn, int res) {
+    conn->send_armed = 0;
+    conn->inflight--;
+    if (conn->state == CONN_CLOSED) return;
+
+    if (res < 0) {
+        log_message(conn->ip, conn->port, "DISCONNECTED", "Error enviando al cliente");
+        conn_close(conn);
+        return;
+    }
+
+    send_queue_complete(&conn->sendq, res);
+    if (conn_flush(conn) < 0) conn_close(conn);
+}
+
+// Sigue con la entrada retenida mientras el COMMAND esperaba al actor
+static void conn_resume(Connection* conn) {
+    conn_process_input(conn);
+    if (backend == SERVER_MODE_EPOLL) {
+        conn_read(conn); // Edge-triggered: lo que llegó sigue en el socket
+    } else {
+        if (conn->stash_len > 0) {
+            int used = conn_feed(conn, conn->stash, conn->stash_len);
+            memmove(conn->stash, conn->stash + used, conn->stash_len - used);
+            conn->stash_len -= used;
+        }
+        if (conn->recv_paused && conn->stash_len == 0 && conn->state != CONN_CLOSED &&
+            conn->state != CONN_CLOSING) {
+            conn->recv_paused = 0;
+            // Si la cancelación aún no llegó, conn_recv_done rearma al recibirla
+            if (!conn->recv_armed && conn_arm_recv(conn) < 0) conn_close(conn);
+        }
+    }
+}
+
+// Aviso del actor, en su thread: el COMMAND de la conexión ya se aplicó. Va
+// al buzón del shard y se responde en el thread del shard.
+static void conn_command_done(ActorCompletion* slot) {
+    Connection* conn = (Connection*)((char*)slot - offsetof(Connection, session.completion));
+    ReactorShard* shard = conn->shard;
+
+    pthread_mutex_lock(&shard->broadcast_mutex);
+    conn->done_next = shard->commands_done;
+    shard->commands_done = conn;
+    pthread_mutex_unlock(&shard->broadcast_mutex);
+    shard_wakeup(shard);
+}
+
+// Responde los COMMAND que el actor ya aplicó y retoma la entrada de esas
+// conexiones
+static void deliver_command_results(ReactorShard* shard) {
+    pthread_mutex_lock(&shard->broadcast_mutex);
+    Connection* done = shard->commands_done;
+    shard->commands_done = NULL;
+    pthread_mutex_unlock(&shard->broadcast_mutex);
+
+    while (done) {
+        Connection* conn = done;
+        done = conn->done_next;
+        conn->inflight--;
+        if (conn->state == CONN_CLOSED) continue; // La libera free_graveyard
+
+        char response[BUFFER_SIZE];
+        int len = client_command_reply(&conn->session, conn->ip, conn->port, response);
+        Frame* reply = frame_create(response, len, 0);
+        int queued = reply ? conn_queue(conn, FRAME_REPLY, reply) : -1;
+        frame_unref(reply);
+        if (queued < 0) {
+            conn_close(conn);
+            continue;
+        }
+        conn_resume(conn);
+    }
+}
+
+// Da de alta una conexión aceptada en el shard
+static void register_connection(ReactorShard* shard, int fd, const struct sockaddr_in* client_addr) {
+    char client_ip[16];
+    inet_ntop(AF_INET, &client_addr->sin_addr, client_ip, sizeof(client_ip));
+    int client_port = ntohs(client_addr->sin_port);
+
+    char accept_msg[256];
+    sprintf(accept_msg, "Nueva conexión aceptada desde %s:%d", client_ip, client_port);
+    log_info(accept_msg);
+
+    int client_idx = add_client(shard->id, fd, client_ip, client_port);
+    if (client_idx < 0) {
+        log_error("No se pudo registrar el cliente");
+        close(fd);
+        return;
+    }
+
+    Connection* conn = calloc(1, sizeof(Connection));
+    if (!conn) {
+        log_error("Sin memoria para la conexión");
+        remove_client(client_idx);
+        return;
+    }
+    conn->shard = shard;
+    conn->fd = fd;
+    conn->client_idx = client_idx;
+    strcpy(conn->ip, client_ip);
+    conn->port = client_port;
+    conn->state = CONN_READING;
+    parser_init(&conn->parser);
+    client_session_init(&conn->session);
+    conn->session.completion.notify = conn_command_done;
+
+    if (backend == SERVER_MODE_URING) {
+        if (conn_arm_recv(conn) < 0) {
+            remove_client(client_idx);
+            free(conn);
+            return;
+        }
+    } else {
+        send_queue_enable_zerocopy(&conn->sendq, fd);
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = conn;
+        if (epoll_ctl(shard->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            log_error("Error registrando conexión en epoll");
+            remove_client(client_idx);
+            free(conn);
+            return;
+        }
+    }
+
+    conn->next = shard->connections;
+    if (shard->connections) shard->connections->prev = conn;
+    shard->connections = conn;
+    conn_subscribe(conn);
+    conn_timer_start(&shard->timers, &conn->timer, fd);
+}
+
+static void accept_connections(ReactorShard* shard) {
+    while (1) {
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+        int fd = accept4(shard->listen_fd, (struct sockaddr*)&client_addr, &client_len,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK && server_running) {
+                log_error("Error aceptando conexión");
+            }
+            return;
+        }
+
+        register_connection(shard, fd, &client_addr);
+    }
+}
+
+// io_uring: un completado del accept multishot
+static void accept_done(ReactorShard* shard, const struct io_uring_cqe* cqe) {
+    if (!(cqe->flags & IORING_CQE_F_MORE)) shard->accept_armed = 0; // Se rearma en el bucle
+
+    if (cqe->res < 0) {
+        if (server_running && cqe->res != -ECANCELED) log_error("Error aceptando conexión");
+        return;
+    }
+
+    int fd = cqe->res;
+    struct sockaddr_in client_addr;
+    socklen_t client_len = sizeof(client_addr);
+    if (!server_running || getpeername(fd, (struct sockaddr*)&client_addr, &client_len) < 0) {
+        close(fd);
+        return;
+    }
+    register_connection(shard, fd, &client_addr);
+}
+
+// Cierra las conexiones cuyo plazo venció
+static void expire_connections(ReactorShard* shard) {
+    TimerEntry* expired = timer_wheel_advance(&shard->timers, timeouts_now());
+    while (expired) {
+        Connection* conn = (Connection*)((char*)expired - offsetof(Connection, timer));
+        expired = expired->next;
+
+        TimeoutKind kind = conn_timer_fire(&shard->timers, &conn->timer);
+        if (kind != TIMEOUT_NONE) {
+            log_message(conn->ip, conn->port, "TIMEOUT", timeout_reason(kind));
+            conn_close(conn);
+        }
+    }
+}
+
+// Reparte los frames de telemetría del buzón del shard a los suscriptores de
+// cada vehículo en los buckets que vencieron. Las colas de un mismo vehículo,
+// bucket, codificación, modo y filtro comparten el frame: no se copia por
+// conexión.
+static void deliver_broadcast(ReactorShard* shard) {
+    TelemetryFrames* sets[SCHEDULER_MAX_BUCKETS];
+    pthread_mutex_lock(&shard->broadcast_mutex);
+    unsigned int due = shard->broadcast_buckets;
+    shard->broadcast_buckets = 0;
+    memcpy(sets, shard->broadcast_frames, sizeof(sets));
+    memset(shard->broadcast_frames, 0, sizeof(shard->broadcast_frames));
+    pthread_mutex_unlock(&shard->broadcast_mutex);
+    if (!due) return;
+
+    unsigned long start = metrics_now_ns();
+    unsigned long sends = 0, failures = 0;
+
+    for (int bucket = 0; bucket < SCHEDULER_MAX_BUCKETS; bucket++) {
+        if (!(due & (1u << bucket)) || !sets[bucket]) continue;
+
+        for (int v = 0; v < sets[bucket]->count && shard->feeds[bucket]; v++) {
+            const VehicleFrames* vf = &sets[bucket]->vehicles[v];
+            Subscription* sub = shard->feeds[bucket][vf->vehicle];
+            while (sub) {
+                // Cerrar la conexión la saca de la lista: avanzar antes
+                Subscription* next = sub->next;
+                Connection* conn = sub->conn;
+                Frame* frame = telemetry_frames_select(vf, conn->session.encoding,
+                                                       conn->session.telemetry_mode,
+                                                       &conn->session.filter);
+                if (frame && conn->state != CONN_CLOSING) {
+                    if (conn_queue(conn, FRAME_BROADCAST, frame) < 0) {
+                        log_message(conn->ip, conn->port, "DISCONNECTED",
+                                   "Cliente desconectado durante broadcast");
+                        conn_close(conn);
+                        failures++;
+                    } else {
+                        sends++;
+                    }
+                }
+                sub = next;
+            }
+        }
+        telemetry_frames_release(sets[bucket]);
+    }
+
+    metrics_add(METRIC_BROADCAST_SENDS, sends);
+    metrics_add(METRIC_BROADCAST_FAILURES, failures);
+    metrics_record(METRIC_HIST_FANOUT, metrics_now_ns() - start);
+}
+
+// Deja los frames de cada bucket de 'due' en el buzón de un shard
+static void post_broadcast(ReactorShard* shard, TelemetryFrames* const* sets, unsigned int due) {
+    TelemetryFrames* previous[SCHEDULER_MAX_BUCKETS] = { NULL };
+
+    pthread_mutex_lock(&shard->broadcast_mutex);
+    for (int bucket = 0; bucket < SCHEDULER_MAX_BUCKETS; bucket++) {
+        if (!(due & (1u << bucket))) continue;
+
+        // Si el shard no llegó a repartir el anterior, el bucket recibe el
+        // más nuevo (un cliente delta verá el salto de secuencia y pedirá RESYNC)
+        previous[bucket] = shard->broadcast_frames[bucket];
+        shard->broadcast_frames[bucket] = sets[bucket] ? telemetry_frames_ref(sets[bucket]) : NULL;
+    }
+    shard->broadcast_buckets |= due;
+    pthread_mutex_unlock(&shard->broadcast_mutex);
+
+    for (int bucket = 0; bucket < SCHEDULER_MAX_BUCKETS; bucket++) {
+        telemetry_frames_release(previous[bucket]);
+    }
+    shard_wakeup(shard);
+}
+
+// Llamado desde el thread de telemetría: publica los frames de cada bucket de
+// 'due' en el buzón de cada shard. Devuelve el número de suscripciones que
+// los recibirán.
+int reactor_broadcast(TelemetryFrames* const* sets, unsigned int due) {
+    int count = 0;
+
+    for (int i = 0; i < shard_count; i++) {
+        post_broadcast(&shards[i], sets, due);
+        for (int bucket = 0; bucket < SCHEDULER_MAX_BUCKETS; bucket++) {
+            if (due & (1u << bucket)) count += shards[i].bucket_counts[bucket];
+        }
+    }
+    return count;
+}
+
+int reactor_is_running() {
+    return reactor_running;
+}
+
+// Sube el límite de descriptores abiertos al máximo permitido
+static void raise_fd_limit() {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+// Socket de escucha adicional en el mismo puerto que 'listen_fd'. El kernel
+// reparte las conexiones entre todos los sockets del grupo SO_REUSEPORT.
+static int open_reuseport_socket(int listen_fd) {
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    if (getsockname(listen_fd, (struct sockaddr*)&addr, &addr_len) < 0) return -1;
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    int opt = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0 ||
+        bind(fd, (struct sockaddr*)&addr, addr_len) < 0 ||
+        listen(fd, SOMAXCONN) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int shard_init(ReactorShard* shard, int id, int listen_fd) {
+    memset(shard, 0, sizeof(ReactorShard));
+    shard->id = id;
+    shard->listen_fd = listen_fd;
+    pthread_mutex_init(&shard->broadcast_mutex, NULL);
+    timer_wheel_init(&shard->timers, timeouts_now());
+
+    shard->epoll_fd = -1;
+    shard->ring.fd = -1;
+
+    int flags = fcntl(listen_fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(listen_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        log_error("No se pudo poner el socket de escucha en modo no bloqueante");
+        return -1;
+    }
+
+    shard->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (shard->wakeup_fd < 0) {
+        log_error("No se pudo crear el eventfd del reactor");
+        return -1;
+    }
+
+    // Con io_uring el anillo lo crea el thread del shard (SINGLE_ISSUER)
+    if (backend == SERVER_MODE_URING) return 0;
+
+    shard->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (shard->epoll_fd < 0) {
+        log_error("No se pudo crear la instancia epoll");
+        close(shard->wakeup_fd);
+        return -1;
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = &listen_tag;
+    epoll_ctl(shard->epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = &wakeup_tag;
+    epoll_ctl(shard->epoll_fd, EPOLL_CTL_ADD, shard->wakeup_fd, &ev);
+    return 0;
+}
+
+// Bucle de eventos de un shard con epoll
+static void shard_loop_epoll(ReactorShard* shard) {
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+
+    while (server_running) {
+        // Timeout para revisar server_running aunque la señal llegue a otro
+        // thread y, con conexiones abiertas, para avanzar sus plazos
+        int n = epoll_wait(shard->epoll_fd, events, REACTOR_MAX_EVENTS,
+                           shard->connections ? TIMEOUT_TICK_MS : 1000);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            log_error("Error en epoll_wait()");
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            void* ptr = events[i].data.ptr;
+            uint32_t mask = events[i].events;
+
+            if (ptr == &listen_tag) {
+                accept_connections(shard);
+                continue;
+            }
+            if (ptr == &wakeup_tag) {
+                uint64_t counter;
+                while (read(shard->wakeup_fd, &counter, sizeof(counter)) > 0) {}
+                deliver_broadcast(shard);
+                deliver_command_results(shard);
+                continue;
+            }
+
+            Connection* conn = ptr;
+            if (conn->state == CONN_CLOSED) continue;
+
+            // EPOLLERR también avisa de envíos zero-copy completados
+            if ((mask & EPOLLERR) && conn->sendq.zc_head) {
+                send_queue_reap_zerocopy(&conn->sendq, conn->fd);
+            }
+            if (mask & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                conn_read(conn);
+            }
+            if ((mask & EPOLLOUT) && conn->state != CONN_CLOSED && conn->sendq.head) {
+                if (conn_flush(conn) < 0) conn_close(conn);
+            }
+        }
+
+        expire_connections(shard);
+        free_graveyard(shard);
+    }
+}
+
+// io_uring: arma el accept multishot y el read del eventfd si no están en vuelo
+static void arm_shard_requests(ReactorShard* shard) {
+    struct io_uring_sqe* sqe;
+    if (!shard->accept_armed && server_running && (sqe = shard_sqe(shard))) {
+        uring_prep_accept_multishot(sqe, shard->listen_fd, SOCK_NONBLOCK | SOCK_CLOEXEC,
+                                    (uintptr_t)&listen_tag);
+        shard->accept_armed = 1;
+    }
+    if (!shard->wakeup_armed && (sqe = shard_sqe(shard))) {
+        uring_prep_read(sqe, shard->wakeup_fd, &shard->wakeup_value, sizeof(shard->wakeup_value),
+                        (uintptr_t)&wakeup_tag);
+        shard->wakeup_armed = 1;
+    }
+}
+
+// Procesa todos los completados disponibles
+static void reap_completions(ReactorShard* shard) {
+    struct io_uring_cqe cqe;
+    while (uring_next_cqe(&shard->ring, &cqe)) {
+        void* ptr = (void*)(uintptr_t)(cqe.user_data & ~URING_OP_MASK);
+        int op = cqe.user_data & URING_OP_MASK;
+
+        if (ptr == &listen_tag) {
+            accept_done(shard, &cqe);
+        } else if (ptr == &wakeup_tag) {
+            shard->wakeup_armed = 0;
+            deliver_broadcast(shard);
+            deliver_command_results(shard);
+        } else if (op == URING_OP_RECV) {
+            conn_recv_done(ptr, &cqe);
+        } else if (op == URING_OP_SEND) {
+            conn_send_done(ptr, cqe.res);
+        }
+    }
+}
+
+// Bucle de eventos de un shard con io_uring: una llamada al sistema por
+// vuelta envía lo preparado en la anterior y espera los completados
+static void shard_loop_uring(ReactorShard* shard) {
+    int ret = uring_init(&shard->ring, URING_QUEUE_DEPTH);
+    if (ret == 0) {
+        ret = uring_buf_ring_init(&shard->ring, &shard->recv_buffers, URING_RECV_GROUP,
+                                  URING_RECV_BUFFERS, URING_RECV_BUFFER_SIZE);
+    }
+    if (ret < 0) {
+        log_error("No se pudo crear el io_uring del shard");
+        server_running = 0;
+        uring_exit(&shard->ring);
+        return;
+    }
+
+    while (server_running) {
+        arm_shard_requests(shard);
+        if (uring_submit_and_wait(&shard->ring, shard->connections ? TIMEOUT_TICK_MS : 1000) < 0) {
+            log_error("Error en io_uring_enter()");
+            break;
+        }
+        reap_completions(shard);
+        expire_connections(shard);
+        free_graveyard(shard);
+    }
+
+    while (shard->connections) {
+        conn_close(shard->connections);
+    }
+    // Esperar (con un límite) los completados de las peticiones en vuelo
+    for (int i = 0; i < 10 && shard->graveyard; i++) {
+        uring_submit_and_wait(&shard->ring, 100);
+        reap_completions(shard);
+        free_graveyard(shard);
+    }
+    // Cerrar el anillo cancela lo que quede; después ya se puede liberar todo
+    uring_exit(&shard->ring);
+    uring_buf_ring_free(&shard->recv_buffers);
+}
+
+static void* shard_loop(void* arg) {
+    ReactorShard* shard = arg;
+
+    if (backend == SERVER_MODE_URING) shard_loop_uring(shard);
+    else shard_loop_epoll(shard);
+
+    while (shard->connections) {
+        conn_close(shard->connections);
+    }
+    free_graveyard(shard);
+    // Los COMMAND aún en el actor retienen su conexión hasta el resultado
+    for (int i = 0; i < 10 && shard->graveyard; i++) {
+        usleep(10000);
+        deliver_command_results(shard);
+        free_graveyard(shard);
+    }
+
+    // Frames que quedaron en el buzón sin repartir
+    for (int bucket = 0; bucket < SCHEDULER_MAX_BUCKETS; bucket++) {
+        telemetry_frames_release(shard->broadcast_frames[bucket]);
+        free(shard->feeds[bucket]);
+    }
+    close(shard->wakeup_fd);
+    if (shard->epoll_fd >= 0) close(shard->epoll_fd);
+    return NULL;
+}
+
+// Comprueba que el kernel admite todo lo que usa el backend io_uring
+static int uring_available() {
+    Uring ring;
+    UringBufRing buffers;
+    if (uring_init(&ring, 8) < 0) return 0;
+    int ok = uring_buf_ring_init(&ring, &buffers, URING_RECV_GROUP, 8, 64) == 0;
+    uring_exit(&ring);
+    if (ok) uring_buf_ring_free(&buffers);
+    return ok;
+}
+
+// Arranca 'count' shards. El 0 usa 'listen_fd' (abierto con SO_REUSEPORT si
+// count > 1) y corre en el thread que llama; el resto abre su propio socket
+// en el mismo puerto y corre en un thread propio. Vuelve al parar el servidor.
+int reactor_run(int listen_fd, int count, ServerMode mode) {
+    raise_fd_limit();
+
+    backend = mode == SERVER_MODE_URING ? SERVER_MODE_URING : SERVER_MODE_EPOLL;
+    if (backend == SERVER_MODE_URING && !uring_available()) {
+        log_error("io_uring no disponible (se necesita Linux 6.1+): se usa epoll");
+        backend = SERVER_MODE_EPOLL;
+    }
+
+    if (count < 1) count = 1;
+    if (count > REACTOR_MAX_SHARDS) count = REACTOR_MAX_SHARDS;
+
+    for (shard_count = 0; shard_count < count; shard_count++) {
+        int fd = shard_count == 0 ? listen_fd : open_reuseport_socket(listen_fd);
+        if (fd < 0) {
+            log_error("No se pudo abrir el socket SO_REUSEPORT de un shard");
+            break;
+        }
+        if (shard_init(&shards[shard_count], shard_count, fd) < 0) {
+            if (shard_count > 0) close(fd);
+            break;
+        }
+    }
+    if (shard_count == 0) return -1;
+
+    reactor_running = 1;
+    int started = 1;
+    while (started < shard_count &&
+           pthread_create(&shards[started].thread, NULL, shard_loop, &shards[started]) == 0) {
+        started++;
+    }
+    if (started < shard_count) {
+        log_error("No se pudo crear el thread de un shard");
+        server_running = 0;
+    }
+
+    char msg[128];
+    if (backend == SERVER_MODE_URING) {
+        sprintf(msg, "Reactor io_uring iniciado (accept y recv multishot, %d shards)", shard_count);
+    } else {
+        sprintf(msg, "Reactor epoll iniciado (edge-triggered, %d shards)", shard_count);
+    }
+    log_info(msg);
+
+    shard_loop(&shards[0]);
+
+    for (int i = 1; i < shard_count; i++) {
+        if (i < started) pthread_join(shards[i].thread, NULL);
+        close(shards[i].listen_fd);
+    }
+    reactor_running = 0;
+
+    log_info(backend == SERVER_MODE_URING ? "Reactor io_uring detenido" : "Reactor epoll detenido");
+    return 0;
+}
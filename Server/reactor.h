@@ -0,0 +1,28 @@
+// ============= reactor.h =============
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include "protocol.h"
+#include "frame.h"
+#include "telemetry.h"
+#include "registry.h"
+
+// Máximo de eventos procesados por llamada a epoll_wait()
+#define REACTOR_MAX_EVENTS 256
+// Máximo de shards (threads reactor); cada uno usa un shard del registro
+#define REACTOR_MAX_SHARDS REGISTRY_MAX_SHARDS
+
+// Modos de I/O del servidor, seleccionables al arrancar
+typedef enum {
+    SERVER_MODE_EPOLL,    // Reactor epoll no bloqueante (por defecto)
+    SERVER_MODE_THREADS,  // Un thread por cliente (modo clásico, fallback)
+    SERVER_MODE_URING     // Los mismos shards sobre io_uring (Linux 6.1+)
+} ServerMode;
+
+// 'mode' es SERVER_MODE_EPOLL o SERVER_MODE_URING (si io_uring no está
+// disponible se usa epoll)
+int reactor_run(int listen_fd, int shards, ServerMode mode);
+int reactor_is_running();
+int reactor_broadcast(TelemetryFrames* const* sets, unsigned int due);
+
+#endif // REACTOR_H
@@ -0,0 +1,526 @@
+// ============= recorder.c =============
+// Grabación y reproducción de la telemetría.
+//
+// Grabar: los escritores del estado (el actor de vehículos y, durante un paso
+// de la física, los threads de la simulación con sus bloques) dejan cada
+// versión y cada comando aplicado en una cola MPSC en memoria (la misma cola
+// de Vyukov del logger), lo que solo cuesta copiar 40 bytes: el tick de
+// simulación nunca espera por disco. Un thread grabador vacía la cola en el
+// segmento actual, un archivo de tamaño fijo mapeado con mmap; al llenarse
+// abre el siguiente y añade una entrada al índice. La cabecera de cada
+// segmento lleva cuántos registros son válidos y se actualiza tras
+// escribirlos, así que un cierre abrupto pierde como mucho el último lote.
+//
+// Reproducir: un thread recorre los segmentos del índice y publica cada
+// estado grabado, respetando los tiempos (1x) o sin pausas.
+#define _GNU_SOURCE
+#include "recorder.h"
+#include "telemetry.h"
+#include "actor.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+extern volatile sig_atomic_t server_running;
+
+#define SEGMENT_MAGIC "VATPSEG1"
+#define INDEX_MAGIC "VATPIDX1"
+#define RECORDS_PER_SEGMENT ((RECORDER_SEGMENT_SIZE - sizeof(SegmentHeader)) / sizeof(RecorderRecord))
+
+typedef struct {
+    char magic[8];
+    uint32_t segment;
+    uint32_t record_size;
+    uint64_t count;             // Registros válidos (se escribe tras ellos)
+    int64_t first_timestamp_ns;
+    uint8_t reserved[32];
+} SegmentHeader;
+
+// Una entrada del índice por segmento, en orden
+typedef struct {
+    uint32_t segment;
+    uint32_t reserved;
+    uint64_t first_version;
+    int64_t first_timestamp_ns;
+} IndexEntry;
+
+_Static_assert(sizeof(RecorderRecord) == 40, "RecorderRecord debe medir 40 bytes");
+_Static_assert(sizeof(SegmentHeader) == 64, "SegmentHeader debe medir 64 bytes");
+
+// Cola MPSC: los productores son los escritores del estado (el actor y los
+// threads de la simulación, cada uno con sus vehículos) y el consumidor el
+// thread grabador
+typedef struct {
+    atomic_size_t seq;
+    RecorderRecord record;
+} QueueCell;
+
+static QueueCell* queue = NULL;         // queue_size celdas, se reserva en recorder_start()
+static size_t queue_size = 0;
+static atomic_size_t enqueue_pos = 0;
+static size_t dequeue_pos = 0;          // Solo lo usa el thread grabador
+static atomic_ulong dropped = 0;
+
+static char base_path[256];
+static int index_fd = -1;
+static int segment_fd = -1;
+static SegmentHeader* segment = NULL;   // Mapeo del segmento actual
+static uint32_t segment_number = 0;
+static uint64_t total_records = 0;
+
+static atomic_int recording = 0;
+static pthread_t recorder_thread;
+
+static int64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void segment_path(char* out, size_t size, const char* base, uint32_t number) {
+    snprintf(out, size, "%s.%06u.seg", base, number);
+}
+
+static RecorderRecord* segment_records(SegmentHeader* header) {
+    return (RecorderRecord*)(header + 1);
+}
+
+static void record_to_state(const RecorderRecord* record, VehicleState* state) {
+    state->speed = record->speed;
+    state->battery = record->battery;
+    state->temperature = record->temperature;
+    strcpy(state->direction, direction_from_id(record->direction));
+    state->is_moving = record->moving;
+}
+
+// ---- Lectura (arranque en frío y reproducción) ----
+
+// Lee las entradas del índice. Devuelve cuántas hay (-1 si no existe o no es válido).
+static int read_index(const char* base, IndexEntry** entries) {
+    char path[300];
+    snprintf(path, sizeof(path), "%s.idx", base);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    char magic[8];
+    if (fstat(fd, &st) < 0 || read(fd, magic, sizeof(magic)) != sizeof(magic) ||
+        memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    int count = (st.st_size - sizeof(magic)) / sizeof(IndexEntry);
+    *entries = calloc(count > 0 ? count : 1, sizeof(IndexEntry));
+    if (!*entries) {
+        close(fd);
+        return -1;
+    }
+    ssize_t bytes = read(fd, *entries, count * sizeof(IndexEntry));
+    close(fd);
+    if (bytes < 0) return -1;
+    return bytes / sizeof(IndexEntry); // Una entrada a medio escribir se ignora
+}
+
+// Mapea un segmento en solo lectura. Devuelve su cabecera (NULL si no es
+// válido) y deja en 'size' el tamaño del mapeo.
+static SegmentHeader* map_segment(const char* base, uint32_t number, size_t* size) {
+    char path[300];
+    segment_path(path, sizeof(path), base, number);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(SegmentHeader)) {
+        close(fd);
+        return NULL;
+    }
+
+    SegmentHeader* header = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (header == MAP_FAILED) return NULL;
+
+    // Nunca más registros de los que caben en el archivo
+    uint64_t capacity = (st.st_size - sizeof(SegmentHeader)) / sizeof(RecorderRecord);
+    if (memcmp(header->magic, SEGMENT_MAGIC, 8) != 0 ||
+        header->record_size != sizeof(RecorderRecord) || header->count > capacity) {
+        munmap(header, st.st_size);
+        return NULL;
+    }
+    *size = st.st_size;
+    return header;
+}
+
+// Arranque en frío: publica el último estado grabado de cada vehículo de la
+// flota, recorriendo la grabación de atrás hacia delante hasta encontrarlos
+// todos. Devuelve cuántos se restauraron.
+static int restore_last_states(const char* base, const IndexEntry* entries, int count) {
+    int fleet = telemetry_vehicle_count();
+    unsigned char* seen = calloc(fleet, 1);
+    if (!seen) return 0;
+
+    int restored = 0;
+    for (int i = count - 1; i >= 0 && restored < fleet; i--) {
+        size_t size;
+        SegmentHeader* header = map_segment(base, entries[i].segment, &size);
+        if (!header) continue;
+
+        const RecorderRecord* records = segment_records(header);
+        for (uint64_t r = header->count; r > 0 && restored < fleet; r--) {
+            uint32_t vehicle = records[r - 1].vehicle;
+            if (vehicle >= (uint32_t)fleet || seen[vehicle]) continue;
+
+            VehicleState state;
+            record_to_state(&records[r - 1], &state);
+            actor_set_state(vehicle, &state);
+            seen[vehicle] = 1;
+            restored++;
+        }
+        munmap(header, size);
+    }
+    free(seen);
+    actor_sync(); // Los estados están aplicados antes de aceptar clientes
+    return restored;
+}
+
+// ---- Escritura (thread grabador) ----
+
+// Cierra el segmento actual dejando el archivo del tamaño de sus registros
+static void close_segment() {
+    if (!segment) return;
+
+    size_t used = sizeof(SegmentHeader) + segment->count * sizeof(RecorderRecord);
+    msync(segment, RECORDER_SEGMENT_SIZE, MS_SYNC);
+    munmap(segment, RECORDER_SEGMENT_SIZE);
+    if (ftruncate(segment_fd, used) < 0) {
+        log_error("No se pudo recortar el segmento de la grabación");
+    }
+    close(segment_fd);
+    segment = NULL;
+    segment_fd = -1;
+}
+
+// Abre el siguiente segmento para un registro que empieza en 'first'
+static int open_segment(const RecorderRecord* first) {
+    char path[300];
+    segment_number++;
+    segment_path(path, sizeof(path), base_path, segment_number);
+
+    segment_fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (segment_fd < 0) return -1;
+
+    void* map = MAP_FAILED;
+    if (ftruncate(segment_fd, RECORDER_SEGMENT_SIZE) == 0) {
+        map = mmap(NULL, RECORDER_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, segment_fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        close(segment_fd);
+        segment_fd = -1;
+        return -1;
+    }
+
+    segment = map;
+    memcpy(segment->magic, SEGMENT_MAGIC, 8);
+    segment->segment = segment_number;
+    segment->record_size = sizeof(RecorderRecord);
+    segment->count = 0;
+    segment->first_timestamp_ns = first->timestamp_ns;
+
+    IndexEntry entry = { segment_number, 0, first->version, first->timestamp_ns };
+    if (write(index_fd, &entry, sizeof(entry)) != sizeof(entry)) {
+        log_error("No se pudo escribir el índice de la grabación");
+    }
+    return 0;
+}
+
+static int append_record(const RecorderRecord* record) {
+    if (!segment || segment->count == RECORDS_PER_SEGMENT) {
+        close_segment();
+        if (open_segment(record) < 0) return -1;
+    }
+    segment_records(segment)[segment->count] = *record;
+    // El contador se publica después del registro: quien lea el archivo
+    // nunca ve un registro a medio escribir
+    atomic_thread_fence(memory_order_release);
+    segment->count++;
+    total_records++;
+    return 0;
+}
+
+// Vacía la cola en el segmento. Devuelve los registros escritos.
+static int drain_queue() {
+    int written = 0;
+
+    while (1) {
+        QueueCell* cell = &queue[dequeue_pos & (queue_size - 1)];
+        if (atomic_load_explicit(&cell->seq, memory_order_acquire) != dequeue_pos + 1) break;
+
+        if (append_record(&cell->record) < 0) {
+            log_error("No se pudo abrir un segmento de la grabación: registro perdido");
+            atomic_fetch_add(&dropped, 1);
+        }
+        // La celda vuelve a estar libre para la siguiente vuelta del ring
+        atomic_store_explicit(&cell->seq, dequeue_pos + queue_size, memory_order_release);
+        dequeue_pos++;
+        written++;
+    }
+    return written;
+}
+
+static void* recorder_loop(void* arg) {
+    (void)arg;
+    struct timespec idle = { 0, RECORDER_IDLE_SLEEP_NS };
+
+    while (atomic_load(&recording)) {
+        if (drain_queue() == 0) nanosleep(&idle, NULL);
+    }
+    drain_queue(); // Lo que quedó encolado antes de recorder_close()
+    return NULL;
+}
+
+// ---- API de grabación ----
+
+int recorder_start(const char* base) {
+    if (strlen(base) >= sizeof(base_path)) return -1;
+    strcpy(base_path, base);
+
+    // Hueco para varios ticks de toda la flota: un tick no puede desbordarla
+    // aunque el grabador se retrase un poco
+    size_t needed = (size_t)telemetry_vehicle_count() * RECORDER_QUEUE_TICKS;
+    queue_size = RECORDER_QUEUE_MIN;
+    while (queue_size < needed) queue_size *= 2;
+    queue = malloc(queue_size * sizeof(QueueCell));
+    if (!queue) return -1;
+    for (size_t i = 0; i < queue_size; i++) {
+        atomic_init(&queue[i].seq, i);
+    }
+
+    // Continuar una grabación previa: nuevo segmento tras el último indexado
+    IndexEntry* entries = NULL;
+    int count = read_index(base, &entries);
+    if (count > 0) segment_number = entries[count - 1].segment;
+
+    char path[300];
+    snprintf(path, sizeof(path), "%s.idx", base);
+    index_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (index_fd < 0) {
+        free(entries);
+        return -1;
+    }
+
+    if (count < 0) {
+        // Índice nuevo (o ilegible): se empieza de cero
+        if (ftruncate(index_fd, 0) < 0 || write(index_fd, INDEX_MAGIC, 8) != 8) {
+            close(index_fd);
+            index_fd = -1;
+            return -1;
+        }
+        segment_number = 0;
+    }
+
+    atomic_store(&recording, 1);
+    if (pthread_create(&recorder_thread, NULL, recorder_loop, NULL) != 0) {
+        atomic_store(&recording, 0);
+        close(index_fd);
+        index_fd = -1;
+        free(entries);
+        return -1;
+    }
+
+    char msg[320];
+    snprintf(msg, sizeof(msg), "Grabando la telemetría en %s (segmento %u en adelante)",
+             base, segment_number + 1);
+    log_info(msg);
+
+    // Con el grabador en marcha, así los estados restaurados abren el segmento nuevo
+    int restored = count > 0 ? restore_last_states(base, entries, count) : 0;
+    free(entries);
+    return restored;
+}
+
+void recorder_close() {
+    if (!atomic_exchange(&recording, 0)) return;
+    pthread_join(recorder_thread, NULL);
+
+    close_segment();
+    close(index_fd);
+    index_fd = -1;
+
+    char msg[160];
+    snprintf(msg, sizeof(msg), "Grabación cerrada: %lu registros escritos, %lu descartados",
+             (unsigned long)total_records, atomic_load(&dropped));
+    log_info(msg);
+}
+
+unsigned long recorder_dropped() {
+    return atomic_load(&dropped);
+}
+
+// Reserva una celda libre de la cola. Devuelve NULL si está llena.
+static QueueCell* queue_claim(size_t* pos_out) {
+    size_t pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+
+    while (1) {
+        QueueCell* cell = &queue[pos & (queue_size - 1)];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                *pos_out = pos;
+                return cell;
+            }
+        } else if (diff < 0) {
+            return NULL; // Lleno: el grabador aún no liberó esta celda
+        } else {
+            pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+// Productor (el escritor del vehículo): copiar a la cola y seguir
+static void enqueue(RecordType type, uint32_t vehicle, CommandType command,
+                    const VehicleState* state, unsigned long version) {
+    if (!atomic_load_explicit(&recording, memory_order_relaxed)) return;
+
+    size_t pos;
+    QueueCell* cell = queue_claim(&pos);
+    if (!cell) {
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        return; // Cola llena: el tick no espera al disco
+    }
+
+    RecorderRecord* record = &cell->record;
+    memset(record, 0, sizeof(*record));
+    record->type = type;
+    record->command = command;
+    record->vehicle = vehicle;
+    record->direction = direction_to_id(state->direction);
+    record->moving = state->is_moving ? 1 : 0;
+    record->version = version;
+    record->timestamp_ns = now_ns();
+    record->speed = state->speed;
+    record->battery = state->battery;
+    record->temperature = state->temperature;
+
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+}
+
+void recorder_record_state(uint32_t vehicle, const VehicleState* state, unsigned long version) {
+    enqueue(RECORD_STATE, vehicle, 0, state, version);
+}
+
+void recorder_record_command(uint32_t vehicle, CommandType command, const VehicleState* state,
+                             unsigned long version) {
+    enqueue(RECORD_COMMAND, vehicle, command, state, version);
+}
+
+// ---- Reproducción ----
+
+typedef struct {
+    char base[256];
+    ReplaySpeed speed;
+    IndexEntry* entries;
+    int count;
+} ReplayCtx;
+
+static void add_ns(struct timespec* ts, int64_t ns) {
+    ts->tv_sec += ns / 1000000000LL;
+    ts->tv_nsec += ns % 1000000000LL;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static void* replay_loop(void* arg) {
+    ReplayCtx* ctx = arg;
+    unsigned long applied = 0;
+    int64_t previous_ns = 0;
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    for (int i = 0; i < ctx->count && server_running; i++) {
+        size_t size;
+        SegmentHeader* header = map_segment(ctx->base, ctx->entries[i].segment, &size);
+        if (!header) {
+            char msg[128];
+            snprintf(msg, sizeof(msg), "Segmento %u de la grabación ilegible, se salta",
+                     ctx->entries[i].segment);
+            log_error(msg);
+            continue;
+        }
+
+        const RecorderRecord* records = segment_records(header);
+        for (uint64_t r = 0; r < header->count && server_running; r++) {
+            if (ctx->speed == REPLAY_REALTIME && previous_ns) {
+                // Pausa absoluta: los errores de cada sleep no se acumulan
+                int64_t gap = records[r].timestamp_ns - previous_ns;
+                if (gap < 0) gap = 0;
+                if (gap > REPLAY_MAX_GAP_MS * 1000000LL) gap = REPLAY_MAX_GAP_MS * 1000000LL;
+                add_ns(&deadline, gap);
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+            }
+            previous_ns = records[r].timestamp_ns;
+
+            VehicleState state;
+            record_to_state(&records[r], &state);
+            actor_set_state(records[r].vehicle, &state); // Ignora IDs fuera de la flota
+            applied++;
+        }
+        munmap(header, size);
+    }
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "Reproducción terminada: %lu estados aplicados", applied);
+    log_info(msg);
+
+    free(ctx->entries);
+    free(ctx);
+    return NULL;
+}
+
+int replay_start(const char* base, ReplaySpeed speed) {
+    ReplayCtx* ctx = calloc(1, sizeof(ReplayCtx));
+    if (!ctx || strlen(base) >= sizeof(ctx->base)) {
+        free(ctx);
+        return -1;
+    }
+    strcpy(ctx->base, base);
+    ctx->speed = speed;
+    ctx->count = read_index(base, &ctx->entries);
+    if (ctx->count < 0) {
+        free(ctx);
+        return -1;
+    }
+    // El thread libera ctx al terminar, quizá antes de llegar al log
+    int segments = ctx->count;
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, replay_loop, ctx) != 0) {
+        free(ctx->entries);
+        free(ctx);
+        return -1;
+    }
+    pthread_detach(thread);
+
+    char msg[320];
+    snprintf(msg, sizeof(msg), "Reproduciendo %s (%d segmentos, %s)", base, segments,
+             speed == REPLAY_REALTIME ? "1x" : "máxima velocidad");
+    log_info(msg);
+    return 0;
+}
@@ -0,0 +1,64 @@
+// ============= recorder.h =============
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include "protocol.h"
+#include <stdint.h>
+
+// Una grabación es un índice "<base>.idx" y segmentos "<base>.NNNNNN.seg" de
+// tamaño fijo, mapeados en memoria. Cada segmento empieza con una cabecera de
+// 64 bytes seguida de registros de 40 bytes (orden de bytes del host).
+#define RECORDER_SEGMENT_SIZE (4 * 1024 * 1024)
+// Registros pendientes entre los escritores del estado y el thread grabador.
+// Un tick de simulación encola un registro por vehículo, así que la cola se
+// dimensiona al arrancar para RECORDER_QUEUE_TICKS ticks de toda la flota
+// (potencia de 2, como mínimo RECORDER_QUEUE_MIN)
+#define RECORDER_QUEUE_MIN 65536
+#define RECORDER_QUEUE_TICKS 4
+// Pausa del thread grabador cuando no hay nada pendiente
+#define RECORDER_IDLE_SLEEP_NS (10 * 1000 * 1000)
+// Reproducción a 1x: las pausas mayores (p. ej. entre dos sesiones) se acortan a esto
+#define REPLAY_MAX_GAP_MS 10000
+
+typedef enum {
+    RECORD_STATE = 1,       // Nueva versión del estado (simulación, arranque)
+    RECORD_COMMAND = 2      // Comando aplicado, con el estado que dejó
+} RecordType;
+
+typedef struct {
+    uint8_t type;           // RecordType
+    uint8_t command;        // CommandType (RECORD_COMMAND)
+    uint8_t direction;      // ID de VATP/2.0
+    uint8_t moving;
+    uint32_t vehicle;       // ID del vehículo en la flota
+    uint64_t version;       // Versión del estado en la sesión que grabó
+    int64_t timestamp_ns;   // CLOCK_REALTIME
+    float speed;
+    float battery;
+    float temperature;
+    uint32_t reserved2;
+} RecorderRecord;
+
+typedef enum {
+    REPLAY_REALTIME,        // Respeta los tiempos de la grabación (1x)
+    REPLAY_MAX              // Tan rápido como se pueda
+} ReplaySpeed;
+
+// Abre (o continúa) la grabación. Si ya existía, restaura el último estado
+// grabado de cada vehículo (arranque en frío). Devuelve cuántos se
+// restauraron, o -1 si falla.
+int recorder_start(const char* base);
+void recorder_close();
+// Registros descartados con la cola llena (o sin segmento donde escribirlos)
+unsigned long recorder_dropped();
+// Las llama el escritor del vehículo (el actor, o el thread de la simulación
+// que publica su bloque) tras publicar la versión. Nunca bloquean: con la
+// cola llena el registro se descarta y se cuenta.
+void recorder_record_state(uint32_t vehicle, const VehicleState* state, unsigned long version);
+void recorder_record_command(uint32_t vehicle, CommandType command, const VehicleState* state,
+                             unsigned long version);
+
+// Reproduce una grabación sobre el estado del vehículo en un thread propio
+int replay_start(const char* base, ReplaySpeed speed);
+
+#endif // RECORDER_H
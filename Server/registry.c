@@ -0,0 +1,379 @@
+// ============= registry.c =============
+// Registro dinámico de clientes, repartido en shards (uno por reactor).
+//
+// - Cada shard tiene su tabla de slots, que crece al doble cuando se llena,
+//   y una pila de slots libres: altas y bajas en O(1) amortizado.
+// - El índice de cliente codifica shard y slot, así que las bajas y los
+//   cambios van directos a su shard sin índices globales.
+// - Los escritores de un shard se serializan con su propio mutex: reactores
+//   distintos nunca compiten por el mismo lock. Los lectores (broadcast,
+//   LIST_USERS) recorren las tablas sin lock. Los registros nunca se
+//   modifican en sitio: cada cambio publica una copia nueva y la vieja se
+//   libera cuando ningún lector puede seguir viéndola (reclamación por
+//   épocas, estilo RCU, también por shard).
+// - Los lectores hacen I/O sobre el socket del registro (broadcast en modo
+//   threads), así que el descriptor de un cliente dado de baja se cierra con
+//   el último registro: mientras un lector pueda verlo, su número no se
+//   reutiliza para otra conexión.
+#include "registry.h"
+#include "metrics.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+typedef struct {
+    int capacity;
+    _Atomic(ClientInfo*) slots[];
+} ClientTable;
+
+// Memoria desenganchada pendiente de liberar (y el socket de una baja)
+typedef struct Retired {
+    void* ptr;
+    int fd;                         // -1 si no hay socket que cerrar
+    pthread_mutex_t* write_lock;    // El del socket, si lo hay
+    unsigned long epoch;
+    struct Retired* next;
+} Retired;
+
+// Épocas: un lector se anota en el contador de la época vigente. Lo retirado
+// en la época E se libera cuando la época del shard llega a E + 2, y solo se
+// avanza de E a E + 1 si no quedan lectores anotados en E - 1.
+typedef struct {
+    pthread_mutex_t mutex;
+    _Atomic(ClientTable*) table;
+    atomic_int count;
+    atomic_ulong epoch;
+    atomic_int epoch_readers[3];
+
+    // Solo accesible por escritores (bajo mutex)
+    int* free_slots;
+    int free_count;
+    Retired* retired_list;
+} __attribute__((aligned(64))) RegistryShard; // Sin false sharing entre shards
+
+static RegistryShard shards[REGISTRY_MAX_SHARDS];
+
+// Índice de cliente <-> (shard, slot)
+#define CLIENT_INDEX(shard, slot) ((slot) * REGISTRY_MAX_SHARDS + (shard))
+#define INDEX_SHARD(index) ((index) % REGISTRY_MAX_SHARDS)
+#define INDEX_SLOT(index) ((index) / REGISTRY_MAX_SHARDS)
+
+static RegistryShard* shard_of(int client_idx) {
+    if (client_idx < 0) return NULL;
+    return &shards[INDEX_SHARD(client_idx)];
+}
+
+static unsigned long epoch_enter(RegistryShard* shard) {
+    while (1) {
+        unsigned long epoch = atomic_load(&shard->epoch);
+        atomic_fetch_add(&shard->epoch_readers[epoch % 3], 1);
+        if (atomic_load(&shard->epoch) == epoch) return epoch;
+        atomic_fetch_sub(&shard->epoch_readers[epoch % 3], 1);
+    }
+}
+
+static void epoch_exit(RegistryShard* shard, unsigned long epoch) {
+    atomic_fetch_sub(&shard->epoch_readers[epoch % 3], 1);
+}
+
+// Avanza la época si es posible y libera lo que ya nadie puede ver.
+// Requiere el mutex del shard.
+static void epoch_reclaim(RegistryShard* shard) {
+    unsigned long epoch = atomic_load(&shard->epoch);
+    if (atomic_load(&shard->epoch_readers[(epoch + 2) % 3]) == 0) {
+        atomic_store(&shard->epoch, ++epoch);
+    }
+
+    Retired** link = &shard->retired_list;
+    while (*link) {
+        Retired* item = *link;
+        if (item->epoch + 2 <= epoch) {
+            *link = item->next;
+            if (item->fd >= 0) close(item->fd);
+            if (item->write_lock) {
+                pthread_mutex_destroy(item->write_lock);
+                free(item->write_lock);
+            }
+            free(item->ptr);
+            free(item);
+        } else {
+            link = &item->next;
+        }
+    }
+}
+
+// Retira 'ptr' y, si 'removed' no es NULL (una baja), también su socket.
+// Requiere el mutex del shard.
+static void retire(RegistryShard* shard, void* ptr, const ClientInfo* removed) {
+    Retired* item = malloc(sizeof(Retired));
+    if (item) {
+        item->ptr = ptr;
+        item->fd = removed ? removed->socket_fd : -1;
+        item->write_lock = removed ? removed->write_lock : NULL;
+        item->epoch = atomic_load(&shard->epoch);
+        item->next = shard->retired_list;
+        shard->retired_list = item;
+    }
+    epoch_reclaim(shard);
+}
+
+// Duplica la tabla de slots. Requiere el mutex del shard.
+static int grow_table(RegistryShard* shard) {
+    ClientTable* old = atomic_load(&shard->table);
+    int old_cap = old ? old->capacity : 0;
+    int new_cap = old_cap ? old_cap * 2 : REGISTRY_INITIAL_CAPACITY;
+
+    ClientTable* table = malloc(sizeof(ClientTable) + new_cap * sizeof(ClientInfo*));
+    int* slots = realloc(shard->free_slots, new_cap * sizeof(int));
+    if (!table || !slots) {
+        free(table);
+        if (slots) shard->free_slots = slots;
+        return -1;
+    }
+    shard->free_slots = slots;
+
+    table->capacity = new_cap;
+    for (int i = 0; i < new_cap; i++) {
+        atomic_init(&table->slots[i], i < old_cap ? atomic_load(&old->slots[i]) : NULL);
+    }
+
+    // Slots nuevos a la pila de libres (los más bajos quedan arriba)
+    for (int i = new_cap - 1; i >= old_cap; i--) {
+        shard->free_slots[shard->free_count++] = i;
+    }
+
+    atomic_store(&shard->table, table);
+    if (old) retire(shard, old, NULL);
+    return 0;
+}
+
+void registry_init() {
+    for (int i = 0; i < REGISTRY_MAX_SHARDS; i++) {
+        pthread_mutex_init(&shards[i].mutex, NULL);
+    }
+}
+
+// Da de alta un cliente en el shard indicado. Devuelve su índice de cliente.
+int registry_add(int shard_id, int socket_fd, const char* ip, int port) {
+    if (shard_id < 0 || shard_id >= REGISTRY_MAX_SHARDS) return -1;
+    RegistryShard* shard = &shards[shard_id];
+
+    ClientInfo* client = calloc(1, sizeof(ClientInfo));
+    pthread_mutex_t* write_lock = malloc(sizeof(pthread_mutex_t));
+    if (!client || !write_lock) {
+        free(client);
+        free(write_lock);
+        return -1;
+    }
+    pthread_mutex_init(write_lock, NULL);
+
+    client->socket_fd = socket_fd;
+    client->write_lock = write_lock;
+    strncpy(client->ip, ip, 15);
+    client->ip[15] = '\0';
+    client->port = port;
+    client->user_type = USER_OBSERVER;
+    client->authenticated = 0;
+    client->active = 1;
+    client->vehicles[0] = 0;    // Sin Vehicle-Id: el vehículo 0
+    client->vehicle_count = 1;
+    telemetry_filter_init(&client->filter);
+
+    metrics_lock(&shard->mutex, METRIC_LOCK_CLIENTS);
+
+    if (shard->free_count == 0 && grow_table(shard) < 0) {
+        pthread_mutex_unlock(&shard->mutex);
+        pthread_mutex_destroy(write_lock);
+        free(write_lock);
+        free(client);
+        return -1;
+    }
+
+    int slot = shard->free_slots[--shard->free_count];
+    atomic_store(&atomic_load(&shard->table)->slots[slot], client);
+    atomic_fetch_add(&shard->count, 1);
+
+    pthread_mutex_unlock(&shard->mutex);
+    return CLIENT_INDEX(shard_id, slot);
+}
+
+// Da de baja un cliente. Copia el registro en 'removed' (si no es NULL) y
+// devuelve 0, o -1 si no estaba registrado. El registro se queda con el
+// socket y lo cierra cuando ya ningún lector puede verlo; el llamador lo
+// corta antes con shutdown() si quiere que el otro extremo lo note ya.
+int registry_remove(int client_idx, ClientInfo* removed) {
+    RegistryShard* shard = shard_of(client_idx);
+    if (!shard) return -1;
+    int slot = INDEX_SLOT(client_idx);
+
+    metrics_lock(&shard->mutex, METRIC_LOCK_CLIENTS);
+
+    ClientTable* table = atomic_load(&shard->table);
+    ClientInfo* client = NULL;
+    if (table && slot < table->capacity) {
+        client = atomic_exchange(&table->slots[slot], NULL);
+    }
+    if (!client) {
+        pthread_mutex_unlock(&shard->mutex);
+        return -1;
+    }
+
+    shard->free_slots[shard->free_count++] = slot;
+    atomic_fetch_sub(&shard->count, 1);
+
+    if (removed) *removed = *client;
+    retire(shard, client, client);
+
+    pthread_mutex_unlock(&shard->mutex);
+    return 0;
+}
+
+// Publica una copia modificada del registro del slot (copy-on-write).
+// Requiere el mutex del shard.
+static ClientInfo* begin_update(RegistryShard* shard, int slot, ClientInfo** old) {
+    ClientTable* table = atomic_load(&shard->table);
+    if (!table || slot >= table->capacity) return NULL;
+
+    *old = atomic_load(&table->slots[slot]);
+    if (!*old) return NULL;
+
+    ClientInfo* copy = malloc(sizeof(ClientInfo));
+    if (copy) *copy = **old;
+    return copy;
+}
+
+static void commit_update(RegistryShard* shard, int slot, ClientInfo* old, ClientInfo* copy) {
+    atomic_store(&atomic_load(&shard->table)->slots[slot], copy);
+    retire(shard, old, NULL);
+}
+
+void registry_set_user_type(int client_idx, UserType user_type) {
+    RegistryShard* shard = shard_of(client_idx);
+    if (!shard) return;
+    int slot = INDEX_SLOT(client_idx);
+
+    metrics_lock(&shard->mutex, METRIC_LOCK_CLIENTS);
+
+    ClientInfo* old;
+    ClientInfo* copy = begin_update(shard, slot, &old);
+    if (copy) {
+        copy->user_type = user_type;
+        commit_update(shard, slot, old, copy);
+    }
+
+    pthread_mutex_unlock(&shard->mutex);
+}
+
+void registry_set_session(int client_idx, ProtocolEncoding encoding, int rate_bucket,
+                          TelemetryMode telemetry_mode, const TelemetryFilter* filter,
+                          const uint32_t* vehicles, int vehicle_count) {
+    RegistryShard* shard = shard_of(client_idx);
+    if (!shard) return;
+    int slot = INDEX_SLOT(client_idx);
+
+    metrics_lock(&shard->mutex, METRIC_LOCK_CLIENTS);
+
+    ClientInfo* old;
+    ClientInfo* copy = begin_update(shard, slot, &old);
+    if (copy) {
+        copy->encoding = encoding;
+        copy->rate_bucket = rate_bucket;
+        copy->telemetry_mode = telemetry_mode;
+        copy->filter = *filter;
+        memcpy(copy->vehicles, vehicles, vehicle_count * sizeof(uint32_t));
+        copy->vehicle_count = vehicle_count;
+        commit_update(shard, slot, old, copy);
+    }
+
+    pthread_mutex_unlock(&shard->mutex);
+}
+
+void registry_set_auth(int client_idx, const char* username, const char* token) {
+    RegistryShard* shard = shard_of(client_idx);
+    if (!shard) return;
+    int slot = INDEX_SLOT(client_idx);
+
+    metrics_lock(&shard->mutex, METRIC_LOCK_CLIENTS);
+
+    ClientInfo* old;
+    ClientInfo* copy = begin_update(shard, slot, &old);
+    if (copy) {
+        copy->authenticated = 1;
+        strncpy(copy->username, username, MAX_USERNAME - 1);
+        copy->username[MAX_USERNAME - 1] = '\0';
+        strncpy(copy->auth_token, token, MAX_TOKEN - 1);
+        copy->auth_token[MAX_TOKEN - 1] = '\0';
+        commit_update(shard, slot, old, copy);
+    }
+
+    pthread_mutex_unlock(&shard->mutex);
+}
+
+// Copia consistente del registro de un cliente. Devuelve 0 si no existe.
+int registry_get(int client_idx, ClientInfo* out) {
+    RegistryShard* shard = shard_of(client_idx);
+    if (!shard) return 0;
+    int slot = INDEX_SLOT(client_idx);
+
+    unsigned long epoch = epoch_enter(shard);
+
+    int found = 0;
+    ClientTable* table = atomic_load(&shard->table);
+    if (table && slot < table->capacity) {
+        ClientInfo* client = atomic_load(&table->slots[slot]);
+        if (client) {
+            *out = *client;
+            found = 1;
+        }
+    }
+
+    epoch_exit(shard, epoch);
+    return found;
+}
+
+// Recorre los clientes registrados en todos los shards sin bloquear a los
+// escritores. Devuelve el número de clientes visitados.
+int registry_for_each(ClientVisitor visitor, void* ctx) {
+    int visited = 0;
+
+    for (int s = 0; s < REGISTRY_MAX_SHARDS; s++) {
+        RegistryShard* shard = &shards[s];
+        if (!atomic_load(&shard->table)) continue;
+
+        unsigned long epoch = epoch_enter(shard);
+
+        ClientTable* table = atomic_load(&shard->table);
+        for (int i = 0; i < table->capacity; i++) {
+            ClientInfo* client = atomic_load(&table->slots[i]);
+            if (client) {
+                visitor(client, ctx);
+                visited++;
+            }
+        }
+
+        epoch_exit(shard, epoch);
+    }
+    return visited;
+}
+
+int registry_count() {
+    int count = 0;
+    for (int s = 0; s < REGISTRY_MAX_SHARDS; s++) {
+        count += atomic_load(&shards[s].count);
+    }
+    return count;
+}
+
+// Avanza las épocas de los shards con algo pendiente de liberar. Las altas y
+// bajas ya lo hacen; esto cubre los shards sin actividad, donde el socket de
+// la última baja quedaría abierto. Nunca espera por el mutex de un shard.
+void registry_collect() {
+    for (int s = 0; s < REGISTRY_MAX_SHARDS; s++) {
+        RegistryShard* shard = &shards[s];
+        if (pthread_mutex_trylock(&shard->mutex) != 0) continue;
+        if (shard->retired_list) epoch_reclaim(shard);
+        pthread_mutex_unlock(&shard->mutex);
+    }
+}
@@ -0,0 +1,34 @@
+// ============= registry.h =============
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include "protocol.h"
+
+// Capacidad inicial de la tabla de cada shard (crece al doble cuando se llena)
+#define REGISTRY_INITIAL_CAPACITY 64
+// Shards del registro: uno por reactor (el modo threads usa solo el 0)
+#define REGISTRY_MAX_SHARDS 64
+
+// Visitante para recorrer los clientes sin tomar el lock de escritura
+typedef void (*ClientVisitor)(const ClientInfo* client, void* ctx);
+
+void registry_init();
+
+// Escritores (serializados con el mutex de su shard)
+int registry_add(int shard, int socket_fd, const char* ip, int port);
+int registry_remove(int client_idx, ClientInfo* removed);
+void registry_set_user_type(int client_idx, UserType user_type);
+void registry_set_session(int client_idx, ProtocolEncoding encoding, int rate_bucket,
+                          TelemetryMode telemetry_mode, const TelemetryFilter* filter,
+                          const uint32_t* vehicles, int vehicle_count);
+void registry_set_auth(int client_idx, const char* username, const char* token);
+
+// Lectores (sin lock, protegidos por reclamación por épocas)
+int registry_get(int client_idx, ClientInfo* out);
+int registry_for_each(ClientVisitor visitor, void* ctx);
+int registry_count();
+
+// Libera lo retirado que ya nadie puede ver (periódicamente, desde telemetría)
+void registry_collect();
+
+#endif // REGISTRY_H
@@ -0,0 +1,225 @@
+// ============= scheduler.c =============
+// Planificador de ticks periódicos con deadlines absolutos.
+//
+// Cada bucket agrupa a los suscriptores de una misma frecuencia y tiene su
+// próximo deadline en CLOCK_MONOTONIC. Un timerfd armado con TFD_TIMER_ABSTIME
+// despierta al thread en el deadline más cercano; como el siguiente deadline
+// se calcula sumando el periodo al anterior (no a la hora de despertar), el
+// tiempo de simulación y envío no se acumula como deriva.
+//
+// Si el thread llega tarde más de un periodo, los ticks perdidos se cuentan
+// y no se recuperan en ráfaga: se salta al siguiente deadline futuro.
+#include "scheduler.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#define NSEC_PER_SEC 1000000000LL
+#define NSEC_PER_MSEC 1000000LL
+
+typedef struct {
+    int period_ms;          // 0 = bucket libre
+    int subscribers;
+    long long deadline_ns;
+    unsigned long ticks;
+    unsigned long missed;
+    long long jitter_sum_ns;
+    long long jitter_max_ns;
+} RateBucket;
+
+static pthread_mutex_t scheduler_mutex = PTHREAD_MUTEX_INITIALIZER;
+static RateBucket buckets[SCHEDULER_MAX_BUCKETS];
+static int timer_fd = -1;
+static int wakeup_fd = -1;      // Avisa al thread de que apareció un bucket nuevo
+
+static long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+// Frecuencia pedida -> periodo en ms, dentro del rango admitido
+static int rate_to_period_ms(double rate_hz) {
+    if (!(rate_hz > 0)) rate_hz = SCHEDULER_DEFAULT_RATE_HZ;
+
+    double period = 1000.0 / rate_hz;
+    if (period < SCHEDULER_MIN_PERIOD_MS) return SCHEDULER_MIN_PERIOD_MS;
+    if (period > SCHEDULER_MAX_PERIOD_MS) return SCHEDULER_MAX_PERIOD_MS;
+    return (int)(period + 0.5);
+}
+
+void scheduler_init() {
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (timer_fd < 0 || wakeup_fd < 0) {
+        log_error("No se pudo crear el timerfd del planificador");
+    }
+
+    // El bucket 0 (frecuencia por defecto) existe siempre
+    pthread_mutex_lock(&scheduler_mutex);
+    memset(buckets, 0, sizeof(buckets));
+    buckets[SCHEDULER_DEFAULT_BUCKET].period_ms = rate_to_period_ms(SCHEDULER_DEFAULT_RATE_HZ);
+    buckets[SCHEDULER_DEFAULT_BUCKET].deadline_ns =
+        now_ns() + buckets[SCHEDULER_DEFAULT_BUCKET].period_ms * NSEC_PER_MSEC;
+    pthread_mutex_unlock(&scheduler_mutex);
+}
+
+// Suscribe a la frecuencia pedida y devuelve su bucket. Si ya hay un bucket
+// con ese periodo se comparte; si no quedan libres, se usa el más cercano.
+int scheduler_subscribe(double rate_hz) {
+    int period_ms = rate_to_period_ms(rate_hz);
+    int bucket = -1, free_bucket = -1, closest = SCHEDULER_DEFAULT_BUCKET;
+
+    pthread_mutex_lock(&scheduler_mutex);
+
+    for (int i = 0; i < SCHEDULER_MAX_BUCKETS; i++) {
+        if (buckets[i].period_ms == period_ms) {
+            bucket = i;
+            break;
+        }
+        if (buckets[i].period_ms == 0) {
+            if (free_bucket < 0) free_bucket = i;
+        } else if (abs(buckets[i].period_ms - period_ms) <
+                   abs(buckets[closest].period_ms - period_ms)) {
+            closest = i;
+        }
+    }
+
+    int created = 0;
+    if (bucket < 0 && free_bucket >= 0) {
+        bucket = free_bucket;
+        memset(&buckets[bucket], 0, sizeof(RateBucket));
+        buckets[bucket].period_ms = period_ms;
+        buckets[bucket].deadline_ns = now_ns() + period_ms * NSEC_PER_MSEC;
+        created = 1;
+    } else if (bucket < 0) {
+        bucket = closest;
+    }
+    buckets[bucket].subscribers++;
+
+    pthread_mutex_unlock(&scheduler_mutex);
+
+    if (created) {
+        // El thread puede estar durmiendo hasta un deadline más lejano
+        uint64_t one = 1;
+        if (write(wakeup_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            log_error("No se pudo despertar al planificador");
+        }
+    }
+    return bucket;
+}
+
+void scheduler_unsubscribe(int bucket) {
+    if (bucket < 0 || bucket >= SCHEDULER_MAX_BUCKETS) return;
+
+    pthread_mutex_lock(&scheduler_mutex);
+    if (buckets[bucket].subscribers > 0) buckets[bucket].subscribers--;
+    if (buckets[bucket].subscribers == 0 && bucket != SCHEDULER_DEFAULT_BUCKET) {
+        buckets[bucket].period_ms = 0; // Se libera para otra frecuencia
+    }
+    pthread_mutex_unlock(&scheduler_mutex);
+}
+
+int scheduler_period_ms(int bucket) {
+    if (bucket < 0 || bucket >= SCHEDULER_MAX_BUCKETS) return 0;
+
+    pthread_mutex_lock(&scheduler_mutex);
+    int period_ms = buckets[bucket].period_ms;
+    pthread_mutex_unlock(&scheduler_mutex);
+    return period_ms;
+}
+
+// Bloquea hasta el próximo deadline y devuelve la máscara de buckets que
+// vencieron (bit i = bucket i). Actualiza los contadores de jitter y pérdidas.
+unsigned int scheduler_wait() {
+    while (1) {
+        long long earliest = -1;
+
+        pthread_mutex_lock(&scheduler_mutex);
+        for (int i = 0; i < SCHEDULER_MAX_BUCKETS; i++) {
+            if (buckets[i].period_ms == 0) continue;
+            if (earliest < 0 || buckets[i].deadline_ns < earliest) {
+                earliest = buckets[i].deadline_ns;
+            }
+        }
+        pthread_mutex_unlock(&scheduler_mutex);
+
+        struct itimerspec spec;
+        memset(&spec, 0, sizeof(spec));
+        spec.it_value.tv_sec = earliest / NSEC_PER_SEC;
+        spec.it_value.tv_nsec = earliest % NSEC_PER_SEC;
+        if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+            log_error("Error armando el timerfd del planificador");
+            return 0;
+        }
+
+        struct pollfd fds[2] = {
+            { .fd = timer_fd, .events = POLLIN },
+            { .fd = wakeup_fd, .events = POLLIN }
+        };
+        if (poll(fds, 2, -1) < 0 && errno != EINTR) {
+            log_error("Error esperando en el planificador");
+            return 0;
+        }
+
+        uint64_t counter;
+        while (read(timer_fd, &counter, sizeof(counter)) > 0) {}
+        while (read(wakeup_fd, &counter, sizeof(counter)) > 0) {}
+
+        long long now = now_ns();
+        unsigned int due = 0;
+
+        pthread_mutex_lock(&scheduler_mutex);
+        for (int i = 0; i < SCHEDULER_MAX_BUCKETS; i++) {
+            RateBucket* b = &buckets[i];
+            if (b->period_ms == 0 || b->deadline_ns > now) continue;
+
+            long long period_ns = b->period_ms * NSEC_PER_MSEC;
+            long long late = now - b->deadline_ns;
+            long long skipped = late / period_ns;
+
+            b->ticks++;
+            b->missed += skipped;
+            b->jitter_sum_ns += late;
+            if (late > b->jitter_max_ns) b->jitter_max_ns = late;
+
+            // Siguiente deadline absoluto: sin deriva y sin ráfagas de recuperación
+            b->deadline_ns += (skipped + 1) * period_ns;
+            due |= 1u << i;
+        }
+        pthread_mutex_unlock(&scheduler_mutex);
+
+        if (due) return due;
+    }
+}
+
+// Copia los contadores de los buckets en uso. Devuelve cuántos se copiaron.
+int scheduler_get_stats(RateBucketStats* stats, int max) {
+    int count = 0;
+
+    pthread_mutex_lock(&scheduler_mutex);
+    for (int i = 0; i < SCHEDULER_MAX_BUCKETS && count < max; i++) {
+        if (buckets[i].period_ms == 0) continue;
+
+        stats[count].bucket = i;
+        stats[count].period_ms = buckets[i].period_ms;
+        stats[count].subscribers = buckets[i].subscribers;
+        stats[count].ticks = buckets[i].ticks;
+        stats[count].missed = buckets[i].missed;
+        stats[count].jitter_sum_ns = buckets[i].jitter_sum_ns;
+        stats[count].jitter_max_ns = buckets[i].jitter_max_ns;
+        count++;
+    }
+    pthread_mutex_unlock(&scheduler_mutex);
+
+    return count;
+}
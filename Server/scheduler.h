@@ -0,0 +1,33 @@
+// ============= scheduler.h =============
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+// Buckets de frecuencia: los clientes con la misma frecuencia comparten bucket
+// (y el mismo frame en cada tick). El índice cabe en una máscara de bits.
+#define SCHEDULER_MAX_BUCKETS 16
+// Frecuencias admitidas: de 0.1 Hz (10 s) a 100 Hz (10 ms)
+#define SCHEDULER_MIN_PERIOD_MS 10
+#define SCHEDULER_MAX_PERIOD_MS 10000
+// Frecuencia por defecto (la del broadcast original, cada 10 s). Es el bucket 0.
+#define SCHEDULER_DEFAULT_RATE_HZ 0.1
+#define SCHEDULER_DEFAULT_BUCKET 0
+
+// Contadores de un bucket (jitter = retraso del despertar sobre el deadline)
+typedef struct {
+    int bucket;
+    int period_ms;
+    int subscribers;
+    unsigned long ticks;
+    unsigned long missed;       // Deadlines saltados por llegar tarde más de un periodo
+    long long jitter_sum_ns;
+    long long jitter_max_ns;
+} RateBucketStats;
+
+void scheduler_init();
+int scheduler_subscribe(double rate_hz);
+void scheduler_unsubscribe(int bucket);
+int scheduler_period_ms(int bucket);
+unsigned int scheduler_wait();
+int scheduler_get_stats(RateBucketStats* stats, int max);
+
+#endif // SCHEDULER_H
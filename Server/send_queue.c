@@ -0,0 +1,302 @@
+// ============= send_queue.c =============
+// Cola de salida acotada por conexión. Las respuestas se encolan siempre (hasta
+// el tope duro); la telemetría periódica admite como mucho un frame sin empezar
+// a enviar por vehículo, que se sustituye por el más reciente de ese mismo
+// vehículo (latest-value coalescing).
+//
+// Los nodos solo guardan una referencia al Frame compartido: el frame de
+// broadcast se codifica una vez y se envía desde la misma memoria a todas las
+// conexiones (sendmsg con varios iovec por llamada, o MSG_ZEROCOPY para frames
+// grandes si se activó con --zerocopy).
+#include "send_queue.h"
+#include "metrics.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+
+static SlowConsumerPolicy slow_policy = SLOW_POLICY_COALESCE;
+static int zerocopy_enabled = 0;
+
+void send_queue_set_policy(SlowConsumerPolicy policy) {
+    slow_policy = policy;
+}
+
+SlowConsumerPolicy send_queue_get_policy() {
+    return slow_policy;
+}
+
+void send_queue_set_zerocopy(int enabled) {
+    zerocopy_enabled = enabled;
+}
+
+// Activa SO_ZEROCOPY en el socket si se pidió con --zerocopy
+int send_queue_enable_zerocopy(SendQueue* queue, int fd) {
+    int one = 1;
+    if (!zerocopy_enabled) return 0;
+    if (setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) < 0) return -1;
+    queue->zerocopy = 1;
+    return 1;
+}
+
+// Histéresis entre los dos watermarks
+static void update_congestion(SendQueue* queue) {
+    if (queue->bytes > SEND_QUEUE_HIGH_WATERMARK) {
+        queue->congested = 1;
+    } else if (queue->bytes < SEND_QUEUE_LOW_WATERMARK) {
+        queue->congested = 0;
+    }
+}
+
+// Frame de telemetría pendiente del mismo vehículo, o -1
+static int find_pending(const SendQueue* queue, uint32_t vehicle) {
+    for (int i = 0; i < queue->pending_count; i++) {
+        if (queue->pending_broadcast[i]->frame->vehicle == vehicle) return i;
+    }
+    return -1;
+}
+
+// Olvida un frame pendiente (empezó a enviarse o se liberó)
+static void forget_pending(SendQueue* queue, QueuedFrame* node) {
+    for (int i = 0; i < queue->pending_count; i++) {
+        if (queue->pending_broadcast[i] == node) {
+            queue->pending_broadcast[i] = queue->pending_broadcast[--queue->pending_count];
+            return;
+        }
+    }
+}
+
+// Sustituye el frame de telemetría pendiente por uno nuevo, en su misma posición
+static SendQueueResult replace_pending(SendQueue* queue, int slot, Frame* frame) {
+    QueuedFrame* node = queue->pending_broadcast[slot];
+
+    queue->bytes += frame->len - node->frame->len;
+    frame_unref(node->frame);
+    node->frame = frame_ref(frame);
+    queue->coalesced++;
+
+    update_congestion(queue);
+    return SQ_COALESCED;
+}
+
+// Encola una referencia al frame (el llamador conserva la suya)
+SendQueueResult send_queue_push(SendQueue* queue, FrameKind kind, Frame* frame) {
+    if (kind == FRAME_BROADCAST) {
+        if (queue->congested && slow_policy == SLOW_POLICY_DISCONNECT) {
+            return SQ_OVERFLOW;
+        }
+        int slot = find_pending(queue, frame->vehicle);
+        if (slot >= 0) {
+            return replace_pending(queue, slot, frame);
+        }
+    }
+
+    if (queue->bytes + frame->len > SEND_QUEUE_MAX_BYTES) {
+        return SQ_OVERFLOW;
+    }
+
+    QueuedFrame* node = malloc(sizeof(QueuedFrame));
+    if (!node) return SQ_OVERFLOW;
+
+    node->next = NULL;
+    node->kind = kind;
+    node->frame = frame_ref(frame);
+    node->off = 0;
+
+    if (queue->tail) queue->tail->next = node;
+    else queue->head = node;
+    queue->tail = node;
+    queue->bytes += frame->len;
+
+    // Con todos los huecos ocupados el frame se encola sin poder sustituirse
+    if (kind == FRAME_BROADCAST && queue->pending_count < MAX_VEHICLE_SUBSCRIPTIONS) {
+        queue->pending_broadcast[queue->pending_count++] = node;
+    }
+
+    update_congestion(queue);
+    return SQ_QUEUED;
+}
+
+// Retiene el frame hasta que el kernel confirme que ya no usa sus páginas
+static void track_zerocopy(SendQueue* queue, Frame* frame) {
+    ZeroCopyRef* ref = malloc(sizeof(ZeroCopyRef));
+    unsigned int seq = queue->zc_next_seq++;
+    if (!ref) return; // Sin memoria: mejor filtrar una referencia que liberar antes de tiempo
+
+    ref->next = NULL;
+    ref->frame = frame_ref(frame);
+    ref->seq = seq;
+    if (queue->zc_tail) queue->zc_tail->next = ref;
+    else queue->zc_head = ref;
+    queue->zc_tail = ref;
+}
+
+// Descuenta 'sent' bytes desde la cabeza de la cola
+static void consume(SendQueue* queue, ssize_t sent) {
+    queue->bytes -= sent;
+    while (sent > 0) {
+        QueuedFrame* node = queue->head;
+        int remaining = node->frame->len - node->off;
+
+        // Un frame que empezó a enviarse ya no se puede sustituir
+        if (node->kind == FRAME_BROADCAST && node->off == 0) forget_pending(queue, node);
+
+        if (sent < remaining) {
+            node->off += sent;
+            break;
+        }
+
+        sent -= remaining;
+        queue->head = node->next;
+        if (!queue->head) queue->tail = NULL;
+        frame_unref(node->frame);
+        free(node);
+    }
+    update_congestion(queue);
+}
+
+// Un iovec por frame desde la cabeza de la cola (como mucho 'max')
+static int fill_iov(SendQueue* queue, struct iovec* iov, int max) {
+    int count = 0;
+    for (QueuedFrame* node = queue->head; node && count < max; node = node->next) {
+        iov[count].iov_base = node->frame->data + node->off;
+        iov[count].iov_len = node->frame->len - node->off;
+        count++;
+    }
+    return count;
+}
+
+// Envía lo posible sin bloquear. Devuelve 1 si la cola quedó vacía,
+// 0 si el socket está lleno (esperar EPOLLOUT) y -1 si el socket falló.
+int send_queue_flush(SendQueue* queue, int fd) {
+    while (queue->head) {
+        struct iovec iov[SEND_QUEUE_IOV_MAX];
+        int count = 0;
+        int flags = MSG_NOSIGNAL | MSG_DONTWAIT;
+        QueuedFrame* head = queue->head;
+
+        if (queue->zerocopy && head->frame->len - head->off >= SEND_QUEUE_ZEROCOPY_MIN) {
+            // Frame grande: se envía solo y sin copia al kernel
+            iov[0].iov_base = head->frame->data + head->off;
+            iov[0].iov_len = head->frame->len - head->off;
+            count = 1;
+            flags |= MSG_ZEROCOPY;
+        } else {
+            count = fill_iov(queue, iov, SEND_QUEUE_IOV_MAX);
+        }
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+
+        ssize_t sent = sendmsg(fd, &msg, flags);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == ENOBUFS && (flags & MSG_ZEROCOPY)) {
+                // Sin memoria para fijar páginas: el socket vuelve al camino con copia
+                queue->zerocopy = 0;
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1;
+        }
+
+        if (flags & MSG_ZEROCOPY) track_zerocopy(queue, head->frame);
+        metrics_add(METRIC_BYTES_OUT, sent);
+        consume(queue, sent);
+    }
+
+    return 1;
+}
+
+// Prepara un envío que el kernel completará más tarde. Los frames del envío
+// dejan de ser sustituibles: su memoria tiene que seguir intacta hasta
+// send_queue_complete(). Devuelve el número de iovec (0 si la cola está vacía).
+int send_queue_prepare(SendQueue* queue, struct iovec* iov, int max) {
+    int count = fill_iov(queue, iov, max);
+    QueuedFrame* node = queue->head;
+    for (int i = 0; i < count; i++, node = node->next) {
+        if (node->kind == FRAME_BROADCAST && node->off == 0) forget_pending(queue, node);
+    }
+    return count;
+}
+
+void send_queue_complete(SendQueue* queue, ssize_t sent) {
+    if (sent <= 0) return;
+    metrics_add(METRIC_BYTES_OUT, sent);
+    consume(queue, sent);
+}
+
+// Procesa las notificaciones de la cola de errores del socket y suelta los
+// frames cuyo envío zero-copy ya completó. Devuelve los envíos liberados.
+int send_queue_reap_zerocopy(SendQueue* queue, int fd) {
+    int released = 0;
+
+    while (queue->zc_head) {
+        char control[128];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                  (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) {
+                continue;
+            }
+
+            struct sock_extended_err* serr = (struct sock_extended_err*)CMSG_DATA(cm);
+            if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) queue->zc_copied++;
+
+            // [ee_info, ee_data] es el rango de envíos completados
+            unsigned int hi = serr->ee_data;
+            while (queue->zc_head && (int)(queue->zc_head->seq - hi) <= 0) {
+                ZeroCopyRef* ref = queue->zc_head;
+                queue->zc_head = ref->next;
+                if (!queue->zc_head) queue->zc_tail = NULL;
+                frame_unref(ref->frame);
+                free(ref);
+                released++;
+            }
+        }
+    }
+
+    return released;
+}
+
+void send_queue_clear(SendQueue* queue) {
+    while (queue->head) {
+        QueuedFrame* next = queue->head->next;
+        frame_unref(queue->head->frame);
+        free(queue->head);
+        queue->head = next;
+    }
+    while (queue->zc_head) {
+        ZeroCopyRef* next = queue->zc_head->next;
+        frame_unref(queue->zc_head->frame);
+        free(queue->zc_head);
+        queue->zc_head = next;
+    }
+    queue->tail = NULL;
+    queue->zc_tail = NULL;
+    queue->pending_count = 0;
+    queue->bytes = 0;
+    queue->congested = 0;
+}
@@ -0,0 +1,84 @@
+// ============= send_queue.h =============
+#ifndef SEND_QUEUE_H
+#define SEND_QUEUE_H
+
+#include "frame.h"
+#include "protocol.h"
+#include <sys/types.h>
+#include <sys/uio.h>
+
+// Límites por conexión (bytes pendientes de enviar)
+#define SEND_QUEUE_HIGH_WATERMARK (64 * 1024)   // Por encima: cliente lento
+#define SEND_QUEUE_LOW_WATERMARK  (16 * 1024)   // Por debajo: vuelve a la normalidad
+#define SEND_QUEUE_MAX_BYTES      (256 * 1024)  // Tope duro: se desconecta
+#define SEND_QUEUE_IOV_MAX 64                   // Frames por llamada a sendmsg()
+#define SEND_QUEUE_ZEROCOPY_MIN (16 * 1024)     // Con frames menores copiar es más barato
+
+// Tipo de frame encolado
+typedef enum {
+    FRAME_REPLY,       // Respuesta a una petición: nunca se descarta
+    FRAME_BROADCAST    // Telemetría periódica: se puede sustituir por una más nueva
+} FrameKind;
+
+// Qué hacer con un cliente que no consume la telemetría a tiempo
+typedef enum {
+    SLOW_POLICY_COALESCE,    // Sustituir el frame encolado por el más reciente
+    SLOW_POLICY_DISCONNECT   // Desconectar al cliente
+} SlowConsumerPolicy;
+
+// Resultado de encolar un frame
+typedef enum {
+    SQ_QUEUED,      // Añadido al final de la cola
+    SQ_COALESCED,   // Reemplazó un frame de telemetría aún no enviado
+    SQ_OVERFLOW     // Cola llena o cliente lento con política DISCONNECT
+} SendQueueResult;
+
+// Nodo de la cola: referencia a un frame compartido (no copia los bytes)
+typedef struct QueuedFrame {
+    struct QueuedFrame* next;
+    FrameKind kind;
+    Frame* frame;
+    int off;        // Bytes ya enviados de este frame
+} QueuedFrame;
+
+// Frame enviado con MSG_ZEROCOPY: se retiene hasta que el kernel lo notifique
+typedef struct ZeroCopyRef {
+    struct ZeroCopyRef* next;
+    Frame* frame;
+    unsigned int seq;
+} ZeroCopyRef;
+
+typedef struct {
+    QueuedFrame* head;
+    QueuedFrame* tail;
+    // Telemetría encolada que aún no empezó a enviarse: como mucho un frame
+    // por vehículo suscrito
+    QueuedFrame* pending_broadcast[MAX_VEHICLE_SUBSCRIPTIONS];
+    int pending_count;
+    int bytes;                       // Bytes pendientes en total
+    int congested;                   // Superó el high watermark y no bajó del low
+    int coalesced;                   // Frames de telemetría sustituidos
+
+    int zerocopy;                    // SO_ZEROCOPY activo en el socket
+    unsigned int zc_next_seq;        // Próximo identificador de envío zero-copy
+    ZeroCopyRef* zc_head;            // Envíos zero-copy sin completar
+    ZeroCopyRef* zc_tail;
+    int zc_copied;                   // Completados en los que el kernel copió igualmente
+} SendQueue;
+
+void send_queue_set_policy(SlowConsumerPolicy policy);
+SlowConsumerPolicy send_queue_get_policy();
+
+void send_queue_set_zerocopy(int enabled);
+int send_queue_enable_zerocopy(SendQueue* queue, int fd);
+
+SendQueueResult send_queue_push(SendQueue* queue, FrameKind kind, Frame* frame);
+int send_queue_flush(SendQueue* queue, int fd);
+// Envío asíncrono (io_uring): 'prepare' deja en 'iov' los frames de la cabeza
+// (que ya no se pueden sustituir) y 'complete' descuenta lo que se envió
+int send_queue_prepare(SendQueue* queue, struct iovec* iov, int max);
+void send_queue_complete(SendQueue* queue, ssize_t sent);
+int send_queue_reap_zerocopy(SendQueue* queue, int fd);
+void send_queue_clear(SendQueue* queue);
+
+#endif // SEND_QUEUE_H
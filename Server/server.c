@@ -11,12 +11,19 @@
 #include "logger.h"
 #include "auth.h"
 #include "telemetry.h"
+#include "scheduler.h"
 #include "client_handler.h"
+#include "reactor.h"
+#include "registry.h"
+#include "send_queue.h"
+#include "timeouts.h"
+#include "metrics.h"
+#include "recorder.h"
+#include "multicast.h"
+#include "actor.h"
+#include "physics.h"
 
 // Variables globales
-ClientInfo clients[MAX_CLIENTS];
-pthread_mutex_t clients_mutex = PTHREAD_MUTEX_INITIALIZER;
-
 int server_socket = -1;
 volatile sig_atomic_t server_running = 1;
 
@@ -32,44 +39,200 @@ void signal_handler(int sig) {
     }
 }
 
-void init_clients() {
-    pthread_mutex_lock(&clients_mutex);
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        clients[i].active = 0;
-        clients[i].socket_fd = -1;
-    }
-    pthread_mutex_unlock(&clients_mutex);
+static void shutdown_client(const ClientInfo* client, void* ctx) {
+    (void)ctx;
+    // shutdown() despierta al thread del cliente, que hace su propia limpieza
+    shutdown(client->socket_fd, SHUT_RDWR);
 }
 
 void cleanup_all_clients() {
-    pthread_mutex_lock(&clients_mutex);
-    
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (clients[i].active && clients[i].socket_fd >= 0) {
-            close(clients[i].socket_fd);
-            clients[i].active = 0;
-        }
-    }
-    
-    pthread_mutex_unlock(&clients_mutex);
+    registry_for_each(shutdown_client, NULL);
+}
+
+// Plazo en milisegundos (0 = sin plazo). Devuelve -1 si no es válido.
+static int parse_timeout_ms(const char* str) {
+    char* end;
+    long ms = strtol(str, &end, 10);
+    if (*str == '\0' || *end != '\0' || ms < 0 || ms > 86400000L) return -1;
+    return (int)ms;
 }
 
 int main(int argc, char *argv[]) {
     // Verificar argumentos
-    if (argc != 3) {
-        fprintf(stderr, "Uso: %s <puerto> <archivo_log>\n", argv[0]);
+    if (argc < 3) {
+        fprintf(stderr, "Uso: %s <puerto> <archivo_log> [--mode epoll|threads|uring]"
+                        " [--slow-policy coalesce|disconnect] [--zerocopy]"
+                        " [--log-policy drop|block] [--keyframe-interval N] [--shards N]"
+                        " [--users ARCHIVO] [--handshake-timeout MS] [--auth-timeout MS]"
+                        " [--idle-timeout MS] [--metrics-port N] [--record BASE]"
+                        " [--replay BASE] [--replay-speed 1x|max] [--vehicles N]"
+                        " [--multicast GRUPO:PUERTO] [--multicast-rate HZ] [--multicast-ttl N]"
+                        " [--multicast-if IP] [--sim-rate HZ] [--sim-threads N] [--seed N]\n", argv[0]);
         fprintf(stderr, "Ejemplo: %s 8080 server.log\n", argv[0]);
         return 1;
     }
     
     int port = atoi(argv[1]);
     char* log_file = argv[2];
+    ServerMode mode = SERVER_MODE_EPOLL;
+    const char* users_file = AUTH_DEFAULT_USERS_FILE;
+    int handshake_ms = TIMEOUT_DEFAULT_HANDSHAKE_MS;
+    int auth_ms = TIMEOUT_DEFAULT_AUTH_MS;
+    int idle_ms = TIMEOUT_DEFAULT_IDLE_MS;
+    int metrics_port = 0; // 0 = sin endpoint de scrape
+    const char* record_base = NULL;
+    const char* replay_base = NULL;
+    ReplaySpeed replay_speed = REPLAY_REALTIME;
+    int vehicle_count = 1;
+    const char* multicast_to = NULL; // NULL = sin canal UDP
+    const char* multicast_if = NULL;
+    double multicast_rate = SCHEDULER_DEFAULT_RATE_HZ;
+    int multicast_ttl = MULTICAST_DEFAULT_TTL;
+    int shards = (int)sysconf(_SC_NPROCESSORS_ONLN); // Un reactor por núcleo
+    double sim_rate = PHYSICS_DEFAULT_RATE_HZ;
+    int sim_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t seed = PHYSICS_DEFAULT_SEED;
     
     if (port <= 0 || port > 65535) {
         fprintf(stderr, "Error: Puerto inválido. Debe estar entre 1 y 65535\n");
         return 1;
     }
     
+    // Opciones adicionales
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "epoll") == 0) {
+                mode = SERVER_MODE_EPOLL;
+            } else if (strcmp(argv[i], "threads") == 0) {
+                mode = SERVER_MODE_THREADS;
+            } else if (strcmp(argv[i], "uring") == 0) {
+                mode = SERVER_MODE_URING;
+            } else {
+                fprintf(stderr, "Error: Modo inválido '%s'. Use epoll, threads o uring\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--slow-policy") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "coalesce") == 0) {
+                send_queue_set_policy(SLOW_POLICY_COALESCE);
+            } else if (strcmp(argv[i], "disconnect") == 0) {
+                send_queue_set_policy(SLOW_POLICY_DISCONNECT);
+            } else {
+                fprintf(stderr, "Error: Política inválida '%s'. Use coalesce o disconnect\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--log-policy") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "drop") == 0) {
+                logger_set_policy(LOG_POLICY_DROP);
+            } else if (strcmp(argv[i], "block") == 0) {
+                logger_set_policy(LOG_POLICY_BLOCK);
+            } else {
+                fprintf(stderr, "Error: Política de log inválida '%s'. Use drop o block\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--zerocopy") == 0) {
+            send_queue_set_zerocopy(1);
+        } else if (strcmp(argv[i], "--keyframe-interval") == 0 && i + 1 < argc) {
+            int interval = atoi(argv[++i]);
+            if (interval <= 0) {
+                fprintf(stderr, "Error: Intervalo de keyframes inválido '%s'\n", argv[i]);
+                return 1;
+            }
+            telemetry_set_keyframe_interval(interval);
+        } else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+            shards = atoi(argv[++i]);
+            if (shards <= 0 || shards > REACTOR_MAX_SHARDS) {
+                fprintf(stderr, "Error: Número de shards inválido '%s' (1-%d)\n",
+                        argv[i], REACTOR_MAX_SHARDS);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--users") == 0 && i + 1 < argc) {
+            users_file = argv[++i];
+        } else if (strcmp(argv[i], "--handshake-timeout") == 0 && i + 1 < argc) {
+            handshake_ms = parse_timeout_ms(argv[++i]);
+            if (handshake_ms < 0) {
+                fprintf(stderr, "Error: Plazo inválido '%s' (milisegundos, 0 = sin plazo)\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--auth-timeout") == 0 && i + 1 < argc) {
+            auth_ms = parse_timeout_ms(argv[++i]);
+            if (auth_ms < 0) {
+                fprintf(stderr, "Error: Plazo inválido '%s' (milisegundos, 0 = sin plazo)\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--idle-timeout") == 0 && i + 1 < argc) {
+            idle_ms = parse_timeout_ms(argv[++i]);
+            if (idle_ms < 0) {
+                fprintf(stderr, "Error: Plazo inválido '%s' (milisegundos, 0 = sin plazo)\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--metrics-port") == 0 && i + 1 < argc) {
+            metrics_port = atoi(argv[++i]);
+            if (metrics_port <= 0 || metrics_port > 65535 || metrics_port == port) {
+                fprintf(stderr, "Error: Puerto de métricas inválido '%s'\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_base = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_base = argv[++i];
+        } else if (strcmp(argv[i], "--replay-speed") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "1x") == 0) {
+                replay_speed = REPLAY_REALTIME;
+            } else if (strcmp(argv[i], "max") == 0) {
+                replay_speed = REPLAY_MAX;
+            } else {
+                fprintf(stderr, "Error: Velocidad inválida '%s'. Use 1x o max\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--vehicles") == 0 && i + 1 < argc) {
+            vehicle_count = atoi(argv[++i]);
+            if (vehicle_count <= 0 || vehicle_count > TELEMETRY_MAX_VEHICLES) {
+                fprintf(stderr, "Error: Número de vehículos inválido '%s' (1-%d)\n",
+                        argv[i], TELEMETRY_MAX_VEHICLES);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--multicast") == 0 && i + 1 < argc) {
+            multicast_to = argv[++i];
+        } else if (strcmp(argv[i], "--multicast-rate") == 0 && i + 1 < argc) {
+            multicast_rate = atof(argv[++i]);
+            if (multicast_rate <= 0) {
+                fprintf(stderr, "Error: Frecuencia del canal UDP inválida '%s' (Hz)\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--multicast-ttl") == 0 && i + 1 < argc) {
+            multicast_ttl = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--multicast-if") == 0 && i + 1 < argc) {
+            multicast_if = argv[++i];
+        } else if (strcmp(argv[i], "--sim-rate") == 0 && i + 1 < argc) {
+            sim_rate = atof(argv[++i]);
+            if (sim_rate <= 0) {
+                fprintf(stderr, "Error: Frecuencia de simulación inválida '%s' (Hz)\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--sim-threads") == 0 && i + 1 < argc) {
+            sim_threads = atoi(argv[++i]);
+            if (sim_threads <= 0 || sim_threads > PHYSICS_MAX_THREADS) {
+                fprintf(stderr, "Error: Número de threads de simulación inválido '%s' (1-%d)\n",
+                        argv[i], PHYSICS_MAX_THREADS);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "Error: Opción desconocida '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    
+    if (record_base && replay_base) {
+        fprintf(stderr, "Error: --record y --replay no se pueden usar juntos\n");
+        return 1;
+    }
+    
     // Configurar manejadores de señales
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
@@ -81,12 +244,83 @@ int main(int argc, char *argv[]) {
     printf("==============================================\n\n");
     
     logger_init(log_file);
-    auth_init();
-    telemetry_init();
-    init_clients();
+    metrics_init();
+    if (auth_init(users_file) < 0) {
+        char error_msg[256];
+        snprintf(error_msg, sizeof(error_msg), "No se pudo cargar el archivo de usuarios '%s'", users_file);
+        log_error(error_msg);
+        logger_close();
+        return 1;
+    }
+    if (telemetry_init(vehicle_count) < 0) {
+        log_error("Sin memoria para el estado de la flota");
+        logger_close();
+        return 1;
+    }
+    if (actor_start() < 0) {
+        log_error("No se pudo crear el thread del actor de vehículos");
+        logger_close();
+        return 1;
+    }
+    if (record_base) {
+        // Arranque en frío: si ya había una grabación, cada vehículo sigue
+        // desde su último estado grabado
+        int restored = recorder_start(record_base);
+        if (restored < 0) {
+            char error_msg[320];
+            snprintf(error_msg, sizeof(error_msg), "No se pudo abrir la grabación '%s'", record_base);
+            log_error(error_msg);
+            logger_close();
+            return 1;
+        }
+        if (restored) {
+            char msg[128];
+            snprintf(msg, sizeof(msg), "Estado de %d vehículo%s restaurado desde la grabación",
+                     restored, restored == 1 ? "" : "s");
+            log_info(msg);
+        }
+    }
+    registry_init();
+    scheduler_init();
+    timeouts_configure(handshake_ms, auth_ms, idle_ms);
+    
+    if (telemetry_start_simulation(sim_rate, sim_threads, seed) < 0) {
+        log_error("No se pudieron crear los threads de la simulación");
+        logger_close();
+        return 1;
+    }
+    
+    if (multicast_to &&
+        multicast_start(multicast_to, multicast_if, multicast_ttl, multicast_rate) < 0) {
+        char error_msg[320];
+        snprintf(error_msg, sizeof(error_msg), "No se pudo abrir el canal UDP '%s'", multicast_to);
+        log_error(error_msg);
+        logger_close();
+        return 1;
+    }
+    
+    if (metrics_port > 0 && metrics_start_http(metrics_port) < 0) {
+        char error_msg[128];
+        snprintf(error_msg, sizeof(error_msg), "No se pudo abrir el puerto de métricas %d", metrics_port);
+        log_error(error_msg);
+        logger_close();
+        return 1;
+    }
+    
+    if (replay_base) {
+        telemetry_set_replay(1);
+        if (replay_start(replay_base, replay_speed) < 0) {
+            char error_msg[320];
+            snprintf(error_msg, sizeof(error_msg), "No se pudo leer la grabación '%s'", replay_base);
+            log_error(error_msg);
+            logger_close();
+            return 1;
+        }
+    }
     
     char init_msg[256];
-    sprintf(init_msg, "Servidor inicializado en puerto %d", port);
+    sprintf(init_msg, "Servidor inicializado en puerto %d (modo %s)", port,
+            mode == SERVER_MODE_EPOLL ? "epoll" : mode == SERVER_MODE_URING ? "uring" : "threads");
     log_info(init_msg);
     
     // Crear socket del servidor
@@ -104,6 +338,15 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
+    // Varios reactores: cada shard abre otro socket en el mismo puerto
+    if (shards < 1) shards = 1;
+    if (shards > REACTOR_MAX_SHARDS) shards = REACTOR_MAX_SHARDS;
+    if (mode != SERVER_MODE_THREADS && shards > 1 &&
+        setsockopt(server_socket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        log_error("SO_REUSEPORT no disponible: se usa un solo reactor");
+        shards = 1;
+    }
+    
     // Configurar dirección del servidor
     struct sockaddr_in server_addr;
     memset(&server_addr, 0, sizeof(server_addr));
@@ -119,7 +362,7 @@ int main(int argc, char *argv[]) {
     }
     
     // Listen
-    if (listen(server_socket, 10) < 0) {
+    if (listen(server_socket, SOMAXCONN) < 0) {
         log_error("Error en listen()");
         close(server_socket);
         return 1;
@@ -142,8 +385,22 @@ int main(int argc, char *argv[]) {
     }
     pthread_detach(telemetry_thread);
     
-    // Loop principal - aceptar clientes
-    while (server_running) {
+    // Modo threads: un thread vence los plazos de todas las conexiones
+    pthread_t timeouts_thread;
+    if (mode == SERVER_MODE_THREADS &&
+        pthread_create(&timeouts_thread, NULL, timeouts_reaper_thread, NULL) == 0) {
+        pthread_detach(timeouts_thread);
+    }
+    
+    // Modos epoll y uring: el reactor acepta y atiende todas las conexiones
+    if (mode != SERVER_MODE_THREADS && reactor_run(server_socket, shards, mode) < 0) {
+        log_error("No se pudo iniciar el reactor");
+        close(server_socket);
+        return 1;
+    }
+    
+    // Modo threads - aceptar clientes y crear un thread por cada uno
+    while (mode == SERVER_MODE_THREADS && server_running) {
         struct sockaddr_in client_addr;
         socklen_t client_len = sizeof(client_addr);
         
@@ -197,6 +454,8 @@ int main(int argc, char *argv[]) {
         close(server_socket);
     }
     
+    recorder_close();
+    multicast_close();
     log_info("Servidor cerrado correctamente");
     logger_close();
     
@@ -0,0 +1,192 @@
+// ============= subscriptions.c =============
+// Índice de suscripciones por vehículo. Para cada bucket de frecuencia guarda
+// solo los vehículos que tienen algún suscriptor, en un array denso que el
+// thread de telemetría recorre en cada tick: el coste de un tick depende de
+// las suscripciones, no del tamaño de la flota. Un array por bucket de
+// 'vehicle_count' posiciones (reservado en su primera suscripción) lleva de
+// cada vehículo a su flujo, y las bajas tapan el hueco con el último.
+//
+// Dentro de un flujo, los suscriptores con filtro se agrupan por filtro y
+// modo idénticos: el thread de telemetría evalúa y codifica una vez por grupo.
+//
+// Cada bucket tiene su propio mutex: altas y bajas (CONNECT, desconexiones)
+// solo compiten con el reparto de su misma frecuencia.
+#include "subscriptions.h"
+#include "scheduler.h"
+#include "logger.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+typedef struct {
+    pthread_mutex_t mutex;
+    VehicleFeed* feeds;     // Flujos vivos, densos
+    int count;
+    int capacity;
+    int* position;          // Vehículo -> índice en 'feeds' + 1 (0 = sin flujo)
+} FeedIndex;
+
+static FeedIndex indexes[SCHEDULER_MAX_BUCKETS];
+static int fleet_size = 0;
+
+void subscriptions_init(int vehicle_count) {
+    fleet_size = vehicle_count;
+    for (int i = 0; i < SCHEDULER_MAX_BUCKETS; i++) {
+        memset(&indexes[i], 0, sizeof(FeedIndex));
+        pthread_mutex_init(&indexes[i].mutex, NULL);
+    }
+}
+
+static FeedIndex* index_of(int bucket) {
+    if (bucket < 0 || bucket >= SCHEDULER_MAX_BUCKETS) return NULL;
+    return &indexes[bucket];
+}
+
+// Flujo del vehículo, creándolo si hace falta. Requiere el mutex del bucket.
+static VehicleFeed* feed_acquire(FeedIndex* index, uint32_t vehicle) {
+    if (!index->position) {
+        index->position = calloc(fleet_size, sizeof(int));
+        if (!index->position) return NULL;
+    }
+    if (index->position[vehicle]) return &index->feeds[index->position[vehicle] - 1];
+
+    if (index->count == index->capacity) {
+        int capacity = index->capacity ? index->capacity * 2 : 16;
+        VehicleFeed* feeds = realloc(index->feeds, capacity * sizeof(VehicleFeed));
+        if (!feeds) return NULL;
+        index->feeds = feeds;
+        index->capacity = capacity;
+    }
+
+    VehicleFeed* feed = &index->feeds[index->count++];
+    memset(feed, 0, sizeof(VehicleFeed));
+    feed->vehicle = vehicle;
+    index->position[vehicle] = index->count;
+    return feed;
+}
+
+// Grupo de los suscriptores con ese filtro y modo, o NULL
+static FilterGroup* group_find(VehicleFeed* feed, const TelemetryFilter* filter,
+                               TelemetryMode mode) {
+    for (int i = 0; i < feed->group_count; i++) {
+        FilterGroup* group = &feed->groups[i];
+        if (group->mode == mode && telemetry_filter_equals(&group->filter, filter)) return group;
+    }
+    return NULL;
+}
+
+// Grupo del filtro en el flujo, creándolo si hace falta
+static FilterGroup* group_acquire(VehicleFeed* feed, const TelemetryFilter* filter,
+                                  TelemetryMode mode) {
+    FilterGroup* found = group_find(feed, filter, mode);
+    if (found) return found;
+
+    if (feed->group_count == feed->group_capacity) {
+        int capacity = feed->group_capacity ? feed->group_capacity * 2 : 4;
+        FilterGroup* groups = realloc(feed->groups, capacity * sizeof(FilterGroup));
+        if (!groups) return NULL;
+        feed->groups = groups;
+        feed->group_capacity = capacity;
+    }
+
+    FilterGroup* group = &feed->groups[feed->group_count++];
+    memset(group, 0, sizeof(FilterGroup));
+    group->filter = *filter;
+    group->mode = mode;
+    return group;
+}
+
+// Quita un flujo sin suscriptores moviendo el último a su hueco
+static void feed_release(FeedIndex* index, VehicleFeed* feed) {
+    for (int i = 0; i < ENCODING_COUNT; i++) {
+        frame_unref(feed->full[i]);
+    }
+    free(feed->groups);
+    index->position[feed->vehicle] = 0;
+
+    VehicleFeed* last = &index->feeds[--index->count];
+    if (feed != last) {
+        *feed = *last;
+        index->position[feed->vehicle] = feed - index->feeds + 1;
+    }
+}
+
+void subscriptions_add(int bucket, const uint32_t* vehicles, int count,
+                       const TelemetryFilter* filter, TelemetryMode mode) {
+    FeedIndex* index = index_of(bucket);
+    if (!index || filter->fields == 0) return;
+    int plain = telemetry_filter_is_plain(filter);
+
+    pthread_mutex_lock(&index->mutex);
+    for (int i = 0; i < count; i++) {
+        if (vehicles[i] >= (uint32_t)fleet_size) continue;
+
+        VehicleFeed* feed = feed_acquire(index, vehicles[i]);
+        FilterGroup* group = feed && !plain ? group_acquire(feed, filter, mode) : NULL;
+        if (!feed || (!plain && !group)) {
+            if (feed && feed->subscribers == 0) feed_release(index, feed);
+            log_error("Sin memoria para el índice de suscripciones");
+            break;
+        }
+        feed->subscribers++;
+        if (plain) feed->plain++;
+        else group->subscribers++;
+    }
+    pthread_mutex_unlock(&index->mutex);
+}
+
+void subscriptions_remove(int bucket, const uint32_t* vehicles, int count,
+                          const TelemetryFilter* filter, TelemetryMode mode) {
+    FeedIndex* index = index_of(bucket);
+    if (!index || filter->fields == 0) return;
+    int plain = telemetry_filter_is_plain(filter);
+
+    pthread_mutex_lock(&index->mutex);
+    for (int i = 0; i < count && index->position; i++) {
+        if (vehicles[i] >= (uint32_t)fleet_size || !index->position[vehicles[i]]) continue;
+
+        VehicleFeed* feed = &index->feeds[index->position[vehicles[i]] - 1];
+        if (plain) {
+            if (feed->plain == 0) continue;
+            feed->plain--;
+        } else {
+            FilterGroup* group = group_find(feed, filter, mode);
+            if (!group) continue;
+            if (--group->subscribers == 0) *group = feed->groups[--feed->group_count];
+        }
+        if (--feed->subscribers == 0) feed_release(index, feed);
+    }
+    pthread_mutex_unlock(&index->mutex);
+}
+
+int subscriptions_count(int bucket) {
+    FeedIndex* index = index_of(bucket);
+    if (!index) return 0;
+
+    pthread_mutex_lock(&index->mutex);
+    int count = index->count;
+    pthread_mutex_unlock(&index->mutex);
+    return count;
+}
+
+void subscriptions_for_each(int bucket, FeedVisitor visitor, void* ctx) {
+    FeedIndex* index = index_of(bucket);
+    if (!index) return;
+
+    pthread_mutex_lock(&index->mutex);
+    for (int i = 0; i < index->count; i++) {
+        visitor(&index->feeds[i], ctx);
+    }
+    pthread_mutex_unlock(&index->mutex);
+}
+
+int subscriptions_visit(int bucket, uint32_t vehicle, FeedVisitor visitor, void* ctx) {
+    FeedIndex* index = index_of(bucket);
+    if (!index || vehicle >= (uint32_t)fleet_size) return 0;
+
+    pthread_mutex_lock(&index->mutex);
+    int found = index->position && index->position[vehicle];
+    if (found) visitor(&index->feeds[index->position[vehicle] - 1], ctx);
+    pthread_mutex_unlock(&index->mutex);
+    return found;
+}
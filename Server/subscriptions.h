@@ -0,0 +1,55 @@
+// ============= subscriptions.h =============
+#ifndef SUBSCRIPTIONS_H
+#define SUBSCRIPTIONS_H
+
+#include "protocol.h"
+#include "frame.h"
+
+// Suscriptores de un vehículo con el mismo filtro y modo: reciben los mismos
+// frames, así que comparten la secuencia y lo último enviado de cada campo
+typedef struct {
+    TelemetryFilter filter;
+    TelemetryMode mode;
+    int subscribers;
+    unsigned long seq;              // Secuencia del último frame emitido
+    VehicleState sent;              // Último valor enviado de cada campo del filtro
+    int ticks_since_key;
+    int has_base;
+} FilterGroup;
+
+// Flujo de un vehículo en un bucket de frecuencia: existe mientras tenga
+// suscriptores. Los que no filtran reciben los mismos frames, así que
+// comparten el último TELEMETRY_DATA codificado y la secuencia y el estado
+// base delta; los que filtran se agrupan por filtro.
+typedef struct {
+    uint32_t vehicle;
+    int subscribers;                // Todos, con o sin filtro
+    int plain;                      // Sin filtro
+    FilterGroup* groups;
+    int group_count;
+    int group_capacity;
+    Frame* full[ENCODING_COUNT];    // TELEMETRY_DATA de la última versión enviada
+    unsigned long seq;              // Secuencia del último frame delta emitido
+    unsigned long version;          // Versión del estado que tienen los clientes al día
+    VehicleState sent;              // Ese mismo estado (base del próximo delta)
+    int ticks_since_key;
+    int has_base;
+} VehicleFeed;
+
+// Visitante de un flujo; se llama con el lock del bucket tomado
+typedef void (*FeedVisitor)(VehicleFeed* feed, void* ctx);
+
+void subscriptions_init(int vehicle_count);
+// Un filtro sin campos (p. ej. un admin que no pidió telemetría) no suscribe a nada
+void subscriptions_add(int bucket, const uint32_t* vehicles, int count,
+                       const TelemetryFilter* filter, TelemetryMode mode);
+void subscriptions_remove(int bucket, const uint32_t* vehicles, int count,
+                          const TelemetryFilter* filter, TelemetryMode mode);
+
+// Vehículos con suscriptores en el bucket
+int subscriptions_count(int bucket);
+void subscriptions_for_each(int bucket, FeedVisitor visitor, void* ctx);
+// Visita el flujo de un vehículo. Devuelve 0 si no tiene suscriptores en el bucket.
+int subscriptions_visit(int bucket, uint32_t vehicle, FeedVisitor visitor, void* ctx);
+
+#endif // SUBSCRIPTIONS_H
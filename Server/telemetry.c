@@ -1,166 +1,805 @@
 #include "telemetry.h"
 #include "logger.h"
+#include "reactor.h"
+#include "registry.h"
+#include "send_queue.h"
+#include "scheduler.h"
+#include "metrics.h"
+#include "history.h"
+#include "recorder.h"
+#include "subscriptions.h"
+#include "multicast.h"
+#include "actor.h"
+#include "physics.h"
 #include <unistd.h>
+#include <time.h>
+#include <errno.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+#include <stdatomic.h>
 
-VehicleState vehicle_state;
-pthread_mutex_t vehicle_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Estado de la flota: cada vehículo tiene su seqlock. Un solo escritor, el
+// actor de vehículos (actor.c), aplica comandos, simulación y estados
+// grabados: incrementa la secuencia del vehículo antes y después de
+// modificar (impar = escritura en curso). Los lectores nunca bloquean:
+// copian el estado y reintentan si la secuencia cambió mientras tanto. La
+// versión de un vehículo es su secuencia / 2.
+typedef struct {
+    atomic_ulong seq;
+    VehicleState state;
+} __attribute__((aligned(64))) Vehicle;    // Una línea de caché por vehículo
 
-// Variables externas del servidor
-extern ClientInfo clients[MAX_CLIENTS];
-extern pthread_mutex_t clients_mutex;
+static Vehicle* vehicles = NULL;
+static int vehicle_count = 0;
 
-void telemetry_init() {
-    pthread_mutex_lock(&vehicle_mutex);
+// Caché por thread de los frames TELEMETRY_DATA de la última versión de los
+// vehículos consultados, uno por codificación: cada reactor (o thread de
+// cliente) reutiliza la suya sin compartir locks con los demás. Es de
+// correspondencia directa (vehículo % FRAME_CACHE_SLOTS) para que su tamaño
+// no dependa de la flota.
+#define FRAME_CACHE_SLOTS 64
+
+typedef struct {
+    uint32_t vehicle;
+    Frame* frames[ENCODING_COUNT];
+} FrameCacheSlot;
+
+typedef struct {
+    FrameCacheSlot slots[FRAME_CACHE_SLOTS];
+} FrameCache;
+
+static pthread_key_t frame_cache_key;
+static pthread_once_t frame_cache_once = PTHREAD_ONCE_INIT;
+
+static int keyframe_interval = TELEMETRY_KEYFRAME_INTERVAL;
+
+// En reproducción el estado solo lo escribe la grabación: ni simulación ni comandos
+static atomic_int replay_mode = 0;
+
+// Bucket del scheduler al que avanza la simulación física (--sim-rate)
+static int simulation_bucket = SCHEDULER_DEFAULT_BUCKET;
+
+// Marcan el inicio y el fin de una escritura del estado. Solo desde el actor
+// (o antes de arrancarlo, en telemetry_init).
+static void write_begin(Vehicle* vehicle) {
+    atomic_store_explicit(&vehicle->seq, atomic_load_explicit(&vehicle->seq, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void write_end(Vehicle* vehicle) {
+    atomic_store_explicit(&vehicle->seq, atomic_load_explicit(&vehicle->seq, memory_order_relaxed) + 1,
+                          memory_order_release);
+}
+
+// ID con el que viaja la telemetría: con un solo vehículo no se incluye
+static int vehicle_tag(uint32_t vehicle) {
+    return vehicle_count > 1 ? (int)vehicle : VEHICLE_NO_ID;
+}
+
+// Copia consistente del estado de un vehículo sin bloquear. Devuelve su versión.
+unsigned long telemetry_snapshot(uint32_t vehicle, VehicleState* out) {
+    Vehicle* v = &vehicles[vehicle];
+    while (1) {
+        unsigned long seq = atomic_load_explicit(&v->seq, memory_order_acquire);
+        if (seq & 1) continue; // Escritura en curso
+        
+        memcpy(out, &v->state, sizeof(VehicleState));
+        atomic_thread_fence(memory_order_acquire);
+        
+        if (atomic_load_explicit(&v->seq, memory_order_relaxed) == seq) return seq / 2;
+    }
+}
+
+// Versión actual de un vehículo (durante una escritura, la anterior)
+unsigned long telemetry_version(uint32_t vehicle) {
+    return atomic_load_explicit(&vehicles[vehicle].seq, memory_order_acquire) / 2;
+}
+
+// Crea la flota con todos los vehículos en el estado inicial. Devuelve -1 si
+// no hay memoria.
+int telemetry_init(int count) {
+    vehicles = aligned_alloc(64, count * sizeof(Vehicle));
+    if (!vehicles || physics_init(count) < 0) return -1;
+    vehicle_count = count;
     
-    vehicle_state.speed = 0.0;
-    vehicle_state.battery = 100.0;
-    vehicle_state.temperature = 25.0;
-    strcpy(vehicle_state.direction, "NORTH");
-    vehicle_state.is_moving = 0;
+    for (int id = 0; id < count; id++) {
+        Vehicle* v = &vehicles[id];
+        atomic_init(&v->seq, 0);
+        
+        write_begin(v);
+        
+        memset(&v->state, 0, sizeof(VehicleState));
+        v->state.speed = 0.0;
+        v->state.battery = 100.0;
+        v->state.temperature = 25.0;
+        strcpy(v->state.direction, "NORTH");
+        v->state.is_moving = 0;
+        
+        write_end(v);
+    }
+    subscriptions_init(count);
     
-    pthread_mutex_unlock(&vehicle_mutex);
+    char msg[128];
+    sprintf(msg, "Sistema de telemetría inicializado (%d vehículo%s)", count, count == 1 ? "" : "s");
+    log_info(msg);
+    return 0;
+}
+
+int telemetry_vehicle_count() {
+    return vehicle_count;
+}
+
+// Sustituye el estado completo de un vehículo (arranque en frío desde una
+// grabación y reproducción). Es una versión nueva como cualquier otra
+// escritura. Solo desde el actor (actor_set_state).
+void telemetry_set_state(uint32_t vehicle, const VehicleState* state) {
+    if (vehicle >= (uint32_t)vehicle_count) return;
+    Vehicle* v = &vehicles[vehicle];
+    
+    write_begin(v);
+    v->state = *state;
+    write_end(v);
+    physics_load(vehicle, &v->state);
+    recorder_record_state(vehicle, &v->state, telemetry_version(vehicle));
+}
+
+void telemetry_set_replay(int enabled) {
+    atomic_store(&replay_mode, enabled);
+}
+
+static void frame_cache_destroy(void* arg) {
+    FrameCache* cache = arg;
+    for (int s = 0; s < FRAME_CACHE_SLOTS; s++) {
+        for (int i = 0; i < ENCODING_COUNT; i++) {
+            frame_unref(cache->slots[s].frames[i]);
+        }
+    }
+    free(cache);
+}
+
+static void frame_cache_key_init() {
+    pthread_key_create(&frame_cache_key, frame_cache_destroy);
+}
+
+static FrameCache* frame_cache() {
+    pthread_once(&frame_cache_once, frame_cache_key_init);
     
-    log_info("Sistema de telemetría inicializado");
+    FrameCache* cache = pthread_getspecific(frame_cache_key);
+    if (!cache && (cache = calloc(1, sizeof(FrameCache)))) {
+        pthread_setspecific(frame_cache_key, cache);
+    }
+    return cache;
 }
 
-// Simula cambios en el vehículo
+static Frame* create_full_frame(uint32_t vehicle, ProtocolEncoding encoding,
+                                const VehicleState* state, unsigned long version) {
+    char buffer[BUFFER_SIZE];
+    int len = encode_telemetry(buffer, encoding, vehicle_tag(vehicle), state);
+    Frame* frame = frame_create(buffer, len, version);
+    if (frame) frame->vehicle = vehicle;
+    return frame;
+}
+
+// Devuelve una referencia al frame TELEMETRY_DATA del estado actual de un
+// vehículo en la codificación pedida. Solo se codifica cuando cambió la
+// versión (o el slot de la caché era de otro vehículo); el llamador debe
+// hacer frame_unref().
+Frame* telemetry_get_frame(uint32_t vehicle, ProtocolEncoding encoding) {
+    FrameCache* cache = frame_cache();
+    FrameCacheSlot* slot = cache ? &cache->slots[vehicle % FRAME_CACHE_SLOTS] : NULL;
+    if (slot && slot->vehicle != vehicle) {
+        for (int i = 0; i < ENCODING_COUNT; i++) {
+            frame_unref(slot->frames[i]);
+            slot->frames[i] = NULL;
+        }
+        slot->vehicle = vehicle;
+    }
+    
+    Frame* cached = slot ? slot->frames[encoding] : NULL;
+    if (cached && cached->version == telemetry_version(vehicle)) {
+        return frame_ref(cached);
+    }
+    
+    VehicleState state;
+    unsigned long version = telemetry_snapshot(vehicle, &state);
+    
+    Frame* frame = create_full_frame(vehicle, encoding, &state, version);
+    if (!frame || !slot) return frame;
+    
+    frame_unref(cached);
+    slot->frames[encoding] = frame;
+    return frame_ref(frame);
+}
+
+void telemetry_set_keyframe_interval(int interval) {
+    keyframe_interval = interval > 0 ? interval : TELEMETRY_KEYFRAME_INTERVAL;
+}
+
+static Frame* create_delta_frame(ProtocolEncoding encoding, uint32_t vehicle, unsigned long seq,
+                                 int keyframe, unsigned int fields, const VehicleState* state,
+                                 unsigned long version) {
+    char buffer[BUFFER_SIZE];
+    int len = encode_telemetry_delta(buffer, encoding, vehicle_tag(vehicle), seq, keyframe, fields, state);
+    Frame* frame = frame_create(buffer, len, version);
+    if (frame) frame->vehicle = vehicle;
+    return frame;
+}
+
+// Avanza el flujo delta de un vehículo en su bucket con el estado actual.
+// Deja en 'out' un frame por codificación, o NULL si no cambió nada y no
+// toca keyframe. Se llama con el lock del bucket tomado.
+static void advance_delta_stream(VehicleFeed* feed, const VehicleState* state, unsigned long version,
+                                 VehicleFrames* out) {
+    int keyframe = !feed->has_base || ++feed->ticks_since_key >= keyframe_interval;
+    unsigned int fields = 0;
+    if (!keyframe && feed->version != version) {
+        fields = telemetry_changed_fields(&feed->sent, state);
+    }
+    
+    for (int i = 0; i < ENCODING_COUNT; i++) out->frames[i][TELEMETRY_MODE_DELTA] = NULL;
+    if (!keyframe && !fields) return;
+    if (keyframe) fields = TELEMETRY_FIELD_ALL;
+    
+    feed->seq++;
+    for (int i = 0; i < ENCODING_COUNT; i++) {
+        out->frames[i][TELEMETRY_MODE_DELTA] =
+            create_delta_frame(i, feed->vehicle, feed->seq, keyframe, fields, state, version);
+    }
+    feed->sent = *state;
+    feed->version = version;
+    feed->has_base = 1;
+    if (keyframe) feed->ticks_since_key = 0;
+}
+
+// Copia de 'src' solo los campos indicados
+static void copy_fields(VehicleState* dst, const VehicleState* src, unsigned int fields) {
+    if (fields & TELEMETRY_FIELD_SPEED) dst->speed = src->speed;
+    if (fields & TELEMETRY_FIELD_BATTERY) dst->battery = src->battery;
+    if (fields & TELEMETRY_FIELD_TEMPERATURE) dst->temperature = src->temperature;
+    if (fields & TELEMETRY_FIELD_DIRECTION) strcpy(dst->direction, src->direction);
+    if (fields & TELEMETRY_FIELD_MOVING) dst->is_moving = src->is_moving;
+}
+
+// Avanza el flujo de un grupo con filtro. Los frames siempre son
+// TELEMETRY_DELTA, que ya sabe llevar un subconjunto de campos:
+//   - modo completo: todos los campos del filtro como keyframe, en cada tick
+//     o, con umbrales u "on-change", solo cuando alguno cambió lo bastante
+//   - modo delta: solo los campos que cambiaron lo bastante, con keyframes
+//     periódicos como el flujo sin filtro
+// Lo enviado de cada campo es la referencia de sus umbrales.
+static void advance_filter_group(uint32_t vehicle, FilterGroup* group, const VehicleState* state,
+                                 unsigned long version, FilteredFrames* out) {
+    const TelemetryFilter* filter = &group->filter;
+    unsigned int fields = group->has_base ? telemetry_filter_changes(filter, &group->sent, state) : 0;
+    int keyframe;
+    
+    out->filter = *filter;
+    out->mode = group->mode;
+    for (int i = 0; i < ENCODING_COUNT; i++) out->frames[i] = NULL;
+    
+    if (group->mode == TELEMETRY_MODE_DELTA) {
+        keyframe = !group->has_base || ++group->ticks_since_key >= keyframe_interval;
+    } else {
+        int conditional = filter->on_change;
+        for (int i = 0; i < TELEMETRY_THRESHOLD_COUNT; i++) {
+            if (filter->thresholds[i] > 0) conditional = 1;
+        }
+        keyframe = !group->has_base || !conditional || fields;
+    }
+    if (!keyframe && !fields) return;
+    if (keyframe) fields = filter->fields;
+    
+    group->seq++;
+    for (int i = 0; i < ENCODING_COUNT; i++) {
+        out->frames[i] = create_delta_frame(i, vehicle, group->seq, keyframe, fields, state, version);
+    }
+    copy_fields(&group->sent, state, fields);
+    group->has_base = 1;
+    if (keyframe) group->ticks_since_key = 0;
+}
+
+typedef struct {
+    const TelemetryFilter* filter;
+    ProtocolEncoding encoding;
+    Frame* frame;
+} KeyframeCtx;
+
+static void build_keyframe(VehicleFeed* feed, void* arg) {
+    KeyframeCtx* ctx = arg;
+    if (!telemetry_filter_is_plain(ctx->filter)) {
+        // Flujo del grupo: su base son los últimos valores enviados
+        for (int i = 0; i < feed->group_count; i++) {
+            FilterGroup* group = &feed->groups[i];
+            if (group->mode != TELEMETRY_MODE_DELTA ||
+                !telemetry_filter_equals(&group->filter, ctx->filter)) {
+                continue;
+            }
+            if (!group->has_base) {
+                telemetry_snapshot(feed->vehicle, &group->sent);
+                group->has_base = 1;
+            }
+            ctx->frame = create_delta_frame(ctx->encoding, feed->vehicle, group->seq, 1,
+                                            group->filter.fields, &group->sent, 0);
+        }
+        return;
+    }
+    
+    if (!feed->has_base) {
+        // El flujo aún no emitió nada: el estado actual pasa a ser la base
+        feed->version = telemetry_snapshot(feed->vehicle, &feed->sent);
+        feed->has_base = 1;
+    }
+    ctx->frame = create_delta_frame(ctx->encoding, feed->vehicle, feed->seq, 1, TELEMETRY_FIELD_ALL,
+                                    &feed->sent, feed->version);
+}
+
+// Keyframe para un cliente que detectó un salto de secuencia (RESYNC). Lleva
+// el estado base y la secuencia actuales del flujo del vehículo (o de su
+// grupo de filtro) en su bucket, así los deltas siguientes se aplican sobre
+// él sin huecos. NULL si el vehículo no tiene ese flujo en el bucket.
+Frame* telemetry_get_keyframe(int bucket, uint32_t vehicle, const TelemetryFilter* filter,
+                              ProtocolEncoding encoding) {
+    KeyframeCtx ctx = { filter, encoding, NULL };
+    subscriptions_visit(bucket, vehicle, build_keyframe, &ctx);
+    return ctx.frame;
+}
+
+typedef struct {
+    TelemetryFrames* set;
+    int capacity;
+} FeedFramesCtx;
+
+// Frames de un flujo en este tick: el TELEMETRY_DATA se reutiliza mientras la
+// versión del vehículo no cambie; el delta avanza la secuencia del flujo, y
+// cada grupo con filtro se evalúa y codifica una sola vez
+static void build_feed_frames(VehicleFeed* feed, void* arg) {
+    FeedFramesCtx* ctx = arg;
+    if (ctx->set->count == ctx->capacity) return; // Suscrito tras contar: entra en el siguiente tick
+    
+    VehicleState state;
+    unsigned long version = telemetry_snapshot(feed->vehicle, &state);
+    
+    VehicleFrames* out = &ctx->set->vehicles[ctx->set->count++];
+    memset(out, 0, sizeof(VehicleFrames));
+    out->vehicle = feed->vehicle;
+    
+    if (feed->group_count > 0) {
+        out->groups = malloc(feed->group_count * sizeof(FilteredFrames));
+        for (int g = 0; out->groups && g < feed->group_count; g++) {
+            advance_filter_group(feed->vehicle, &feed->groups[g], &state, version, &out->groups[g]);
+        }
+        if (out->groups) out->group_count = feed->group_count;
+    }
+    if (feed->plain == 0) return; // Solo suscriptores con filtro
+    
+    for (int i = 0; i < ENCODING_COUNT; i++) {
+        if (!feed->full[i] || feed->full[i]->version != version) {
+            frame_unref(feed->full[i]);
+            feed->full[i] = create_full_frame(feed->vehicle, i, &state, version);
+        }
+        out->frames[i][TELEMETRY_MODE_FULL] = feed->full[i] ? frame_ref(feed->full[i]) : NULL;
+    }
+    advance_delta_stream(feed, &state, version, out);
+}
+
+static int compare_vehicle_frames(const void* a, const void* b) {
+    uint32_t va = ((const VehicleFrames*)a)->vehicle;
+    uint32_t vb = ((const VehicleFrames*)b)->vehicle;
+    return va < vb ? -1 : va > vb;
+}
+
+// Frames de un bucket en este tick: solo los vehículos con suscriptores en
+// él. NULL si no hay ninguno.
+static TelemetryFrames* build_bucket_frames(int bucket) {
+    int capacity = subscriptions_count(bucket);
+    if (capacity == 0) return NULL;
+    
+    TelemetryFrames* set = malloc(sizeof(TelemetryFrames) + capacity * sizeof(VehicleFrames));
+    if (!set) return NULL;
+    atomic_init(&set->refcount, 1);
+    set->count = 0;
+    
+    FeedFramesCtx ctx = { set, capacity };
+    subscriptions_for_each(bucket, build_feed_frames, &ctx);
+    qsort(set->vehicles, set->count, sizeof(VehicleFrames), compare_vehicle_frames);
+    return set;
+}
+
+TelemetryFrames* telemetry_frames_ref(TelemetryFrames* frames) {
+    if (frames) atomic_fetch_add_explicit(&frames->refcount, 1, memory_order_relaxed);
+    return frames;
+}
+
+// Suelta una referencia; la última libera los frames de todos los vehículos
+void telemetry_frames_release(TelemetryFrames* frames) {
+    if (!frames || atomic_fetch_sub_explicit(&frames->refcount, 1, memory_order_acq_rel) != 1) {
+        return;
+    }
+    for (int v = 0; v < frames->count; v++) {
+        VehicleFrames* vehicle = &frames->vehicles[v];
+        for (int e = 0; e < ENCODING_COUNT; e++) {
+            for (int m = 0; m < TELEMETRY_MODE_COUNT; m++) {
+                frame_unref(vehicle->frames[e][m]);
+            }
+            for (int g = 0; g < vehicle->group_count; g++) {
+                frame_unref(vehicle->groups[g].frames[e]);
+            }
+        }
+        free(vehicle->groups);
+    }
+    free(frames);
+}
+
+// Frames de un vehículo en el tick (búsqueda binaria). NULL si no está.
+const VehicleFrames* telemetry_frames_find(const TelemetryFrames* frames, uint32_t vehicle) {
+    if (!frames) return NULL;
+    
+    int lo = 0, hi = frames->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (frames->vehicles[mid].vehicle < vehicle) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < frames->count && frames->vehicles[lo].vehicle == vehicle ? &frames->vehicles[lo] : NULL;
+}
+
+// Frame que le toca a un suscriptor según su codificación, modo y filtro
+Frame* telemetry_frames_select(const VehicleFrames* frames, ProtocolEncoding encoding,
+                               TelemetryMode mode, const TelemetryFilter* filter) {
+    if (!frames || filter->fields == 0) return NULL;
+    if (telemetry_filter_is_plain(filter)) return frames->frames[encoding][mode];
+    
+    for (int g = 0; g < frames->group_count; g++) {
+        const FilteredFrames* group = &frames->groups[g];
+        if (group->mode == mode && telemetry_filter_equals(&group->filter, filter)) {
+            return group->frames[encoding];
+        }
+    }
+    return NULL;
+}
+
+static int same_state(const VehicleState* a, const VehicleState* b) {
+    return a->speed == b->speed && a->battery == b->battery &&
+           a->temperature == b->temperature && a->is_moving == b->is_moving &&
+           strcmp(a->direction, b->direction) == 0;
+}
+
+// Publica los vehículos [first, last) tras un paso de la física. Lo llama
+// cada thread de la simulación con sus bloques mientras el actor espera en
+// physics_step(): cada vehículo sigue teniendo un solo escritor.
+static void publish_vehicles(uint32_t first, uint32_t last, void* arg) {
+    (void)arg;
+    for (uint32_t id = first; id < last; id++) {
+        Vehicle* v = &vehicles[id];
+        VehicleState next;
+        physics_state(id, &next);
+        // Sin cambios (p. ej. parado y a temperatura ambiente): ni versión
+        // nueva ni frames que recodificar
+        if (same_state(&next, &v->state)) continue;
+        
+        write_begin(v);
+        v->state = next;
+        write_end(v);
+        recorder_record_state(id, &v->state, telemetry_version(id));
+    }
+}
+
+// Arranca la simulación física a 'rate_hz' (paso fijo = periodo de su
+// bucket) con 'threads' threads. Devuelve -1 si falla.
+int telemetry_start_simulation(double rate_hz, int threads, uint32_t seed) {
+    simulation_bucket = scheduler_subscribe(rate_hz);
+    int period_ms = scheduler_period_ms(simulation_bucket);
+    if (physics_start(period_ms / 1000.0, threads, seed, publish_vehicles, NULL) < 0) return -1;
+    
+    char msg[160];
+    snprintf(msg, sizeof(msg), "Simulación física: paso fijo de %d ms, %d thread%s, semilla %u",
+             period_ms, physics_threads(), physics_threads() == 1 ? "" : "s", seed);
+    log_info(msg);
+    return 0;
+}
+
+// Un paso de la simulación de toda la flota (physics.c). Solo desde el actor
+// (actor_simulate).
 void simulate_vehicle_changes() {
-    pthread_mutex_lock(&vehicle_mutex);
+    unsigned long start = metrics_now_ns();
+    physics_step();
+    metrics_record(METRIC_HIST_SIMULATION, metrics_now_ns() - start);
+}
+
+typedef struct {
+    TelemetryFrames** buckets;  // Frames de cada bucket de frecuencia
+    unsigned int due;           // Buckets que vencieron en este tick
+    int sent_count;
+    int failed_count;           // Frames perdidos por clientes que se desconectan
+    int coalesced_count;        // Frames omitidos: el siguiente tick trae el estado nuevo
+} BroadcastCtx;
+
+// Un cliente lento: se omiten sus 'count' frames y, según la política (ver
+// send_queue.h), se desconecta
+static void drop_slow_client(const ClientInfo* client, BroadcastCtx* ctx, int count) {
+    if (send_queue_get_policy() == SLOW_POLICY_DISCONNECT) {
+        ctx->failed_count += count;
+        shutdown(client->socket_fd, SHUT_RDWR);
+        log_message(client->ip, client->port, "SLOW_CONSUMER", 
+                   "Cliente lento desconectado");
+    } else {
+        ctx->coalesced_count += count;
+    }
+}
+
+// Modo threads: no hay cola propia, así que el watermark se aplica sobre lo
+// que el kernel aún tiene pendiente en el socket (SIOCOUTQ). Nunca se bloquea.
+// El cliente recibe un frame por cada vehículo suscrito que tenga algo nuevo.
+// Solo se omiten frames enteros: uno que sale a medias deja el flujo
+// corrupto (en VATP/2.0 el cliente no puede resincronizar), así que el
+// cliente se desconecta sea cual sea la política.
+static void send_to_client(const ClientInfo* client, void* arg) {
+    BroadcastCtx* ctx = arg;
+    
+    if (!(ctx->due & (1u << client->rate_bucket))) return;
     
-    // Consumir batería si está en movimiento
-    if (vehicle_state.is_moving && vehicle_state.battery > 0) {
-        vehicle_state.battery -= 0.5;
-        if (vehicle_state.battery < 0) vehicle_state.battery = 0;
+    const TelemetryFrames* set = ctx->buckets[client->rate_bucket];
+    Frame* frames[MAX_VEHICLE_SUBSCRIPTIONS];
+    int count = 0;
+    for (int i = 0; i < client->vehicle_count; i++) {
+        const VehicleFrames* found = telemetry_frames_find(set, client->vehicles[i]);
+        Frame* frame = telemetry_frames_select(found, client->encoding, client->telemetry_mode,
+                                               &client->filter);
+        if (frame) frames[count++] = frame;
+    }
+    int pending = 0;
+    if (ioctl(client->socket_fd, SIOCOUTQ, &pending) == 0 &&
+        pending > SEND_QUEUE_HIGH_WATERMARK) {
+        // SLOW_POLICY_COALESCE: se omiten estos frames, los siguientes traen el estado más nuevo
+        drop_slow_client(client, ctx, count);
+        return;
     }
     
-    // Temperatura varía ligeramente
-    vehicle_state.temperature += ((float)(rand() % 20 - 10)) / 10.0;
-    if (vehicle_state.temperature < 15.0) vehicle_state.temperature = 15.0;
-    if (vehicle_state.temperature > 45.0) vehicle_state.temperature = 45.0;
+    // Su thread está enviando una respuesta (quizá bloqueado en un cliente
+    // lento): se omite el tick como con un socket lleno, sin esperar
+    if (pthread_mutex_trylock(client->write_lock) != 0) {
+        ctx->coalesced_count += count;
+        return;
+    }
     
-    // Detener si no hay batería
-    if (vehicle_state.battery <= 5.0) {
-        vehicle_state.speed = 0.0;
-        vehicle_state.is_moving = 0;
+    // Sin frames: deltas sin cambios o ningún vehículo suyo en este tick
+    for (int i = 0; i < count; i++) {
+        int sent = send(client->socket_fd, frames[i]->data, frames[i]->len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent == frames[i]->len) {
+            ctx->sent_count++;
+            metrics_add(METRIC_BYTES_OUT, sent);
+            continue;
+        }
+        
+        if (sent > 0) {
+            // Frame a medias: el resto del flujo ya no se puede interpretar
+            metrics_add(METRIC_BYTES_OUT, sent);
+            ctx->failed_count += count - i;
+            shutdown(client->socket_fd, SHUT_RDWR);
+            log_message(client->ip, client->port, "SLOW_CONSUMER",
+                       "Frame de telemetría truncado, cliente desconectado");
+        } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // Socket lleno antes del frame: mismo tratamiento que superar el watermark
+            drop_slow_client(client, ctx, count - i);
+        } else {
+            ctx->failed_count += count - i;
+            // Cliente desconectado: su thread detecta el cierre y se da de baja
+            shutdown(client->socket_fd, SHUT_RDWR);
+            log_message(client->ip, client->port, "DISCONNECTED", 
+                       "Cliente desconectado durante broadcast");
+        }
+        break;
     }
+    pthread_mutex_unlock(client->write_lock);
+}
+
+// Resumen periódico de los contadores del planificador
+static void log_scheduler_stats() {
+    RateBucketStats stats[SCHEDULER_MAX_BUCKETS];
+    int count = scheduler_get_stats(stats, SCHEDULER_MAX_BUCKETS);
     
-    pthread_mutex_unlock(&vehicle_mutex);
+    for (int i = 0; i < count; i++) {
+        char log_msg[256];
+        double jitter_avg_us = stats[i].ticks ? stats[i].jitter_sum_ns / 1000.0 / stats[i].ticks : 0;
+        sprintf(log_msg, "Telemetría cada %d ms: %d suscriptores, %lu ticks, %lu deadlines perdidos, "
+                         "jitter medio %.1f us, máx %.1f us",
+                stats[i].period_ms, stats[i].subscribers, stats[i].ticks, stats[i].missed,
+                jitter_avg_us, stats[i].jitter_max_ns / 1000.0);
+        log_info(log_msg);
+    }
 }
 
 void* telemetry_broadcast_thread(void* arg) {
-    char buffer[BUFFER_SIZE];
+    log_info("Thread de telemetría iniciado (frecuencia por cliente, 0.1-100 Hz)");
+    
+    time_t next_report = time(NULL) + TELEMETRY_STATS_PERIOD;
     
-    log_info("Thread de telemetría iniciado (broadcast cada 10 segundos)");
+    // El historial (del vehículo 0) empieza con el estado inicial y suma una
+    // muestra por tick del bucket por defecto (10 s), sea cual sea --sim-rate
+    VehicleState sample;
+    telemetry_snapshot(0, &sample);
+    history_append(&sample);
     
     while (1) {
-        sleep(10); // Esperar 10 segundos
+        // Bloquea hasta el deadline absoluto más cercano de los buckets
+        unsigned int due = scheduler_wait();
+        if (!due) {
+            sleep(1); // Error del timerfd: reintentar sin girar en vacío
+            continue;
+        }
         
-        simulate_vehicle_changes();
+        // La simulación avanza al ritmo de su bucket (--sim-rate, por defecto
+        // cada 10 s) y el historial al del bucket por defecto
+        if ((due & (1u << simulation_bucket)) && !atomic_load(&replay_mode)) {
+            actor_simulate();
+        }
+        int default_due = due & (1u << SCHEDULER_DEFAULT_BUCKET);
+        if (default_due) {
+            telemetry_snapshot(0, &sample);
+            history_append(&sample);
+        }
         
-        pthread_mutex_lock(&vehicle_mutex);
-        int len = build_telemetry_message(buffer, &vehicle_state);
-        pthread_mutex_unlock(&vehicle_mutex);
+        // Solo se codifican los vehículos con suscriptores en cada bucket
+        // vencido: completos una vez por versión, deltas uno por flujo
+        TelemetryFrames* buckets[SCHEDULER_MAX_BUCKETS] = { NULL };
+        for (int b = 0; b < SCHEDULER_MAX_BUCKETS; b++) {
+            if (due & (1u << b)) buckets[b] = build_bucket_frames(b);
+        }
         
-        // Enviar a todos los clientes activos
-        pthread_mutex_lock(&clients_mutex);
-        int sent_count = 0;
+        int sent_count;
+        metrics_add(METRIC_BROADCAST_TICKS, 1);
+        if (reactor_is_running()) {
+            // En modo epoll el reactor se encarga de repartir los frames (y
+            // cada shard mide su parte del reparto)
+            sent_count = reactor_broadcast(buckets, due);
+        } else {
+            // Enviar a los clientes de esos buckets (sin bloquear altas/bajas)
+            unsigned long start = metrics_now_ns();
+            BroadcastCtx ctx = { buckets, due, 0, 0, 0 };
+            registry_for_each(send_to_client, &ctx);
+            sent_count = ctx.sent_count;
+            metrics_record(METRIC_HIST_FANOUT, metrics_now_ns() - start);
+            metrics_add(METRIC_BROADCAST_SENDS, ctx.sent_count);
+            metrics_add(METRIC_BROADCAST_FAILURES, ctx.failed_count);
+            metrics_add(METRIC_BROADCAST_COALESCED, ctx.coalesced_count);
+        }
+        for (int b = 0; b < SCHEDULER_MAX_BUCKETS; b++) {
+            telemetry_frames_release(buckets[b]);
+        }
+        // Sockets de bajas que ya ningún lector del registro puede ver
+        registry_collect();
         
-        for (int i = 0; i < MAX_CLIENTS; i++) {
-            if (clients[i].active && clients[i].socket_fd > 0) {
-                int sent = send(clients[i].socket_fd, buffer, len, 0);
-                if (sent > 0) {
-                    sent_count++;
-                } else {
-                    // Cliente desconectado
-                    clients[i].active = 0;
-                    close(clients[i].socket_fd);
-                    log_message(clients[i].ip, clients[i].port, "DISCONNECTED", 
-                               "Cliente desconectado durante broadcast");
-                }
-            }
+        // Canal UDP: un envío por tick del canal, con independencia de los observers
+        if (multicast_enabled() && (due & (1u << multicast_bucket()))) {
+            multicast_publish();
         }
         
-        pthread_mutex_unlock(&clients_mutex);
+        // Solo se loguea el tick por defecto: a 100 Hz el log se inundaría
+        if (default_due) {
+            char log_msg[256];
+            sprintf(log_msg, "Telemetría enviada a %d clientes", sent_count);
+            log_info(log_msg);
+        }
         
-        char log_msg[256];
-        sprintf(log_msg, "Telemetría enviada a %d clientes", sent_count);
-        log_info(log_msg);
+        if (time(NULL) >= next_report) {
+            log_scheduler_stats();
+            next_report += TELEMETRY_STATS_PERIOD;
+        }
     }
     
     return NULL;
 }
 
-int can_execute_command(CommandType command, char* reason) {
-    pthread_mutex_lock(&vehicle_mutex);
-    
+// Comprueba si el comando puede ejecutarse sobre el estado dado
+static int can_execute_command(const VehicleState* state, CommandType command, char* reason) {
     // Verificar batería baja
-    if (vehicle_state.battery < 10.0) {
+    if (state->battery < 10.0) {
         strcpy(reason, "Batería demasiado baja");
-        pthread_mutex_unlock(&vehicle_mutex);
         return 0;
     }
     
     // Verificar límite de velocidad
-    if (command == CMD_SPEED_UP && vehicle_state.speed >= 100.0) {
+    if (command == CMD_SPEED_UP && state->speed >= 100.0) {
         strcpy(reason, "Límite de velocidad alcanzado (100 km/h)");
-        pthread_mutex_unlock(&vehicle_mutex);
         return 0;
     }
     
-    if (command == CMD_SLOW_DOWN && vehicle_state.speed <= 0.0) {
+    if (command == CMD_SLOW_DOWN && state->speed <= 0.0) {
         strcpy(reason, "Vehículo ya está detenido");
-        pthread_mutex_unlock(&vehicle_mutex);
         return 0;
     }
     
-    pthread_mutex_unlock(&vehicle_mutex);
     return 1; // Comando puede ejecutarse
 }
 
-static void rotate_direction(int left) {
+static void rotate_direction(VehicleState* state, int left) {
     const char* directions[] = {"NORTH", "EAST", "SOUTH", "WEST"};
     int current = 0;
     
     for (int i = 0; i < 4; i++) {
-        if (strcmp(vehicle_state.direction, directions[i]) == 0) {
+        if (strcmp(state->direction, directions[i]) == 0) {
             current = i;
             break;
         }
     }
     
     current = left ? (current + 3) % 4 : (current + 1) % 4;
-    strcpy(vehicle_state.direction, directions[current]);
+    strcpy(state->direction, directions[current]);
 }
 
-void update_vehicle_state(CommandType command) {
-    pthread_mutex_lock(&vehicle_mutex);
-    
+static void apply_command(VehicleState* state, CommandType command) {
     switch (command) {
         case CMD_SPEED_UP:
-            vehicle_state.speed = (vehicle_state.speed + 10.0 > 100.0) ? 100.0 : vehicle_state.speed + 10.0;
-            vehicle_state.is_moving = 1;
+            state->speed = (state->speed + 10.0 > 100.0) ? 100.0 : state->speed + 10.0;
+            state->is_moving = 1;
             break;
             
         case CMD_SLOW_DOWN:
-            vehicle_state.speed = (vehicle_state.speed - 10.0 < 0.0) ? 0.0 : vehicle_state.speed - 10.0;
-            vehicle_state.is_moving = (vehicle_state.speed > 0.0);
+            state->speed = (state->speed - 10.0 < 0.0) ? 0.0 : state->speed - 10.0;
+            state->is_moving = (state->speed > 0.0);
             break;
             
         case CMD_TURN_LEFT:
-            rotate_direction(1);
+            rotate_direction(state, 1);
             break;
             
         case CMD_TURN_RIGHT:
-            rotate_direction(0);
+            rotate_direction(state, 0);
             break;
             
         default:
             break;
     }
+}
+
+// Valida y aplica una secuencia de comandos sobre un vehículo como una sola
+// transición de estado (todo o nada): cada paso se valida contra el estado
+// que dejó el anterior. Solo la llama el actor (actor_apply_commands): los
+// lotes de dos admins se aplican uno tras otro, en orden de llegada. Devuelve
+// 'count' si se aplicaron todos, con el estado tras cada paso en steps[i];
+// si no, el índice del primer comando rechazado con el motivo en 'reason', y
+// el estado del vehículo no cambia.
+int telemetry_apply_commands(uint32_t vehicle, const CommandType* commands, int count,
+                             VehicleState* steps, char* reason) {
+    if (vehicle >= (uint32_t)vehicle_count) {
+        strcpy(reason, "Vehículo inexistente");
+        return 0;
+    }
+    if (atomic_load(&replay_mode)) {
+        strcpy(reason, "Vehículo en modo reproducción");
+        return 0;
+    }
     
-    pthread_mutex_unlock(&vehicle_mutex);
-}
\ No newline at end of file
+    Vehicle* v = &vehicles[vehicle];
+    
+    VehicleState next = v->state;
+    for (int i = 0; i < count; i++) {
+        if (!can_execute_command(&next, commands[i], reason)) {
+            // Un rechazo no escribe: no cambia la versión ni invalida las cachés
+            return i;
+        }
+        apply_command(&next, commands[i]);
+        steps[i] = next;
+    }
+    
+    write_begin(v);
+    v->state = next;
+    write_end(v);
+    physics_load(vehicle, &v->state);
+    
+    // Cada comando con el estado que dejó; todos comparten la versión publicada
+    unsigned long version = telemetry_version(vehicle);
+    for (int i = 0; i < count; i++) {
+        recorder_record_command(vehicle, commands[i], &steps[i], version);
+    }
+    
+    return count;
+}
@@ -3,14 +3,64 @@
 #define TELEMETRY_H
 
 #include "protocol.h"
+#include "frame.h"
 #include <pthread.h>
+#include <stdatomic.h>
 
-extern VehicleState vehicle_state;
-extern pthread_mutex_t vehicle_mutex;
+// Cada cuánto se loguean los contadores del planificador (segundos)
+#define TELEMETRY_STATS_PERIOD 60
+// Ticks de un bucket entre keyframes del modo delta (por defecto)
+#define TELEMETRY_KEYFRAME_INTERVAL 50
+// Tamaño máximo de la flota (--vehicles)
+#define TELEMETRY_MAX_VEHICLES 1000000
 
-void telemetry_init();
+// Frames de un grupo de suscriptores con el mismo filtro y modo
+typedef struct {
+    TelemetryFilter filter;
+    TelemetryMode mode;
+    Frame* frames[ENCODING_COUNT];
+} FilteredFrames;
+
+// Frames de un vehículo en un tick: uno por codificación y modo para los
+// suscriptores sin filtro y uno por codificación para cada grupo con filtro
+// (NULL si no hay nada que enviar, p. ej. un delta sin cambios)
+typedef struct {
+    uint32_t vehicle;
+    Frame* frames[ENCODING_COUNT][TELEMETRY_MODE_COUNT];
+    FilteredFrames* groups;
+    int group_count;
+} VehicleFrames;
+
+// Frames de un tick para un bucket de frecuencia: los de cada vehículo con
+// suscriptores en el bucket, ordenados por ID. No cambia una vez publicado y
+// lo comparten los shards del reactor (contador de referencias).
+typedef struct {
+    atomic_int refcount;
+    int count;
+    VehicleFrames vehicles[];
+} TelemetryFrames;
+
+int telemetry_init(int vehicle_count);
+int telemetry_start_simulation(double rate_hz, int threads, uint32_t seed);
+int telemetry_vehicle_count();
+void telemetry_set_replay(int enabled);
+unsigned long telemetry_snapshot(uint32_t vehicle, VehicleState* out);
+unsigned long telemetry_version(uint32_t vehicle);
+Frame* telemetry_get_frame(uint32_t vehicle, ProtocolEncoding encoding);
+Frame* telemetry_get_keyframe(int bucket, uint32_t vehicle, const TelemetryFilter* filter,
+                              ProtocolEncoding encoding);
+TelemetryFrames* telemetry_frames_ref(TelemetryFrames* frames);
+void telemetry_frames_release(TelemetryFrames* frames);
+const VehicleFrames* telemetry_frames_find(const TelemetryFrames* frames, uint32_t vehicle);
+Frame* telemetry_frames_select(const VehicleFrames* frames, ProtocolEncoding encoding,
+                               TelemetryMode mode, const TelemetryFilter* filter);
+void telemetry_set_keyframe_interval(int interval);
 void* telemetry_broadcast_thread(void* arg);
-void update_vehicle_state(CommandType command);
-int can_execute_command(CommandType command, char* reason);
 
-#endif // TELEMETRY_H
\ No newline at end of file
+// Escritores del estado de la flota: solo los llama el actor (actor.c)
+void telemetry_set_state(uint32_t vehicle, const VehicleState* state);
+void simulate_vehicle_changes();
+int telemetry_apply_commands(uint32_t vehicle, const CommandType* commands, int count,
+                             VehicleState* steps, char* reason);
+
+#endif // TELEMETRY_H
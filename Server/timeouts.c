@@ -0,0 +1,173 @@
+// ============= timeouts.c =============
+// Plazos de handshake, autenticación e inactividad de las conexiones, sobre
+// la rueda de temporizadores (sin SO_RCVTIMEO por socket). Al vencer, la
+// conexión se cierra y pasa por remove_client() como cualquier otra baja.
+#include "timeouts.h"
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+extern volatile sig_atomic_t server_running;
+
+static unsigned long handshake_ticks = TIMEOUT_DEFAULT_HANDSHAKE_MS / TIMEOUT_TICK_MS;
+static unsigned long auth_ticks = TIMEOUT_DEFAULT_AUTH_MS / TIMEOUT_TICK_MS;
+static unsigned long idle_ticks = TIMEOUT_DEFAULT_IDLE_MS / TIMEOUT_TICK_MS;
+
+// Rueda del modo threads
+static pthread_mutex_t shared_mutex = PTHREAD_MUTEX_INITIALIZER;
+static TimerWheel shared_wheel;
+static int shared_ready = 0;
+
+// Redondea hacia arriba: un plazo nunca vence antes de lo pedido
+static unsigned long ms_to_ticks(int ms) {
+    return ms > 0 ? (ms + TIMEOUT_TICK_MS - 1) / TIMEOUT_TICK_MS : 0;
+}
+
+void timeouts_configure(int handshake_ms, int auth_ms, int idle_ms) {
+    handshake_ticks = ms_to_ticks(handshake_ms);
+    auth_ticks = ms_to_ticks(auth_ms);
+    idle_ticks = ms_to_ticks(idle_ms);
+}
+
+unsigned long timeouts_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * (1000 / TIMEOUT_TICK_MS) + ts.tv_nsec / (TIMEOUT_TICK_MS * 1000000L);
+}
+
+const char* timeout_reason(TimeoutKind kind) {
+    switch (kind) {
+        case TIMEOUT_HANDSHAKE: return "Sin CONNECT dentro del plazo";
+        case TIMEOUT_AUTH: return "Sin AUTH dentro del plazo";
+        case TIMEOUT_IDLE: return "Inactividad";
+        default: return "Sin plazo vencido";
+    }
+}
+
+// Plazo más cercano de la conexión y de qué tipo es
+static unsigned long next_deadline(const ConnTimer* timer, TimeoutKind* kind) {
+    unsigned long deadline = ULONG_MAX;
+    *kind = TIMEOUT_NONE;
+
+    if (timer->phase == SESSION_HANDSHAKE && handshake_ticks) {
+        deadline = timer->phase_start + handshake_ticks;
+        *kind = TIMEOUT_HANDSHAKE;
+    }
+    if (timer->phase == SESSION_AUTH && auth_ticks) {
+        deadline = timer->phase_start + auth_ticks;
+        *kind = TIMEOUT_AUTH;
+    }
+    if (idle_ticks && timer->last_activity + idle_ticks < deadline) {
+        deadline = timer->last_activity + idle_ticks;
+        *kind = TIMEOUT_IDLE;
+    }
+    return deadline;
+}
+
+static void schedule(TimerWheel* wheel, ConnTimer* timer) {
+    TimeoutKind kind;
+    unsigned long deadline = next_deadline(timer, &kind);
+
+    if (kind == TIMEOUT_NONE) {
+        timer_wheel_remove(&timer->timer);
+    } else {
+        timer_wheel_add(wheel, &timer->timer, deadline);
+    }
+}
+
+void conn_timer_start(TimerWheel* wheel, ConnTimer* timer, int fd) {
+    timer->timer.next = NULL;
+    timer->timer.pprev = NULL;
+    timer->fd = fd;
+    timer->phase = SESSION_HANDSHAKE;
+    timer->phase_start = timer->last_activity = timeouts_now();
+    atomic_init(&timer->expired, TIMEOUT_NONE);
+    schedule(wheel, timer);
+}
+
+// Llamar tras cada mensaje: anota la actividad y, si el mensaje cambió la
+// fase de la sesión (CONNECT, AUTH), reprograma el temporizador
+void conn_timer_update(TimerWheel* wheel, ConnTimer* timer, SessionPhase phase) {
+    timer->last_activity = timeouts_now();
+    if (phase == timer->phase) return;
+
+    timer->phase = phase;
+    timer->phase_start = timer->last_activity;
+    schedule(wheel, timer);
+}
+
+void conn_timer_stop(ConnTimer* timer) {
+    timer_wheel_remove(&timer->timer);
+}
+
+// Para un temporizador que la rueda acaba de devolver: el motivo si el plazo
+// venció de verdad o TIMEOUT_NONE tras reprogramarlo (hubo actividad)
+TimeoutKind conn_timer_fire(TimerWheel* wheel, ConnTimer* timer) {
+    TimeoutKind kind;
+    unsigned long deadline = next_deadline(timer, &kind);
+
+    if (kind != TIMEOUT_NONE && deadline <= wheel->now) return kind;
+    schedule(wheel, timer);
+    return TIMEOUT_NONE;
+}
+
+// ---- Modo threads ----
+
+void timeouts_shared_start(ConnTimer* timer, int fd) {
+    pthread_mutex_lock(&shared_mutex);
+    if (!shared_ready) {
+        timer_wheel_init(&shared_wheel, timeouts_now());
+        shared_ready = 1;
+    }
+    conn_timer_start(&shared_wheel, timer, fd);
+    pthread_mutex_unlock(&shared_mutex);
+}
+
+void timeouts_shared_update(ConnTimer* timer, SessionPhase phase) {
+    pthread_mutex_lock(&shared_mutex);
+    conn_timer_update(&shared_wheel, timer, phase);
+    pthread_mutex_unlock(&shared_mutex);
+}
+
+// Saca el temporizador de la rueda. Devuelve el motivo si la conexión se
+// cerró por un plazo vencido.
+TimeoutKind timeouts_shared_stop(ConnTimer* timer) {
+    pthread_mutex_lock(&shared_mutex);
+    conn_timer_stop(timer);
+    pthread_mutex_unlock(&shared_mutex);
+    return atomic_load(&timer->expired);
+}
+
+// Avanza la rueda compartida cada tick. Un plazo vencido cierra el socket en
+// ambos sentidos: el recv() del thread del cliente vuelve y este hace la
+// limpieza habitual (remove_client).
+void* timeouts_reaper_thread(void* arg) {
+    (void)arg;
+
+    while (server_running) {
+        usleep(TIMEOUT_TICK_MS * 1000);
+
+        pthread_mutex_lock(&shared_mutex);
+        if (!shared_ready) {
+            pthread_mutex_unlock(&shared_mutex);
+            continue;
+        }
+
+        TimerEntry* expired = timer_wheel_advance(&shared_wheel, timeouts_now());
+        while (expired) {
+            ConnTimer* timer = (ConnTimer*)expired;
+            expired = expired->next;
+
+            TimeoutKind kind = conn_timer_fire(&shared_wheel, timer);
+            if (kind != TIMEOUT_NONE) {
+                atomic_store(&timer->expired, kind);
+                shutdown(timer->fd, SHUT_RDWR);
+            }
+        }
+        pthread_mutex_unlock(&shared_mutex);
+    }
+    return NULL;
+}
@@ -0,0 +1,53 @@
+// ============= timeouts.h =============
+#ifndef TIMEOUTS_H
+#define TIMEOUTS_H
+
+#include "timer_wheel.h"
+#include "client_handler.h"
+#include <stdatomic.h>
+
+// Resolución de los plazos: un tick de la rueda
+#define TIMEOUT_TICK_MS 100
+// Plazos por defecto (0 = desactivado). La inactividad va desactivada porque
+// los observers solo reciben y nunca envían.
+#define TIMEOUT_DEFAULT_HANDSHAKE_MS 10000
+#define TIMEOUT_DEFAULT_AUTH_MS 30000
+#define TIMEOUT_DEFAULT_IDLE_MS 0
+
+typedef enum {
+    TIMEOUT_NONE,
+    TIMEOUT_HANDSHAKE,   // Sin CONNECT a tiempo
+    TIMEOUT_AUTH,        // Admin sin AUTH a tiempo
+    TIMEOUT_IDLE         // Sin mensajes durante el plazo de inactividad
+} TimeoutKind;
+
+// Plazos de una conexión. Un solo temporizador por conexión, programado al
+// plazo más cercano; la actividad solo anota la hora y, al vencer, el
+// temporizador se reprograma si la conexión se movió entretanto.
+typedef struct {
+    TimerEntry timer;            // Primero: la rueda devuelve punteros a él
+    int fd;                      // Modo threads: socket que se cierra al vencer
+    SessionPhase phase;
+    unsigned long phase_start;   // Ticks
+    unsigned long last_activity; // Ticks
+    atomic_int expired;          // Modo threads: motivo del cierre (TimeoutKind)
+} ConnTimer;
+
+void timeouts_configure(int handshake_ms, int auth_ms, int idle_ms);
+unsigned long timeouts_now();
+const char* timeout_reason(TimeoutKind kind);
+
+// Sobre una rueda propia (un shard del reactor, bajo su thread)
+void conn_timer_start(TimerWheel* wheel, ConnTimer* timer, int fd);
+void conn_timer_update(TimerWheel* wheel, ConnTimer* timer, SessionPhase phase);
+void conn_timer_stop(ConnTimer* timer);
+TimeoutKind conn_timer_fire(TimerWheel* wheel, ConnTimer* timer);
+
+// Modo threads: rueda compartida con su mutex y un thread que la avanza y
+// cierra los sockets vencidos (el thread del cliente hace la limpieza)
+void timeouts_shared_start(ConnTimer* timer, int fd);
+void timeouts_shared_update(ConnTimer* timer, SessionPhase phase);
+TimeoutKind timeouts_shared_stop(ConnTimer* timer);
+void* timeouts_reaper_thread(void* arg);
+
+#endif // TIMEOUTS_H
@@ -0,0 +1,111 @@
+// ============= timer_wheel.c =============
+// Rueda de temporizadores jerárquica (ver timer_wheel.h). No es thread-safe:
+// cada rueda pertenece a quien la avanza (un shard, un reactor) y se protege
+// con su lock.
+#include "timer_wheel.h"
+#include <string.h>
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+void timer_wheel_init(TimerWheel* wheel, unsigned long now) {
+    memset(wheel->slots, 0, sizeof(wheel->slots));
+    wheel->now = now;
+}
+
+static void link_entry(TimerEntry** head, TimerEntry* entry) {
+    entry->next = *head;
+    entry->pprev = head;
+    if (*head) (*head)->pprev = &entry->next;
+    *head = entry;
+}
+
+// Elige el nivel por la distancia al vencimiento y el slot por los bits del
+// tick de vencimiento que corresponden a ese nivel. Lo ya vencido va al tick
+// 'first' (el próximo al añadir, el actual al bajar de nivel).
+static void place(TimerWheel* wheel, TimerEntry* entry, unsigned long first) {
+    unsigned long expires = entry->expires;
+    if (expires < first) expires = first;
+
+    unsigned long delta = expires - wheel->now;
+    int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 &&
+           delta >= 1UL << (TIMER_WHEEL_BITS * (level + 1))) {
+        level++;
+    }
+
+    // Más allá del último nivel: se recoloca cuando llegue su vuelta
+    unsigned long limit = 1UL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS);
+    if (delta >= limit) expires = wheel->now + limit - 1;
+
+    int slot = (expires >> (TIMER_WHEEL_BITS * level)) & SLOT_MASK;
+    link_entry(&wheel->slots[level][slot], entry);
+}
+
+void timer_wheel_add(TimerWheel* wheel, TimerEntry* entry, unsigned long expires) {
+    if (entry->pprev) timer_wheel_remove(entry);
+    entry->expires = expires;
+    place(wheel, entry, wheel->now + 1);
+}
+
+void timer_wheel_remove(TimerEntry* entry) {
+    if (!entry->pprev) return;
+    *entry->pprev = entry->next;
+    if (entry->next) entry->next->pprev = entry->pprev;
+    entry->next = NULL;
+    entry->pprev = NULL;
+}
+
+int timer_wheel_pending(const TimerEntry* entry) {
+    return entry->pprev != NULL;
+}
+
+// Baja los temporizadores de un slot de nivel superior a su nivel definitivo
+static void cascade(TimerWheel* wheel, int level, int slot) {
+    TimerEntry* entry = wheel->slots[level][slot];
+    wheel->slots[level][slot] = NULL;
+
+    while (entry) {
+        TimerEntry* next = entry->next;
+        place(wheel, entry, wheel->now);
+        entry = next;
+    }
+}
+
+// Avanza la rueda hasta 'now' y devuelve los temporizadores vencidos como
+// lista enlazada por 'next' (ya fuera de la rueda). El llamador los recorre
+// y puede volver a añadirlos.
+TimerEntry* timer_wheel_advance(TimerWheel* wheel, unsigned long now) {
+    TimerEntry* expired = NULL;
+
+    while (wheel->now < now) {
+        wheel->now++;
+
+        // Al dar la vuelta un nivel, baja el slot que toca del siguiente,
+        // empezando por el más alto para que todo acabe en su sitio
+        int top = 0;
+        while (top < TIMER_WHEEL_LEVELS - 1 &&
+               !(wheel->now & ((1UL << (TIMER_WHEEL_BITS * (top + 1))) - 1))) {
+            top++;
+        }
+        for (int level = top; level >= 1; level--) {
+            cascade(wheel, level, (wheel->now >> (TIMER_WHEEL_BITS * level)) & SLOT_MASK);
+        }
+
+        int slot = wheel->now & SLOT_MASK;
+        TimerEntry* entry = wheel->slots[0][slot];
+        wheel->slots[0][slot] = NULL;
+
+        while (entry) {
+            TimerEntry* next = entry->next;
+            if (entry->expires <= wheel->now) {
+                entry->pprev = NULL;
+                entry->next = expired;
+                expired = entry;
+            } else {
+                place(wheel, entry, wheel->now + 1); // Lejano (más de 64^4 ticks): otra vuelta
+            }
+            entry = next;
+        }
+    }
+    return expired;
+}
@@ -0,0 +1,31 @@
+// ============= timer_wheel.h =============
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+// Rueda de temporizadores jerárquica: 4 niveles de 64 slots. El nivel 0
+// avanza un slot por tick y cada nivel superior cubre 64 veces más tiempo
+// (hasta 64^4 ticks). Alta, baja y vencimiento en O(1): un temporizador
+// lejano baja de nivel solo cuando su slot llega a la cabeza.
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+
+// Intrusivo: se embebe en la estructura que se quiere temporizar
+typedef struct TimerEntry {
+    struct TimerEntry* next;
+    struct TimerEntry** pprev;   // NULL si no está en la rueda
+    unsigned long expires;       // Tick en que vence
+} TimerEntry;
+
+typedef struct {
+    unsigned long now;           // Último tick procesado
+    TimerEntry* slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+} TimerWheel;
+
+void timer_wheel_init(TimerWheel* wheel, unsigned long now);
+void timer_wheel_add(TimerWheel* wheel, TimerEntry* entry, unsigned long expires);
+void timer_wheel_remove(TimerEntry* entry);
+int timer_wheel_pending(const TimerEntry* entry);
+TimerEntry* timer_wheel_advance(TimerWheel* wheel, unsigned long now);
+
+#endif // TIMER_WHEEL_H
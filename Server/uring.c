@@ -0,0 +1,276 @@
+// ============= uring.c =============
+// Lo mínimo de io_uring para el reactor, directamente sobre io_uring_setup,
+// io_uring_enter e io_uring_register (sin liburing): mapeo de los anillos,
+// SQEs, completados y anillos de buffers provistos.
+//
+// Orden de memoria: el kernel lee la cola de envío hasta 'sq_tail' (se
+// publica con release) y escribe la de completados hasta 'cq_tail' (se lee
+// con acquire); 'cq_head' se devuelve con release cuando el CQE ya se copió.
+#define _GNU_SOURCE
+#include "uring.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+static int sys_setup(unsigned int entries, struct io_uring_params* params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sys_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+                     unsigned int flags, void* arg, size_t arg_size) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+static int sys_register(int fd, unsigned int opcode, void* arg, unsigned int nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// Crea el anillo con las opciones que reducen el trabajo por llamada; un
+// kernel que no conozca alguna (EINVAL) se reintenta sin ellas
+static int setup_ring(unsigned int entries, struct io_uring_params* params) {
+    static const unsigned int attempts[] = {
+        IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN |
+            IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN,
+        IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN,
+        IORING_SETUP_CQSIZE
+    };
+
+    for (size_t i = 0; i < sizeof(attempts) / sizeof(attempts[0]); i++) {
+        memset(params, 0, sizeof(*params));
+        params->flags = attempts[i];
+        params->cq_entries = entries * 4;
+        int fd = sys_setup(entries, params);
+        if (fd >= 0 || errno != EINVAL) return fd < 0 ? -errno : fd;
+    }
+    return -EINVAL;
+}
+
+int uring_init(Uring* ring, unsigned int entries) {
+    struct io_uring_params params;
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+
+    int fd = setup_ring(entries, &params);
+    if (fd < 0) return fd;
+    // SQ y CQ en un solo mapeo (Linux 5.4+) y plazo en io_uring_enter (5.11+)
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) ||
+        !(params.features & IORING_FEAT_EXT_ARG)) {
+        close(fd);
+        return -ENOSYS;
+    }
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ring_size = sq_size > cq_size ? sq_size : cq_size;
+    ring->ring_ptr = mmap(NULL, ring->ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->ring_ptr == MAP_FAILED) {
+        close(fd);
+        return -errno;
+    }
+
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        int error = -errno;
+        munmap(ring->ring_ptr, ring->ring_size);
+        close(fd);
+        return error;
+    }
+
+    char* base = ring->ring_ptr;
+    ring->fd = fd;
+    ring->flags = params.flags;
+    ring->sq_head = (unsigned int*)(base + params.sq_off.head);
+    ring->sq_tail = (unsigned int*)(base + params.sq_off.tail);
+    ring->sq_mask = *(unsigned int*)(base + params.sq_off.ring_mask);
+    ring->cq_head = (unsigned int*)(base + params.cq_off.head);
+    ring->cq_tail = (unsigned int*)(base + params.cq_off.tail);
+    ring->cq_mask = *(unsigned int*)(base + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(base + params.cq_off.cqes);
+
+    // La SQE i siempre ocupa el hueco i
+    unsigned int* array = (unsigned int*)(base + params.sq_off.array);
+    for (unsigned int i = 0; i < params.sq_entries; i++) array[i] = i;
+    ring->sq_local_tail = *ring->sq_tail;
+    return 0;
+}
+
+void uring_exit(Uring* ring) {
+    if (ring->fd < 0) return;
+    munmap(ring->sqes, ring->sqes_size);
+    munmap(ring->ring_ptr, ring->ring_size);
+    close(ring->fd);
+    ring->fd = -1;
+}
+
+// Publica las SQEs preparadas para que el kernel las vea
+static void publish(Uring* ring) {
+    unsigned int tail = *ring->sq_tail;
+    if (tail == ring->sq_local_tail) return;
+    ring->sq_pending += ring->sq_local_tail - tail;
+    __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+}
+
+static int enter(Uring* ring, unsigned int min_complete, unsigned int flags, void* arg,
+                 size_t arg_size) {
+    publish(ring);
+    while (1) {
+        int submitted = sys_enter(ring->fd, ring->sq_pending, min_complete, flags, arg, arg_size);
+        if (submitted >= 0) {
+            ring->sq_pending -= (unsigned int)submitted < ring->sq_pending ?
+                                (unsigned int)submitted : ring->sq_pending;
+            return 0;
+        }
+        if (errno == EINTR) continue;
+        // Sin completados antes del plazo, o CQ desbordada: hay que vaciarla
+        if (errno == ETIME || errno == EBUSY || errno == EAGAIN) return 0;
+        return -errno;
+    }
+}
+
+struct io_uring_sqe* uring_get_sqe(Uring* ring) {
+    unsigned int head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sq_local_tail - head > ring->sq_mask) {
+        // Llena: enviar lo que hay (con DEFER_TASKRUN también corre el trabajo pendiente)
+        unsigned int flags = (ring->flags & IORING_SETUP_DEFER_TASKRUN) ? IORING_ENTER_GETEVENTS : 0;
+        if (enter(ring, 0, flags, NULL, 0) < 0) return NULL;
+        head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        if (ring->sq_local_tail - head > ring->sq_mask) return NULL;
+    }
+
+    struct io_uring_sqe* sqe = &ring->sqes[ring->sq_local_tail & ring->sq_mask];
+    ring->sq_local_tail++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int uring_submit_and_wait(Uring* ring, int timeout_ms) {
+    struct __kernel_timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = (unsigned long long)(uintptr_t)&ts;
+
+    return enter(ring, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+int uring_next_cqe(Uring* ring, struct io_uring_cqe* cqe) {
+    unsigned int head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) return 0;
+
+    *cqe = ring->cqes[head & ring->cq_mask];
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+int uring_buf_ring_init(Uring* ring, UringBufRing* buffers, unsigned short group,
+                        unsigned int entries, unsigned int buffer_size) {
+    memset(buffers, 0, sizeof(*buffers));
+    size_t ring_bytes = entries * sizeof(struct io_uring_buf);
+
+    // El anillo tiene que estar alineado a página
+    void* mem = mmap(NULL, ring_bytes, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) return -errno;
+    buffers->ring = mem;
+    buffers->entries = entries;
+    buffers->buffer_size = buffer_size;
+    buffers->buffers = aligned_alloc(64, (size_t)entries * buffer_size);
+    if (!buffers->buffers) {
+        uring_buf_ring_free(buffers);
+        return -ENOMEM;
+    }
+    buffers->group = group;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long long)(uintptr_t)mem;
+    reg.ring_entries = entries;
+    reg.bgid = group;
+    if (sys_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        int error = -errno;
+        uring_buf_ring_free(buffers);
+        return error;
+    }
+
+    for (unsigned int bid = 0; bid < entries; bid++) {
+        uring_buf_recycle(buffers, bid);
+    }
+    return 0;
+}
+
+// El anillo sigue registrado hasta que se cierre el io_uring
+void uring_buf_ring_free(UringBufRing* buffers) {
+    if (buffers->ring) munmap(buffers->ring, buffers->entries * sizeof(struct io_uring_buf));
+    free(buffers->buffers);
+    memset(buffers, 0, sizeof(*buffers));
+}
+
+char* uring_buf_ptr(UringBufRing* buffers, unsigned int bid) {
+    return buffers->buffers + (size_t)bid * buffers->buffer_size;
+}
+
+void uring_buf_recycle(UringBufRing* buffers, unsigned int bid) {
+    struct io_uring_buf* buf = &buffers->ring->bufs[buffers->tail & (buffers->entries - 1)];
+    buf->addr = (unsigned long long)(uintptr_t)uring_buf_ptr(buffers, bid);
+    buf->len = buffers->buffer_size;
+    buf->bid = bid;
+    buffers->tail++;
+    __atomic_store_n(&buffers->ring->tail, buffers->tail, __ATOMIC_RELEASE);
+}
+
+void uring_prep_accept_multishot(struct io_uring_sqe* sqe, int fd, int flags, unsigned long long data) {
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->accept_flags = flags;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = data;
+}
+
+void uring_prep_recv_multishot(struct io_uring_sqe* sqe, int fd, unsigned short group,
+                               unsigned long long data) {
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = group;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data = data;
+}
+
+void uring_prep_sendmsg(struct io_uring_sqe* sqe, int fd, const struct msghdr* msg, int flags,
+                        unsigned long long data) {
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long long)(uintptr_t)msg;
+    sqe->len = 1;
+    sqe->msg_flags = flags;
+    sqe->user_data = data;
+}
+
+void uring_prep_read(struct io_uring_sqe* sqe, int fd, void* buffer, unsigned int len,
+                     unsigned long long data) {
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long long)(uintptr_t)buffer;
+    sqe->len = len;
+    sqe->off = (unsigned long long)-1; // Posición actual (eventfd no la tiene)
+    sqe->user_data = data;
+}
+
+void uring_prep_cancel(struct io_uring_sqe* sqe, unsigned long long target,
+                       unsigned long long data) {
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = data;
+}
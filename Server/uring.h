@@ -0,0 +1,84 @@
+// ============= uring.h =============
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <stddef.h>
+
+// Entradas de la cola de envío de cada anillo (la de completados es 4 veces
+// mayor: recv y accept multishot generan varias por petición)
+#define URING_QUEUE_DEPTH 4096
+// Buffers provistos para recv, por anillo (potencia de 2)
+#define URING_RECV_BUFFERS 1024
+#define URING_RECV_BUFFER_SIZE 2048
+
+// Anillo de io_uring sobre las llamadas al sistema, sin liburing. Un solo
+// thread lo usa (IORING_SETUP_SINGLE_ISSUER).
+typedef struct {
+    int fd;
+    unsigned int flags;             // IORING_SETUP_* con los que se creó
+
+    // Cola de envío (SQ); el array de índices es la identidad
+    unsigned int* sq_head;
+    unsigned int* sq_tail;
+    unsigned int sq_mask;
+    unsigned int sq_local_tail;     // SQEs preparadas, aún sin publicar
+    unsigned int sq_pending;        // Publicadas pero no enviadas al kernel
+    struct io_uring_sqe* sqes;
+
+    // Cola de completados (CQ)
+    unsigned int* cq_head;
+    unsigned int* cq_tail;
+    unsigned int cq_mask;
+    struct io_uring_cqe* cqes;
+
+    void* ring_ptr;
+    size_t ring_size;
+    size_t sqes_size;
+} Uring;
+
+// Anillo de buffers provistos (IORING_REGISTER_PBUF_RING): el kernel elige
+// un buffer libre para cada recv y la aplicación lo devuelve tras copiarlo
+typedef struct {
+    struct io_uring_buf_ring* ring;
+    char* buffers;
+    unsigned int entries;
+    unsigned int buffer_size;
+    unsigned short group;
+    unsigned short tail;
+} UringBufRing;
+
+// Devuelve 0 o -errno (p. ej. -ENOSYS sin soporte de io_uring)
+int uring_init(Uring* ring, unsigned int entries);
+void uring_exit(Uring* ring);
+
+// SQE libre y a cero; si la cola está llena envía lo pendiente primero.
+// NULL solo si falla io_uring_enter().
+struct io_uring_sqe* uring_get_sqe(Uring* ring);
+// Envía lo pendiente y espera al menos un completado o 'timeout_ms'. Una
+// sola llamada al sistema. Devuelve 0 o -errno.
+int uring_submit_and_wait(Uring* ring, int timeout_ms);
+// Copia el siguiente completado en 'cqe' y lo consume. Devuelve 0 si no hay.
+int uring_next_cqe(Uring* ring, struct io_uring_cqe* cqe);
+
+int uring_buf_ring_init(Uring* ring, UringBufRing* buffers, unsigned short group,
+                        unsigned int entries, unsigned int buffer_size);
+void uring_buf_ring_free(UringBufRing* buffers);
+char* uring_buf_ptr(UringBufRing* buffers, unsigned int bid);
+// Devuelve el buffer 'bid' al anillo
+void uring_buf_recycle(UringBufRing* buffers, unsigned int bid);
+
+// Preparación de peticiones
+void uring_prep_accept_multishot(struct io_uring_sqe* sqe, int fd, int flags, unsigned long long data);
+void uring_prep_recv_multishot(struct io_uring_sqe* sqe, int fd, unsigned short group,
+                               unsigned long long data);
+void uring_prep_sendmsg(struct io_uring_sqe* sqe, int fd, const struct msghdr* msg, int flags,
+                        unsigned long long data);
+void uring_prep_read(struct io_uring_sqe* sqe, int fd, void* buffer, unsigned int len,
+                     unsigned long long data);
+// Cancela la petición en vuelo cuyo user_data es 'target'
+void uring_prep_cancel(struct io_uring_sqe* sqe, unsigned long long target,
+                       unsigned long long data);
+
+#endif // URING_H